@@ -17,6 +17,8 @@
 #include <string.h>
 #include "journal.h"
 #include "bytes.h"
+#include "../../inc/nand_stats.h"
+#include "../../inc/nand_trace.h"
 
 /************************************************************************
  * Metapage binary format
@@ -188,6 +190,7 @@ static void reset_journal(struct dhara_journal *j)
 	j->tail = 0;
 	j->tail_sync = 0;
 	j->root = DHARA_PAGE_NONE;
+	j->erased = DHARA_BLOCK_NONE;
 
 	/* No recovery required */
 	clear_recovery(j);
@@ -211,6 +214,8 @@ void dhara_journal_init(struct dhara_journal *j,
 	j->nand = n;
 	j->page_buf = page_buf;
 	j->log2_ppc = choose_ppc(n->log2_page_size, n->log2_ppb);
+	memset(&j->stats, 0, sizeof(j->stats));
+	j->pin = DHARA_PAGE_NONE;
 
 	reset_journal(j);
 }
@@ -459,6 +464,7 @@ int dhara_journal_resume(struct dhara_journal *j, dhara_error_t *err)
 
 	j->flags = 0;
 	j->tail_sync = j->tail;
+	j->erased = DHARA_BLOCK_NONE;
 
 	clear_recovery(j);
 	return 0;
@@ -509,6 +515,7 @@ int dhara_journal_read_meta(struct dhara_journal *j, dhara_page_t p,
 	/* Offset of metadata within the metadata page */
 	const dhara_page_t ppc_mask = (1 << j->log2_ppc) - 1;
 	const size_t offset = hdr_user_offset(p & ppc_mask);
+	int ret;
 
 	/* Special case: buffered metadata */
 	if (align_eq(p, j->head, j->log2_ppc)) {
@@ -526,9 +533,16 @@ int dhara_journal_read_meta(struct dhara_journal *j, dhara_page_t p,
 				       buf, err);
 
 	/* General case: fetch from metadata page for checkpoint group */
-	return dhara_nand_read(j->nand, p | ppc_mask,
-			       offset, DHARA_META_SIZE,
-			       buf, err);
+	NAND_STATS_START(start);
+	NAND_TRACE_START(trace_start);
+	ret = dhara_nand_read(j->nand, p | ppc_mask,
+			      offset, DHARA_META_SIZE,
+			      buf, err);
+	NAND_STATS_STOP(NAND_STATS_META_READ, start);
+	NAND_TRACE_END(NAND_TRACE_META_READ, 0, p | ppc_mask, 0,
+		       trace_start);
+
+	return ret;
 }
 
 dhara_page_t dhara_journal_peek(struct dhara_journal *j)
@@ -595,13 +609,25 @@ void dhara_journal_clear(struct dhara_journal *j)
 	hdr_clear_user(j->page_buf, j->nand->log2_page_size);
 }
 
+void dhara_journal_pin(struct dhara_journal *j)
+{
+	j->pin = j->tail_sync;
+}
+
+void dhara_journal_unpin(struct dhara_journal *j)
+{
+	j->pin = DHARA_PAGE_NONE;
+}
+
 static int skip_block(struct dhara_journal *j, dhara_error_t *err)
 {
 	const dhara_block_t next = next_block(j->nand,
 		j->head >> j->nand->log2_ppb);
 
-	/* We can't roll onto the same block as the tail */
-	if ((j->tail_sync >> j->nand->log2_ppb) == next) {
+	/* We can't roll onto the same block as the tail or the pin */
+	if ((j->tail_sync >> j->nand->log2_ppb) == next ||
+	    (j->pin != DHARA_PAGE_NONE &&
+	     (j->pin >> j->nand->log2_ppb) == next)) {
 		dhara_set_error(err, DHARA_E_JOURNAL_FULL);
 		return -1;
 	}
@@ -628,6 +654,14 @@ static int prepare_head(struct dhara_journal *j, dhara_error_t *err)
 		return -1;
 	}
 
+	/* The same applies to the block of a snapshot pin */
+	if (j->pin != DHARA_PAGE_NONE &&
+	    align_eq(next, j->pin, j->nand->log2_ppb) &&
+	    !align_eq(next, j->head, j->nand->log2_ppb)) {
+		dhara_set_error(err, DHARA_E_JOURNAL_FULL);
+		return -1;
+	}
+
 	j->flags |= DHARA_JOURNAL_F_DIRTY;
 	if (!is_aligned(j->head, j->nand->log2_ppb))
 		return 0;
@@ -635,8 +669,19 @@ static int prepare_head(struct dhara_journal *j, dhara_error_t *err)
 	for (i = 0; i < DHARA_MAX_RETRIES; i++) {
 		const dhara_block_t blk = j->head >> j->nand->log2_ppb;
 
-		if (!dhara_nand_is_bad(j->nand, blk))
-			return dhara_nand_erase(j->nand, blk, err);
+		/* Erased ahead, and known to be good */
+		if (blk == j->erased) {
+			j->erased = DHARA_BLOCK_NONE;
+			return 0;
+		}
+
+		if (!dhara_nand_is_bad(j->nand, blk)) {
+			if (dhara_nand_erase(j->nand, blk, err) < 0)
+				return -1;
+
+			j->stats.erases++;
+			return 0;
+		}
 
 		j->bb_current++;
 		if (skip_block(j, err) < 0)
@@ -647,6 +692,51 @@ static int prepare_head(struct dhara_journal *j, dhara_error_t *err)
 	return -1;
 }
 
+int dhara_journal_erase_ahead(struct dhara_journal *j, dhara_error_t *err)
+{
+	const dhara_block_t tail_blk = j->tail_sync >> j->nand->log2_ppb;
+	const dhara_block_t pin_blk = j->pin != DHARA_PAGE_NONE ?
+		j->pin >> j->nand->log2_ppb : DHARA_BLOCK_NONE;
+	dhara_block_t blk = j->head >> j->nand->log2_ppb;
+	int i;
+
+	/* A head at the start of a block has not prepared it yet. Any
+	 * other head block is in use, and we look at the next one,
+	 * following the same rules as skip_block().
+	 */
+	if (!is_aligned(j->head, j->nand->log2_ppb)) {
+		blk = next_block(j->nand, blk);
+		if (blk == tail_blk || blk == pin_blk)
+			return 0;
+	}
+
+	for (i = 0; i < DHARA_MAX_RETRIES; i++) {
+		if (blk == j->erased)
+			return 0;
+
+		if (!dhara_nand_is_bad(j->nand, blk)) {
+			if (dhara_nand_erase(j->nand, blk, err) < 0) {
+				/* The head skips it and counts it when it
+				 * gets there.
+				 */
+				dhara_nand_mark_bad(j->nand, blk);
+				return -1;
+			}
+
+			j->erased = blk;
+			j->stats.erases++;
+			j->stats.erases_ahead++;
+			return 0;
+		}
+
+		blk = next_block(j->nand, blk);
+		if (blk == tail_blk || blk == pin_blk)
+			return 0;
+	}
+
+	return 0;
+}
+
 static void restart_recovery(struct dhara_journal *j, dhara_page_t old_head)
 {
 	/* Mark the current head bad immediately, unless we're also
@@ -685,6 +775,7 @@ static int dump_meta(struct dhara_journal *j, dhara_error_t *err)
 		if (!(prepare_head(j, &my_err) ||
 		      dhara_nand_prog(j->nand, j->head,
 				      j->page_buf, &my_err))) {
+			j->stats.meta_pages++;
 			j->recover_meta = j->head;
 			j->head = next_upage(j, j->head);
 			if (!j->head)
@@ -728,6 +819,8 @@ static int recover_from(struct dhara_journal *j,
 
 	/* Are we already in the middle of a recovery? */
 	if (dhara_journal_in_recovery(j)) {
+		j->stats.recoveries++;
+		NAND_TRACE_EVENT(NAND_TRACE_RECOVERY, 1, old_head, 0);
 		restart_recovery(j, old_head);
 		dhara_set_error(err, DHARA_E_RECOVER);
 		return -1;
@@ -748,6 +841,8 @@ static int recover_from(struct dhara_journal *j,
 	    dump_meta(j, err) < 0)
 		return -1;
 
+	j->stats.recoveries++;
+	NAND_TRACE_EVENT(NAND_TRACE_RECOVERY, 0, old_head, 0);
 	j->flags |= DHARA_JOURNAL_F_RECOVERY;
 	dhara_set_error(err, DHARA_E_RECOVER);
 	return -1;
@@ -807,6 +902,7 @@ static int push_meta(struct dhara_journal *j, const uint8_t *meta,
 	if (dhara_nand_prog(j->nand, j->head + 1, j->page_buf, &my_err) < 0)
 		return recover_from(j, my_err, err);
 
+	j->stats.meta_pages++;
 	j->flags &= ~DHARA_JOURNAL_F_DIRTY;
 
 	j->root = old_head;
@@ -824,6 +920,21 @@ static int push_meta(struct dhara_journal *j, const uint8_t *meta,
 	return 0;
 }
 
+/* Program a user page to the head. Outside of recovery, the page is
+ * programmed behind: its status is checked by the next program. That
+ * program is always on the same block (at the latest, it is the
+ * checkpoint of the group), and the page's metadata is still in the
+ * buffer, so a late failure is recovered as if the next page had failed.
+ */
+static int prog_user(struct dhara_journal *j, const uint8_t *data,
+		     dhara_error_t *err)
+{
+	if (dhara_journal_in_recovery(j))
+		return dhara_nand_prog(j->nand, j->head, data, err);
+
+	return dhara_nand_prog_behind(j->nand, j->head, data, err);
+}
+
 int dhara_journal_enqueue(struct dhara_journal *j,
 			  const uint8_t *data, const uint8_t *meta,
 			  dhara_error_t *err)
@@ -833,9 +944,12 @@ int dhara_journal_enqueue(struct dhara_journal *j,
 
 	for (i = 0; i < DHARA_MAX_RETRIES; i++) {
 		if (!(prepare_head(j, &my_err) ||
-		      (data && dhara_nand_prog(j->nand, j->head, data,
-					       &my_err))))
+		      (data && prog_user(j, data, &my_err)))) {
+			if (data)
+				j->stats.user_pages++;
+
 			return push_meta(j, meta, err);
+		}
 
 		if (recover_from(j, my_err, err) < 0)
 			return -1;
@@ -854,8 +968,10 @@ int dhara_journal_copy(struct dhara_journal *j,
 
 	for (i = 0; i < DHARA_MAX_RETRIES; i++) {
 		if (!(prepare_head(j, &my_err) ||
-		      dhara_nand_copy(j->nand, p, j->head, &my_err)))
+		      dhara_nand_copy(j->nand, p, j->head, &my_err))) {
+			j->stats.copied_pages++;
 			return push_meta(j, meta, err);
+		}
 
 		if (recover_from(j, my_err, err) < 0)
 			return -1;
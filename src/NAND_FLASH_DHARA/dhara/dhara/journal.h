@@ -45,12 +45,38 @@
  */
 #define DHARA_PAGE_NONE			((dhara_page_t)0xffffffff)
 
+/* Likewise for blocks. */
+#define DHARA_BLOCK_NONE		((dhara_block_t)0xffffffff)
+
 /* State flags */
 #define DHARA_JOURNAL_F_DIRTY		0x01
 #define DHARA_JOURNAL_F_BAD_META	0x02
 #define DHARA_JOURNAL_F_RECOVERY	0x04
 #define DHARA_JOURNAL_F_ENUM_DONE	0x08
 
+/* Operation counters, for working out write amplification. They are
+ * kept in RAM only, and start from zero at dhara_journal_init().
+ */
+struct dhara_journal_stats {
+	/* Pages programmed with new user data */
+	uint32_t			user_pages;
+
+	/* Pages programmed by copying an existing page */
+	uint32_t			copied_pages;
+
+	/* Checkpoint (metadata) pages programmed */
+	uint32_t			meta_pages;
+
+	/* Blocks erased */
+	uint32_t			erases;
+
+	/* Blocks erased ahead of the head, included in erases */
+	uint32_t			erases_ahead;
+
+	/* Assisted recoveries started (or restarted) after a bad block */
+	uint32_t			recoveries;
+};
+
 /* The journal layer presents the NAND pages as a double-ended queue.
  * Pages, with associated metadata may be pushed onto the end of the
  * queue, and pages may be popped from the end.
@@ -116,6 +142,20 @@ struct dhara_journal {
 	dhara_page_t			recover_next;
 	dhara_page_t			recover_root;
 	dhara_page_t			recover_meta;
+
+	/* Snapshot pin: if not DHARA_PAGE_NONE, the head may not roll
+	 * onto the block holding this page, so that nothing from here up
+	 * to the head is erased. See dhara_journal_pin().
+	 */
+	dhara_page_t			pin;
+
+	/* Erase-ahead: if not DHARA_BLOCK_NONE, this block was erased
+	 * by dhara_journal_erase_ahead() and nothing has been programmed
+	 * to it since. The head takes it over without erasing it again.
+	 */
+	dhara_block_t			erased;
+
+	struct dhara_journal_stats	stats;
 };
 
 /* Initialize a journal. You must supply a pointer to a NAND chip
@@ -185,6 +225,28 @@ void dhara_journal_dequeue(struct dhara_journal *j);
  */
 void dhara_journal_clear(struct dhara_journal *j);
 
+/* Keep every page from the last-synced tail up to the head readable,
+ * even after it is dequeued. The head stops short of the pinned block
+ * and enqueue fails with E_JOURNAL_FULL once it gets there. Only one
+ * pin exists, pinning again moves it. The pin is not persistent.
+ */
+void dhara_journal_pin(struct dhara_journal *j);
+
+/* Release the pin, the blocks behind the tail may be reused again. */
+void dhara_journal_unpin(struct dhara_journal *j);
+
+/* Erase the block the head will move to next, so that the erase is not
+ * done inline by the next enqueue or copy which needs it. This is the
+ * head block itself if the head is at the start of one, otherwise the
+ * next good block, unless that holds the last-synced tail or the pin.
+ * Nothing is done if that block is already erased.
+ *
+ * Meant to be called while the chip is idle. If the erase fails, the
+ * block is marked bad and -1 is returned with E_BAD_BLOCK, a later
+ * call tries the block after it.
+ */
+int dhara_journal_erase_ahead(struct dhara_journal *j, dhara_error_t *err);
+
 /* Append a page to the journal. Both raw page data and metadata must be
  * specified. The push operation is not persistent until a checkpoint is
  * reached.
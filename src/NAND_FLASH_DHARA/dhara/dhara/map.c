@@ -17,6 +17,8 @@
 #include <string.h>
 #include "bytes.h"
 #include "map.h"
+#include "../../inc/nand_stats.h"
+#include "../../inc/nand_trace.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -84,6 +86,10 @@ void dhara_map_init(struct dhara_map *m, const struct dhara_nand *n,
 
 	dhara_journal_init(&m->journal, n, page_buf);
 	m->gc_ratio = gc_ratio;
+
+	m->user_writes = 0;
+	m->gc_copies = 0;
+	m->pad_pages = 0;
 }
 
 int dhara_map_resume(struct dhara_map *m, dhara_error_t *err)
@@ -127,13 +133,15 @@ dhara_sector_t dhara_map_capacity(const struct dhara_map *m)
  * (containing PAGE_NONE alt-pointers), and DHARA_E_NOT_FOUND will be
  * returned.
  */
-static int trace_path(struct dhara_map *m, dhara_sector_t target,
-		      dhara_page_t *loc, uint8_t *new_meta,
-		      dhara_error_t *err)
+static int trace_path_from(struct dhara_map *m, dhara_page_t root,
+			   dhara_sector_t target, dhara_page_t *loc,
+			   uint8_t *new_meta, dhara_error_t *err)
 {
 	uint8_t meta[DHARA_META_SIZE];
 	int depth = 0;
-	dhara_page_t p = dhara_journal_root(&m->journal);
+	int reads = 0;
+	dhara_page_t p = root;
+	NAND_TRACE_START(trace_start);
 
 	if (new_meta)
 		meta_set_id(new_meta, target);
@@ -143,6 +151,7 @@ static int trace_path(struct dhara_map *m, dhara_sector_t target,
 
 	if (dhara_journal_read_meta(&m->journal, p, meta, err) < 0)
 		return -1;
+	reads++;
 
 	while (depth < DHARA_RADIX_DEPTH) {
 		const dhara_sector_t id = meta_get_id(meta);
@@ -163,6 +172,7 @@ static int trace_path(struct dhara_map *m, dhara_sector_t target,
 			if (dhara_journal_read_meta(&m->journal, p,
 						    meta, err) < 0)
 				return -1;
+			reads++;
 		} else {
 			if (new_meta)
 				meta_set_alt(new_meta, depth,
@@ -175,6 +185,8 @@ static int trace_path(struct dhara_map *m, dhara_sector_t target,
 	if (loc)
 		*loc = p;
 
+	NAND_STATS_RECORD(NAND_STATS_TRACE_DEPTH, reads);
+	NAND_TRACE_END(NAND_TRACE_TRACE_PATH, 0, target, reads, trace_start);
 	return 0;
 
 not_found:
@@ -183,11 +195,23 @@ not_found:
 			meta_set_alt(new_meta, depth++, DHARA_SECTOR_NONE);
 	}
 
+	NAND_STATS_RECORD(NAND_STATS_TRACE_DEPTH, reads);
+	NAND_TRACE_END(NAND_TRACE_TRACE_PATH, DHARA_E_NOT_FOUND, target, reads,
+		       trace_start);
+
 	dhara_set_error(err, DHARA_E_NOT_FOUND);
 	LOG_DBG("DHARA_E_NOT_FOUND, trace_path");
 	return -1;
 }
 
+static int trace_path(struct dhara_map *m, dhara_sector_t target,
+		      dhara_page_t *loc, uint8_t *new_meta,
+		      dhara_error_t *err)
+{
+	return trace_path_from(m, dhara_journal_root(&m->journal), target,
+			       loc, new_meta, err);
+}
+
 int dhara_map_find(struct dhara_map *m, dhara_sector_t target,
 		   dhara_page_t *loc, dhara_error_t *err)
 {
@@ -254,9 +278,15 @@ static int raw_gc(struct dhara_map *m, dhara_page_t src,
 
 	/* Rewrite it at the front of the journal with updated metadata */
 	ck_set_count(dhara_journal_cookie(&m->journal), m->count);
+
+	NAND_STATS_START(start);
+	NAND_TRACE_START(trace_start);
 	if (dhara_journal_copy(&m->journal, src, meta, err) < 0)
 		return -1;
+	NAND_STATS_STOP(NAND_STATS_GC_COPY, start);
+	NAND_TRACE_END(NAND_TRACE_GC_COPY, 0, src, 0, trace_start);
 
+	m->gc_copies++;
 	return 0;
 }
 
@@ -264,16 +294,29 @@ static int pad_queue(struct dhara_map *m, dhara_error_t *err)
 {
 	dhara_page_t p = dhara_journal_root(&m->journal);
 	uint8_t root_meta[DHARA_META_SIZE];
+	int ret;
 
 	ck_set_count(dhara_journal_cookie(&m->journal), m->count);
 
+	/* An empty journal is padded with a skipped page, nothing is
+	 * programmed and nothing is counted.
+	 */
 	if (p == DHARA_PAGE_NONE)
 		return dhara_journal_enqueue(&m->journal, NULL, NULL, err);
 
 	if (dhara_journal_read_meta(&m->journal, p, root_meta, err) < 0)
 		return -1;
 
-	return dhara_journal_copy(&m->journal, p, root_meta, err);
+	NAND_STATS_START(start);
+	NAND_TRACE_START(trace_start);
+	ret = dhara_journal_copy(&m->journal, p, root_meta, err);
+	NAND_STATS_STOP(NAND_STATS_SYNC_PAD, start);
+	NAND_TRACE_END(NAND_TRACE_SYNC_PAD, 0, p, 0, trace_start);
+
+	if (!ret)
+		m->pad_pages++;
+
+	return ret;
 }
 
 /* Attempt to recover the journal */
@@ -368,8 +411,10 @@ int dhara_map_write(struct dhara_map *m, dhara_sector_t dst,
 		if (prepare_write(m, dst, meta, err) < 0)
 			return -1;
 
-		if (!dhara_journal_enqueue(&m->journal, data, meta, &my_err))
+		if (!dhara_journal_enqueue(&m->journal, data, meta, &my_err)) {
+			m->user_writes++;
 			break;
+		}
 
 		m->count = old_count;
 
@@ -391,8 +436,10 @@ int dhara_map_copy_page(struct dhara_map *m, dhara_page_t src,
 		if (prepare_write(m, dst, meta, err) < 0)
 			return -1;
 
-		if (!dhara_journal_copy(&m->journal, src, meta, &my_err))
+		if (!dhara_journal_copy(&m->journal, src, meta, &my_err)) {
+			m->user_writes++;
 			break;
+		}
 
 		m->count = old_count;
 
@@ -542,3 +589,63 @@ int dhara_map_gc(struct dhara_map *m, dhara_error_t *err)
 
 	return 0;
 }
+
+int dhara_map_erase_ahead(struct dhara_map *m, dhara_error_t *err)
+{
+	return dhara_journal_erase_ahead(&m->journal, err);
+}
+
+int dhara_map_snapshot_take(struct dhara_map *m,
+			    struct dhara_map_snapshot *snap,
+			    dhara_error_t *err)
+{
+	/* Checkpoint first: the metadata of the frozen root must be on
+	 * the chip, not in the journal's page buffer.
+	 */
+	if (dhara_map_sync(m, err) < 0)
+		return -1;
+
+	dhara_journal_pin(&m->journal);
+	snap->root = dhara_journal_root(&m->journal);
+	snap->count = m->count;
+	return 0;
+}
+
+void dhara_map_snapshot_release(struct dhara_map *m,
+				struct dhara_map_snapshot *snap)
+{
+	dhara_journal_unpin(&m->journal);
+	snap->root = DHARA_PAGE_NONE;
+	snap->count = 0;
+}
+
+int dhara_map_snapshot_read(struct dhara_map *m,
+			    const struct dhara_map_snapshot *snap,
+			    dhara_sector_t s, uint8_t *data,
+			    dhara_error_t *err)
+{
+	const struct dhara_nand *n = m->journal.nand;
+	dhara_error_t my_err;
+	dhara_page_t p;
+
+	if (trace_path_from(m, snap->root, s, &p, NULL, &my_err) < 0) {
+		if (my_err == DHARA_E_NOT_FOUND) {
+			memset(data, 0xff, 1 << n->log2_page_size);
+			return 0;
+		}
+
+		dhara_set_error(err, my_err);
+		return -1;
+	}
+
+	return dhara_nand_read(n, p, 0, 1 << n->log2_page_size, data, err);
+}
+
+void dhara_map_get_stats(const struct dhara_map *m,
+			 struct dhara_map_stats *stats)
+{
+	stats->user_writes = m->user_writes;
+	stats->gc_copies = m->gc_copies;
+	stats->pad_pages = m->pad_pages;
+	stats->journal = m->journal.stats;
+}
@@ -32,6 +32,42 @@ struct dhara_map {
 
 	uint8_t			gc_ratio;
 	dhara_sector_t		count;
+
+	/* Operation counters, see dhara_map_get_stats() */
+	uint32_t		user_writes;
+	uint32_t		gc_copies;
+	uint32_t		pad_pages;
+};
+
+/* Counters of the map and its journal since dhara_map_init(). The
+ * write amplification is the number of programmed pages
+ * (journal.user_pages + journal.copied_pages + journal.meta_pages)
+ * per user write.
+ */
+struct dhara_map_stats {
+	/* Sectors written or copied by the user */
+	uint32_t			user_writes;
+
+	/* Live pages moved to the head by garbage collection */
+	uint32_t			gc_copies;
+
+	/* Filler pages programmed to reach a checkpoint, skipped pages
+	 * of an empty journal are not counted
+	 */
+	uint32_t			pad_pages;
+
+	struct dhara_journal_stats	journal;
+};
+
+/* A read-only view of the map at one point in time. The radix tree of
+ * the frozen root stays readable because the journal is pinned: the
+ * garbage collector may still move live pages to the head, but the
+ * blocks holding the old copies are not erased until the snapshot is
+ * released.
+ */
+struct dhara_map_snapshot {
+	dhara_page_t			root;
+	dhara_sector_t			count;
 };
 
 /* Initialize a map. You need to supply a buffer for page metadata, and
@@ -111,4 +147,36 @@ int dhara_map_sync(struct dhara_map *m, dhara_error_t *err);
  */
 int dhara_map_gc(struct dhara_map *m, dhara_error_t *err);
 
+/* Erase the block the journal head moves to next, see
+ * dhara_journal_erase_ahead(). Call it while the map is idle, the next
+ * write crossing into a new block then does not wait for an erase.
+ */
+int dhara_map_erase_ahead(struct dhara_map *m, dhara_error_t *err);
+
+/* Take a snapshot. The map is synchronized first, so this may write.
+ * While the snapshot is held, writes keep working until the head
+ * reaches the pinned block and then fail with E_JOURNAL_FULL, release
+ * the snapshot to get the space back. Only one snapshot can be held at
+ * a time, and it does not survive a reboot.
+ */
+int dhara_map_snapshot_take(struct dhara_map *m,
+			    struct dhara_map_snapshot *snap,
+			    dhara_error_t *err);
+
+/* Release a snapshot. Its pages may be erased from now on. */
+void dhara_map_snapshot_release(struct dhara_map *m,
+				struct dhara_map_snapshot *snap);
+
+/* Read a sector as it was when the snapshot was taken. Unmapped
+ * sectors read as blank pages (0xff).
+ */
+int dhara_map_snapshot_read(struct dhara_map *m,
+			    const struct dhara_map_snapshot *snap,
+			    dhara_sector_t s, uint8_t *data,
+			    dhara_error_t *err);
+
+/* Obtain the operation counters of the map and its journal. */
+void dhara_map_get_stats(const struct dhara_map *m,
+			 struct dhara_map_stats *stats);
+
 #endif
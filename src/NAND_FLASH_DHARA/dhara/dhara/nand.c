@@ -14,27 +14,322 @@
 #include "nand.h"
 #include "../../inc/nand_driver.h" 
 #include "../../inc/nand_top_layer.h"//for the nand_flash_device_t
+#include "../../inc/nand_stats.h"
+#include "../../inc/nand_trace.h"
+#include "../../inc/nand_clock.h"
 
 
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef CONFIG_NAND_SOFT_ECC
+#include "../ecc/hamming.h"
+#include "../ecc/bch.h"
+#endif
+
+#ifdef CONFIG_NAND_PAGE_CRC
+#include "../ecc/crc32.h"
+#endif
+
 
 #define ERASE_COUNTER_SPARE_AREA_OFFSET 16
+#define PAGE_CRC_SPARE_AREA_OFFSET 4
 
 
-size_t Erase_counter_FLAG = 0;
-dhara_page_t Erased_block = 0;
+#ifdef CONFIG_HEALTH_MONITORING
+#ifdef CONFIG_NAND_ERASE_AHEAD
+//an erased-ahead block waits for its first program, other blocks may be erased meanwhile
+#define PENDING_ERASES 4
+#else
+#define PENDING_ERASES 1
+#endif
+
+//erased blocks whose first page is not programmed yet, the erase counter goes there
+static struct {
+    bool valid;
+    dhara_page_t first_page;
+    uint32_t erase_count;
+} pending_erases[PENDING_ERASES];
+static uint8_t next_pending_erase;
+#endif
 
 size_t Delta_ECC_counter = 0;
 size_t Initial_ECC_counter = 0;
 uint32_t Total_ECC_counter = 0;
 
-uint32_t erase_count_indicator = 0;
+#ifdef CONFIG_NAND_PAGE_CRC
+//full page reads whose checksum did not match, including the ones fixed by re-reading
+uint32_t Page_CRC_mismatches = 0;
+#endif
 
 uint8_t spare_area_buffer[8];
 
-static uint8_t load_buffer[4200];
+#ifdef CONFIG_NAND_PLANE_PAIRS
+#define LOAD_BUFFER_SIZE (2 * 4200)//page and spare area of both planes
+#else
+#define LOAD_BUFFER_SIZE 4200
+#endif
+
+#ifdef CONFIG_NAND_WRITE_BEHIND
+//a page is staged in one buffer while the other still holds the page programming behind
+static uint8_t load_buffers[2][LOAD_BUFFER_SIZE];
+static uint8_t *load_buffer = load_buffers[0];
+
+//the page programming behind the caller, n is NULL if there is none
+static struct {
+    const struct dhara_nand *n;
+    dhara_page_t p;//physical page
+    uint8_t *buffer;
+    uint32_t start;
+} behind;
+
+//a page that failed behind the caller, n is NULL if there is none. Reads of the page are
+//served from its buffer until its block is erased or marked bad.
+static struct {
+    const struct dhara_nand *n;
+    dhara_page_t p;//physical page
+    uint8_t *buffer;
+    bool reported;
+} failed;
+#else
+static uint8_t load_buffer[LOAD_BUFFER_SIZE];
+#endif
+
+
+/**
+ * @brief Device that owns n, the dhara_nand of either the main or the hot region.
+ */
+static nand_flash_device_t *device_of(const struct dhara_nand *n)
+{
+#ifdef CONFIG_NAND_HOT_COLD
+    if (n == &device_handle->hot_nand) {
+        return CONTAINER_OF(n, nand_flash_device_t, hot_nand);
+    }
+#endif
+    return CONTAINER_OF(n, nand_flash_device_t, dhara_nand);
+}
+
+/**
+ * @brief Physical page of page p of the region n. The main region starts at block 0,
+ * the hot region (CONFIG_NAND_HOT_COLD) takes the blocks after it.
+ */
+static inline dhara_page_t region_page(const struct dhara_nand *n, dhara_page_t p)
+{
+#ifdef CONFIG_NAND_HOT_COLD
+    if (n == &device_handle->hot_nand) {
+        return p + (device_handle->dhara_nand.num_blocks << n->log2_ppb);
+    }
+#endif
+    return p;
+}
+
+
+/////////////////////////           SOFTWARE ECC START (OPTIONAL)        ///////////////////////////////////
+
+#ifdef CONFIG_NAND_SOFT_ECC
+
+#define SOFT_ECC_CHUNK_SIZE CONFIG_NAND_SOFT_ECC_CHUNK_SIZE
+#define SOFT_ECC_OOB_OFFSET CONFIG_NAND_SOFT_ECC_OOB_OFFSET
+#ifdef CONFIG_NAND_PLANE_PAIRS
+#define SOFT_ECC_MAX_CHUNKS (2 * 4096 / SOFT_ECC_CHUNK_SIZE)
+#else
+#define SOFT_ECC_MAX_CHUNKS (4096 / SOFT_ECC_CHUNK_SIZE)
+#endif
+
+#if defined(CONFIG_NAND_SOFT_ECC_HAMMING)
+#define SOFT_ECC_BYTES HAMMING_ECC_SIZE
+#elif defined(CONFIG_NAND_SOFT_ECC_BCH_1BIT)
+#define SOFT_ECC_BCH (&bch_1bit)
+#elif defined(CONFIG_NAND_SOFT_ECC_BCH_2BIT)
+#define SOFT_ECC_BCH (&bch_2bit)
+#else
+#define SOFT_ECC_BCH (&bch_4bit)
+#endif
+
+#ifdef SOFT_ECC_BCH
+#define SOFT_ECC_BYTES BCH_MAX_ECC //upper bound, the code itself uses SOFT_ECC_BCH->ecc_bytes
+#endif
+
+//bits repaired by the software ECC since start up, the early wear indicator
+uint32_t Soft_ECC_corrected_bits = 0;
+//chunks which needed at least one repaired bit
+uint32_t Soft_ECC_corrected_chunks = 0;
+
+static uint8_t soft_ecc_codes[SOFT_ECC_MAX_CHUNKS * SOFT_ECC_BYTES];
+static uint8_t soft_ecc_chunk[SOFT_ECC_CHUNK_SIZE];
+
+
+static inline size_t soft_ecc_code_size(void)
+{
+#ifdef SOFT_ECC_BCH
+    return SOFT_ECC_BCH->ecc_bytes;
+#else
+    return HAMMING_ECC_SIZE;
+#endif
+}
+
+
+/**
+ * @brief Compute the ECC code of one chunk of page data.
+ *
+ * @param chunk Pointer to SOFT_ECC_CHUNK_SIZE bytes of page data.
+ * @param[out] ecc Buffer receiving the code (soft_ecc_code_size() bytes).
+ */
+static void soft_ecc_generate(const uint8_t *chunk, uint8_t *ecc)
+{
+#ifdef SOFT_ECC_BCH
+    bch_generate(SOFT_ECC_BCH, chunk, SOFT_ECC_CHUNK_SIZE, ecc);
+#else
+    hamming_generate(chunk, SOFT_ECC_CHUNK_SIZE, ecc);
+#endif
+}
+
+
+/**
+ * @brief Verify one chunk against its code and repair it in place.
+ *
+ * Erased chunks (data and code all 0xFF) are valid code words, so blank
+ * pages pass without special casing.
+ *
+ * @param chunk Chunk data, repaired in place.
+ * @param ecc Code read from the spare area, repaired in place.
+ * @return number of corrected bits (0 if the chunk was clean), or -1 if the
+ *         chunk is not correctable.
+ */
+static int soft_ecc_correct(uint8_t *chunk, uint8_t *ecc)
+{
+#ifdef SOFT_ECC_BCH
+    //one remainder pass for clean chunks, the decoder only runs on a mismatch
+    return bch_verify_repair(SOFT_ECC_BCH, chunk, SOFT_ECC_CHUNK_SIZE, ecc);
+#else
+    hamming_ecc_t syndrome = hamming_syndrome(chunk, SOFT_ECC_CHUNK_SIZE, ecc);
+
+    if (!syndrome) {
+        return 0;
+    }
+
+    if (hamming_repair(chunk, SOFT_ECC_CHUNK_SIZE, syndrome) < 0) {
+        return -1;
+    }
+
+    return 1;
+#endif
+}
+
+
+/**
+ * @brief Read a portion of the page currently held in the NAND cache,
+ * verifying and repairing every chunk it touches.
+ *
+ * @param dev NAND flash device.
+ * @param p Page in the cache, only used for logging.
+ * @param offset Start of the portion within the page.
+ * @param length Length of the portion.
+ * @param[out] data Destination buffer.
+ * @return 0 on success, -1 on a transfer error or an uncorrectable chunk.
+ */
+static int soft_ecc_read(nand_flash_device_t *dev, dhara_page_t p, size_t offset, size_t length,
+                         uint8_t *data, dhara_error_t *err)
+{
+    const size_t code_size = soft_ecc_code_size();
+    const size_t first = offset / SOFT_ECC_CHUNK_SIZE;
+    const size_t last = (offset + length - 1) / SOFT_ECC_CHUNK_SIZE;
+    int ret;
+
+    __ASSERT(offset + length <= dev->page_size, "Soft ECC read past the page data");
+
+    if (length == 0) {
+        return 0;
+    }
+
+    ret = nand_read(soft_ecc_codes + first * code_size,
+                    dev->page_size + SOFT_ECC_OOB_OFFSET + first * code_size,
+                    (last - first + 1) * code_size);
+    if (ret != 0) {
+        my_nand_handle->log("Failed to read soft ECC codes of page", true, true, p);
+        return -1;
+    }
+
+    for (size_t c = first; c <= last; c++) {
+        const size_t chunk_start = c * SOFT_ECC_CHUNK_SIZE;
+        const size_t from = MAX(offset, chunk_start);
+        const size_t to = MIN(offset + length, chunk_start + SOFT_ECC_CHUNK_SIZE);
+        uint8_t *chunk = soft_ecc_chunk;
+        int bits;
+
+        //whole chunks are repaired in the caller's buffer, partial ones in a scratch copy
+        if (from == chunk_start && to == chunk_start + SOFT_ECC_CHUNK_SIZE) {
+            chunk = data + (chunk_start - offset);
+        }
+
+        ret = nand_read(chunk, chunk_start, SOFT_ECC_CHUNK_SIZE);
+        if (ret != 0) {
+            my_nand_handle->log("Failed to read data from page", true, true, chunk_start);
+            return -1;
+        }
+
+        bits = soft_ecc_correct(chunk, soft_ecc_codes + c * code_size);
+        if (bits < 0) {
+            my_nand_handle->log("Uncorrectable soft ECC error on page", true, true, p);
+            dhara_set_error(err, DHARA_E_ECC);
+            Delta_ECC_counter++;
+            NAND_CLOCK_ANOMALY();
+            return -1;
+        }
+
+        if (bits > 0) {
+            my_nand_handle->log("Soft ECC corrected bits", false, true, bits);
+            Soft_ECC_corrected_bits += bits;
+            Soft_ECC_corrected_chunks++;
+        }
+
+        if (chunk == soft_ecc_chunk) {
+            memcpy(data + (from - offset), soft_ecc_chunk + (from - chunk_start), to - from);
+        }
+    }
+
+    return 0;
+}
+
+
+int nand_soft_ecc_check_layout(const nand_flash_device_t *dev)
+{
+    const size_t start = SOFT_ECC_OOB_OFFSET;
+    const size_t end = start + (dev->page_size / SOFT_ECC_CHUNK_SIZE) * soft_ecc_code_size();
+
+    //with plane pairs the spare area of plane 1 starts with its bad block marker
+    if (end > dev->chip.oob_size) {
+        my_nand_handle->log("Soft ECC codes do not fit the spare area, bytes needed", true, true, end);
+        return -1;
+    }
+
+#ifdef CONFIG_NAND_PAGE_CRC
+    if (start < PAGE_CRC_SPARE_AREA_OFFSET + sizeof(uint32_t)) {
+#else
+    if (start < 4) {
+#endif
+        my_nand_handle->log("Soft ECC codes overlap the markers, offset", true, true, start);
+        return -1;
+    }
+
+#ifdef CONFIG_HEALTH_MONITORING
+    if (start < ERASE_COUNTER_SPARE_AREA_OFFSET + 8 && end > ERASE_COUNTER_SPARE_AREA_OFFSET) {
+        my_nand_handle->log("Soft ECC codes overlap the health counters, offset", true, true, start);
+        return -1;
+    }
+#endif
+
+#ifndef CONFIG_NAND_SOFT_ECC_DISABLE_ON_DIE
+    if ((dev->chip.features & NAND_CHIP_ON_DIE_ECC) != 0) {
+        my_nand_handle->log("Soft ECC with on-die ECC enabled, the chip parity may overwrite the codes", false, false, 0);
+    }
+#endif
+
+    return 0;
+}
+
+#endif // CONFIG_NAND_SOFT_ECC
+/////////////////////////           SOFTWARE ECC END (OPTIONAL)        ///////////////////////////////////
 
 
 //defined in 
@@ -50,6 +345,9 @@ static uint8_t load_buffer[4200];
  */
 static int wait_for_ready_nand(uint8_t *status_out)
 {
+    uint32_t spins = 0;
+    NAND_TRACE_START(start);
+
     while (true) {
         uint8_t status;
         int err = nand_read_register(REG_STATUS, &status);
@@ -57,6 +355,7 @@ static int wait_for_ready_nand(uint8_t *status_out)
             my_nand_handle->log("Error reading NAND status register",true ,false ,0);
             return -1; 
         }
+        spins++;
 
         if ((status & STAT_BUSY) == 0) {
             if (status_out) {
@@ -65,6 +364,8 @@ static int wait_for_ready_nand(uint8_t *status_out)
             break;
         }
     }
+    NAND_STATS_RECORD(NAND_STATS_WAIT_SPINS, spins);
+    NAND_TRACE_END(NAND_TRACE_BUSY, 0, spins, 0, start);
 
     return 0; // Success
 }
@@ -89,13 +390,24 @@ static int wait_for_ready_nand(uint8_t *status_out)
 static int read_page_and_wait(struct nand_flash_device_t *device, uint32_t page, uint8_t *status_out)
 {
     int err;
+    NAND_STATS_START(start);
+    NAND_TRACE_START(trace_start);
+
     err = nand_read_page(page); 
     if (err != 0) {
         my_nand_handle->log("Failed to read page",true ,true ,page);
         return -1;
     }
 
-    return wait_for_ready_nand(status_out);
+    err = wait_for_ready_nand(status_out);
+#ifdef CONFIG_NAND_PLANE_PAIRS
+    if (status_out) {
+        *status_out = nand_pair_status(*status_out);
+    }
+#endif
+    NAND_STATS_STOP(NAND_STATS_PAGE_READ, start);
+    NAND_TRACE_END(NAND_TRACE_PAGE_READ, 0, page, 0, trace_start);
+    return err;
 }
 
 
@@ -120,6 +432,8 @@ static int read_page_and_wait(struct nand_flash_device_t *device, uint32_t page,
 static int program_execute_and_wait(struct nand_flash_device_t *device, uint32_t page, uint8_t *status_out)
 {
     int err;
+    NAND_STATS_START(start);
+    NAND_TRACE_START(trace_start);
 
     err = nand_program_execute(page);
     if (err != 0) {
@@ -127,24 +441,125 @@ static int program_execute_and_wait(struct nand_flash_device_t *device, uint32_t
         return -1;
     }
 
-    return wait_for_ready_nand(status_out);
+    err = wait_for_ready_nand(status_out);
+    NAND_STATS_STOP(NAND_STATS_PROGRAM, start);
+    NAND_TRACE_END(NAND_TRACE_PROGRAM, 0, page, 0, trace_start);
+    return err;
 }
 
 
+/////////////////////////           WRITE BEHIND START (OPTIONAL)        ///////////////////////////////////
+
+#ifdef CONFIG_NAND_WRITE_BEHIND
 /**
- * @return 1 if block is bad, 0 (false) if the block is good (indicator equals 0xFFFF),
-*/
-int dhara_nand_is_bad(const struct dhara_nand *n, dhara_block_t b)
+ * @brief Wait for the page programming behind the caller. A page that failed is kept
+ * in its buffer, the failure is reported by take_failure().
+ */
+static void finish_behind(void)
 {
-    
-    /**
-     * to retrieve a pointer to a container structure given a pointer to a member of that structure. It's used to obtain
-     * a pointer to a parent or enclosing structure by knowing the pointer to a member field and the type of the parent 
-     * structure.
-    */
-    nand_flash_device_t *dev = CONTAINER_OF(n, nand_flash_device_t, dhara_nand);//struct necessary?
+    uint8_t status = 0;
+
+    if (behind.n == NULL) {
+        return;
+    }
 
-    dhara_page_t first_block_page = b * (1 << n->log2_ppb);
+    nand_select_flash(behind.p);
+    int ret = wait_for_ready_nand(&status);
+    NAND_STATS_RECORD(NAND_STATS_PROGRAM, k_cycle_get_32() - behind.start);
+    NAND_TRACE_END(NAND_TRACE_PROGRAM, 0, behind.p, 0, behind.start);
+
+    //nothing is started behind while a failed page is kept, so its buffer is free
+    if (ret != 0 || (status & STAT_PROGRAM_FAILED) != 0) {
+        my_nand_handle->log("prog behind failed, page",true ,true ,behind.p);
+        failed.n = behind.n;
+        failed.p = behind.p;
+        failed.buffer = behind.buffer;
+        failed.reported = false;
+    }
+
+    behind.n = NULL;
+}
+
+
+/**
+ * @brief Finish the page programming behind and report its failure to the next
+ * program or copy of the same region.
+ *
+ * @return 0 if there is nothing to report, -1 with err set to E_BAD_BLOCK otherwise.
+ */
+static int take_failure(const struct dhara_nand *n, dhara_error_t *err)
+{
+    finish_behind();
+
+    if (failed.n == n && !failed.reported) {
+        failed.reported = true;
+        dhara_set_error(err, DHARA_E_BAD_BLOCK);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Drop the page that failed behind once its block is erased or marked bad.
+ */
+static void forget_failure(const struct dhara_nand *n, dhara_page_t first_block_page)
+{
+    if (failed.n == n && (failed.p >> n->log2_ppb) == (first_block_page >> n->log2_ppb)) {
+        failed.n = NULL;
+    }
+}
+
+
+/**
+ * @return true if p is the page that failed behind, its data is in failed.buffer.
+ */
+static inline bool is_failed_page(const struct dhara_nand *n, dhara_page_t p)
+{
+    return failed.n == n && failed.p == p;
+}
+
+
+void nand_write_behind_finish(void)
+{
+    finish_behind();
+}
+
+
+void nand_write_behind_reset(void)
+{
+    finish_behind();
+    failed.n = NULL;
+}
+
+#else
+
+static inline void finish_behind(void) {}
+
+static inline int take_failure(const struct dhara_nand *n, dhara_error_t *err)
+{
+    return 0;
+}
+
+static inline void forget_failure(const struct dhara_nand *n, dhara_page_t first_block_page) {}
+
+static inline bool is_failed_page(const struct dhara_nand *n, dhara_page_t p)
+{
+    return false;
+}
+
+#endif // CONFIG_NAND_WRITE_BEHIND
+/////////////////////////           WRITE BEHIND END (OPTIONAL)        ///////////////////////////////////
+
+
+/**
+ * @brief Check the bad block marker of the block of first_block_page on the chip of that page.
+ *
+ * @return 1 if the block is bad or the marker could not be read, 0 if it is good.
+ */
+static int chip_block_is_bad(nand_flash_device_t *dev, dhara_page_t first_block_page)
+{
     uint16_t bad_block_indicator;
     int ret;
 
@@ -162,49 +577,160 @@ int dhara_nand_is_bad(const struct dhara_nand *n, dhara_block_t b)
         return 1; // Assume bad block on error
     }
 
-    if(bad_block_indicator == 0x0000){my_nand_handle->log("Bad_Block on Block=",false ,true ,b);}
+#ifdef CONFIG_NAND_PLANE_PAIRS
+    //the factory marks the blocks of each plane on their own, the spare area of plane 1 follows the one of plane 0
+    if (dev->plane_pairs && bad_block_indicator != 0x0000) {
+        ret = nand_read((uint8_t *)&bad_block_indicator, dev->page_size + dev->chip.oob_size, 2);
+        if (ret != 0) {
+            my_nand_handle->log("Failed to read bad block indicator, err",true ,true ,ret);
+            return 1;
+        }
+    }
+#endif
+
     return bad_block_indicator == 0x0000;
 }
 
 
+/**
+ * @return 1 if block is bad, 0 (false) if the block is good (indicator equals 0xFFFF),
+*/
+int dhara_nand_is_bad(const struct dhara_nand *n, dhara_block_t b)
+{
+    
+    /**
+     * to retrieve a pointer to a container structure given a pointer to a member of that structure. It's used to obtain
+     * a pointer to a parent or enclosing structure by knowing the pointer to a member field and the type of the parent 
+     * structure.
+    */
+    nand_flash_device_t *dev = device_of(n);//struct necessary?
+
+    dhara_page_t first_block_page = region_page(n, b * (1 << n->log2_ppb));
+
+    finish_behind();
+
+    //with interleaved pages the block is bad if it is bad on any of its chips
+    for (int c = 0; c < nand_stripe_width(); c++) {
+        if (chip_block_is_bad(dev, first_block_page + c)) {
+            my_nand_handle->log("Bad_Block on Block=",false ,true ,b);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
 
 void dhara_nand_mark_bad(const struct dhara_nand *n, dhara_block_t b)
 {
-    nand_flash_device_t *dev = CONTAINER_OF(n, nand_flash_device_t, dhara_nand);
+    nand_flash_device_t *dev = device_of(n);
     int ret;
 
-    dhara_page_t first_block_page = b * (1 << n->log2_ppb);
+    dhara_page_t first_block_page = region_page(n, b * (1 << n->log2_ppb));
     uint16_t bad_block_indicator = 0;
 
-    ret = nand_write_enable();
-    if (ret) {
-        my_nand_handle->log("Failed to enable write, error",true ,true ,ret);
-        return;
-    }
+    finish_behind();
+    forget_failure(n, first_block_page);
 
-    ret = nand_erase_block(first_block_page);
-    if (ret != 0) {
-        my_nand_handle->log("Failed to erase block, error",true ,true ,ret);
-        return;
+    //with interleaved pages every chip of the block gets the marker
+    for (int c = 0; c < nand_stripe_width(); c++) {
+        ret = nand_enable_and_erase_block(first_block_page + c);
+        if (ret == 0) {
+            ret = wait_for_ready_nand(NULL);
+        }
+        if (ret != 0) {
+            my_nand_handle->log("Failed to erase block, error",true ,true ,ret);
+            return;
+        }
+
+        ret = nand_enable_and_program_page(first_block_page + c, (uint8_t *)&bad_block_indicator, dev->page_size, 2);
+        if (ret != 0) {
+            my_nand_handle->log("Failed to program page, error",true ,true ,ret);
+            return;
+        }
+
+        ret = wait_for_ready_nand(NULL);
+        if (ret != 0) {
+            my_nand_handle->log("Failed to execute program and wait, error",true ,true ,ret);
+            return;
+        }
     }
+}
 
-    ret = nand_write_enable();
-    if (ret != 0) {
-        my_nand_handle->log("Failed to enable write, error",true ,true ,ret);
-        return;
+
+/**
+ * @brief Wait for the erases started on the first chips of a block.
+ *
+ * Every chip is waited for even if one of them fails, none is left busy.
+ *
+ * @param chips number of chips, from the chip of first_block_page on.
+ * @param[out] status_out status registers of the chips, ORed.
+ * @return 0 on success, -1 if a status read failed.
+ */
+static int wait_stripe(dhara_page_t first_block_page, int chips, uint8_t *status_out)
+{
+    uint8_t status;
+    int ret = 0;
+
+    for (int c = 0; c < chips; c++) {
+        nand_select_flash(first_block_page + c);
+        if (wait_for_ready_nand(&status) != 0) {
+            my_nand_handle->log("Failed to wait for ready, chip",true ,true ,c);
+            ret = -1;
+        } else {
+            *status_out |= status;
+        }
     }
 
-    ret = nand_program_load((uint8_t *)&bad_block_indicator, dev->page_size, 2);
-    if (ret != 0) {
-        my_nand_handle->log("Failed to program load, error",true ,true ,ret);
-        return;
+    return ret;
+}
+
+
+/**
+ * @brief Erase the block of first_block_page on every chip it spans and wait for the erases.
+ *
+ * The chips erase in parallel. A background erase that serves reads goes one chip at a
+ * time instead, the reads in the window of a suspended erase may go to any chip.
+ *
+ * @param[out] status_out status registers of the chips, STAT_ERASE_FAILED if one failed.
+ * @return 0 on success, -1 if a command or status read failed.
+ */
+static int erase_stripe(nand_flash_device_t *dev, dhara_page_t first_block_page, uint8_t *status_out)
+{
+    const int width = nand_stripe_width();
+    uint8_t status;
+    int ret;
+
+    *status_out = 0;
+    for (int c = 0; c < width; c++) {
+        ret = nand_enable_and_erase_block(first_block_page + c);
+        if (ret != 0) {
+            my_nand_handle->log("Failed to erase block, error",true ,true ,ret);
+            //the chips before erase on, the next commands to them would be dropped
+            (void)wait_stripe(first_block_page, c, status_out);
+            return -1;
+        }
+
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+        //only the erase ahead work lets reads in, a foreground erase is part of a write
+        if (dev->background_erase && (dev->chip.features & NAND_CHIP_ERASE_SUSPEND) != 0) {
+            ret = wait_for_erase_serving_reads(dev, first_block_page + c, &status);
+            if (ret != 0) {
+                my_nand_handle->log("Failed to wait for ready, error",true ,true ,ret);
+                return -1;
+            }
+            *status_out |= status;
+        }
+#endif
     }
 
-    ret = program_execute_and_wait(dev, first_block_page, NULL);
-    if (ret != 0) {
-        my_nand_handle->log("Failed to execute program and wait, error",true ,true ,ret);
-        return;
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+    if (dev->background_erase && (dev->chip.features & NAND_CHIP_ERASE_SUSPEND) != 0) {
+        return 0;
     }
+#endif
+
+    return wait_stripe(first_block_page, width, status_out);
 }
 
 
@@ -217,13 +743,16 @@ void dhara_nand_mark_bad(const struct dhara_nand *n, dhara_block_t b)
 int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t *err)
 {
     //LOG_INF("erase_block, block=%u", b);
-    struct nand_flash_device_t *dev = CONTAINER_OF(n, struct nand_flash_device_t, dhara_nand);
+    struct nand_flash_device_t *dev = device_of(n);
     int ret;
     
 
-    dhara_page_t first_block_page = b * (1 << n->log2_ppb);
+    dhara_page_t first_block_page = region_page(n, b * (1 << n->log2_ppb));
     uint8_t status;
 
+    finish_behind();
+    forget_failure(n, first_block_page);
+
     //first read out the flags and store them, they will be written to the page
     ret = read_page_and_wait(dev, first_block_page, NULL);
     if (ret) {
@@ -237,6 +766,7 @@ int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t
 
 #ifdef CONFIG_HEALTH_MONITORING
     //extract the counters, that are after erasure programmed back to the first page of a block
+    uint32_t erase_count_indicator = 0;
     uint32_t ecc_count_indicator = 0;
     ret = nand_read(spare_area_buffer, dev->page_size + ERASE_COUNTER_SPARE_AREA_OFFSET, 8);
     if (ret != 0) {
@@ -265,29 +795,28 @@ int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t
         my_nand_handle->log("Current total ECC faults found",false ,true ,Total_ECC_counter);
     }
     
-    Erase_counter_FLAG = 1; //setting flag to make sure, that a page is only written to once, not twice partly
-    Erased_block = first_block_page;
+    //the counters are programmed with the first page, so that a page is only written to once, not twice partly
+    for (int i = 0; i < PENDING_ERASES; i++) {
+        if (pending_erases[i].first_page == first_block_page) {
+            pending_erases[i].valid = false;
+        }
+    }
+    pending_erases[next_pending_erase].valid = true;
+    pending_erases[next_pending_erase].first_page = first_block_page;
+    pending_erases[next_pending_erase].erase_count = erase_count_indicator;
+    next_pending_erase = (next_pending_erase + 1) % PENDING_ERASES;
 
 #endif // CONFIG_HEALTH_MONITORING
     /////////////////////////           HEALTH MONITORING END (OPTIONAL)        ///////////////////////////////////
 
-    ret = nand_write_enable();
-    if (ret != 0) {
-        my_nand_handle->log("Failed to enable write, error",true ,true ,ret);
-        return -1;
-    }
-
-    ret = nand_erase_block(first_block_page);
-    if (ret != 0) {
-        my_nand_handle->log("Failed to erase block, error",true ,true ,ret);
-        return -1;
-    }
-
-    ret = wait_for_ready_nand( &status);
+    NAND_STATS_START(start);
+    NAND_TRACE_START(trace_start);
+    ret = erase_stripe(dev, first_block_page, &status);
     if (ret != 0) {
-        my_nand_handle->log("Failed to wait for ready, error",true ,true ,ret);
         return -1;
     }
+    NAND_STATS_STOP(NAND_STATS_ERASE, start);
+    NAND_TRACE_END(NAND_TRACE_ERASE, 0, first_block_page >> n->log2_ppb, 0, trace_start);
 
     if ((status & STAT_ERASE_FAILED) != 0) {
         dhara_set_error(err, DHARA_E_BAD_BLOCK);
@@ -300,98 +829,229 @@ int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t b, dhara_error_t
 }
 
 
-/* Program the given page. The data pointer is a pointer to an entire
- * page ((1 << log2_page_size) bytes). The operation status should be
- * checked. If the operation fails, return -1 and set err to
- * E_BAD_BLOCK.
- * 
+#ifdef CONFIG_HEALTH_MONITORING
+/**
+ * @brief Pack the erase and ECC counters into spare_area_buffer if page p is
+ * the first page of a block erased before. The counters are only
+ * written once per erase, so this clears the pending erase.
+ *
+ * @return 1 if the counters are due on page p, 0 otherwise.
  */
-int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data, dhara_error_t *err)
+static int take_health_counters(dhara_page_t p)
 {
-    //LOG_DBG("prog, page=%u", p);
-    nand_flash_device_t *dev = CONTAINER_OF(n, nand_flash_device_t, dhara_nand);
-    int ret;
-    uint8_t status;
-    uint16_t used_marker = 0;
-    
-
-    ret = read_page_and_wait(dev, p, NULL);//Initiate page read operation to cache. Reads the specified page from NAND to the device's internal cache.
-    if (ret) {
-        my_nand_handle->log("Failed to read page",true ,true ,p);
-        return -1;
+    for (int i = 0; i < PENDING_ERASES; i++) {
+        if (pending_erases[i].valid && pending_erases[i].first_page == p) {
+            //we store the ECC counter and erase counter on the first page of the block
+            memcpy(spare_area_buffer, &pending_erases[i].erase_count, 4);
+            memcpy(spare_area_buffer + 4, &Total_ECC_counter, 4);
+
+            pending_erases[i].valid = false;
+            return 1;
+        }
     }
+    return 0;
+}
+#endif //CONFIG_HEALTH_MONITORING
 
-    ret = nand_write_enable();//Enable writing on the NAND device.
-    if (ret) {
-        my_nand_handle->log("Failed to enable write, error",true ,true ,ret);
-        return -1;
-    }
-    memset(load_buffer, 0xFF, 4200);
+/**
+ * @brief Stage a page of data in load_buffer, the spare area is reset to 0xFF.
+ */
+static void stage_page(nand_flash_device_t *dev, const uint8_t *data)
+{
+    //no page read first: the program load resets the whole cache to 0xFF
+    memset(load_buffer, 0xFF, LOAD_BUFFER_SIZE);
     memcpy(load_buffer, data, dev->page_size);
+}
+
+
+/**
+ * @brief Fill in the spare area behind the page data staged in load_buffer.
+ *
+ * Used marker, optional checksum, health counters and software ECC codes.
+ *
+ * @return number of bytes of load_buffer to transfer.
+ */
+static size_t stage_spare_area(nand_flash_device_t *dev, dhara_page_t p)
+{
+    uint16_t used_marker = 0;
+    size_t load_length = dev->page_size + sizeof(used_marker) + 2;
+
     memcpy(load_buffer + dev->page_size + 2, &used_marker, sizeof(used_marker));
 
+#ifdef CONFIG_NAND_PAGE_CRC
+    //end-to-end checksum of the page data, computed before it crosses the SPI bus
+    uint32_t page_crc = crc32_nand(load_buffer, dev->page_size, CRC32_INIT);
+    memcpy(load_buffer + dev->page_size + PAGE_CRC_SPARE_AREA_OFFSET, &page_crc, sizeof(page_crc));
+    load_length = dev->page_size + PAGE_CRC_SPARE_AREA_OFFSET + sizeof(page_crc);
+#endif
 
 #ifdef CONFIG_HEALTH_MONITORING
     //we store the erase count indicator into the spare area
-    if(Erase_counter_FLAG && Erased_block == p){
-        
-        //we store the ECC counter and erase counter on the first page of the block
-        memcpy(spare_area_buffer, &erase_count_indicator, 4);
-        memcpy(spare_area_buffer + 4, &Total_ECC_counter, 4);
-
-        Erase_counter_FLAG = 0;
-
+    if (take_health_counters(p)) {
         memcpy(load_buffer + dev->page_size + ERASE_COUNTER_SPARE_AREA_OFFSET, spare_area_buffer, 8);
-        ret = nand_program_load(load_buffer, 0, dev->page_size  + ERASE_COUNTER_SPARE_AREA_OFFSET + 8);//put a flag there
-        if (ret) {
-            my_nand_handle->log("Failed to load erase counter, error",true ,true ,ret);
-            return -1;
-        }
-    }else{
-        ret = nand_program_load(load_buffer, 0, dev->page_size + sizeof(used_marker) + 2);
-        if (ret != 0) {
-            my_nand_handle->log("Failed to program load, error", true, true, ret);
-            return -1;
-        }
+        load_length = dev->page_size + ERASE_COUNTER_SPARE_AREA_OFFSET + 8;
     }
-    
-    ret = program_execute_and_wait(dev, p, &status);//Execute a program operation. Commits the data previously loaded into the device's cache to the NAND array
-    if (ret) {
-        my_nand_handle->log("Failed to execute program, error",true ,true ,ret);
-        return -1;
+#endif //CONFIG_HEALTH_MONITORING
+
+#ifdef CONFIG_NAND_SOFT_ECC
+    const size_t code_size = soft_ecc_code_size();
+    const size_t chunks = dev->page_size / SOFT_ECC_CHUNK_SIZE;
+    uint8_t *codes = load_buffer + dev->page_size + SOFT_ECC_OOB_OFFSET;
+
+    __ASSERT(chunks <= SOFT_ECC_MAX_CHUNKS, "Page too large for the soft ECC buffers");
+
+    for (size_t c = 0; c < chunks; c++) {
+        soft_ecc_generate(load_buffer + c * SOFT_ECC_CHUNK_SIZE, codes + c * code_size);
     }
+    load_length = MAX(load_length, dev->page_size + SOFT_ECC_OOB_OFFSET + chunks * code_size);
+#endif // CONFIG_NAND_SOFT_ECC
+
+    return load_length;
+}
+
 
+/**
+ * @brief Translate the status after a program operation into a dhara error.
+ *
+ * @return 0 if the page was programmed, -1 with err set to E_BAD_BLOCK otherwise.
+ */
+static int check_program_status(dhara_page_t p, uint8_t status, dhara_error_t *err)
+{
     if ((status & STAT_PROGRAM_FAILED) != 0) {
         my_nand_handle->log("prog failed, page",true ,true ,p);
         dhara_set_error(err, DHARA_E_BAD_BLOCK);
         return -1;
     }
-    
 
     return 0;
-#endif //CONFIG_HEALTH_MONITORING
+}
 
-    
-    ret = nand_program_load(load_buffer, 0, dev->page_size + sizeof(used_marker) + 2);
+
+/**
+ * @brief Program the page data staged in load_buffer to page p of the region n.
+ *
+ * Fills in the spare area behind the page data and commits the page. A failure of the
+ * page programming behind is reported first, p is not programmed then. With wait the
+ * status of p is checked before returning, otherwise (CONFIG_NAND_WRITE_BEHIND) the
+ * next operation checks it.
+ *
+ * @return 0 on success, -1 on failure (err is set to E_BAD_BLOCK if the
+ *         chip reports a failed program operation).
+ */
+static int program_load_buffer(nand_flash_device_t *dev, const struct dhara_nand *n, dhara_page_t p,
+                               bool wait, dhara_error_t *err)
+{
+    int ret;
+    uint8_t status;
+    const size_t load_length = stage_spare_area(dev, p);
+
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    //with interleaved pages the page behind programs on another chip while this one goes out
+    const bool other_chip = behind.n != NULL && !nand_same_flash(behind.p, p);
+    //only parts verified in the chip table take the load while the array still programs,
+    //the others would program their old cache content
+    const bool load_early = behind.n != NULL && !other_chip &&
+                            (dev->chip.features & NAND_CHIP_CACHE_PROGRAM) != 0;
+
+    if (load_early) {
+        nand_select_flash(p);
+        ret = nand_program_load(load_buffer, 0, load_length);
+        if (ret != 0) {
+            my_nand_handle->log("Failed to program load, error", true, true, ret);
+            return -1;
+        }
+    }
+#else
+    const bool other_chip = false;
+#endif
+
+    if (!other_chip && take_failure(n, err) < 0) {
+        return -1;
+    }
+
+    NAND_STATS_START(start);
+    NAND_TRACE_START(trace_start);
+
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    if (load_early) {
+        nand_select_flash(p);
+        ret = nand_write_enable();
+        if (ret == 0) {
+            ret = nand_program_execute(p);
+        }
+    } else
+#endif
+    {
+        //write enable, load and execute in one batch, the bus is set up once
+        ret = nand_enable_and_program_page(p, load_buffer, 0, load_length);
+    }
     if (ret != 0) {
-        my_nand_handle->log("Failed to program load, error", true, true, ret);
+        my_nand_handle->log("Failed to program page, error", true, true, ret);
         return -1;
     }
 
-    ret = program_execute_and_wait(dev, p, &status);//Execute a program operation. Commits the data previously loaded into the device's cache to the NAND array
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    if (other_chip) {
+        //the status of the page behind is polled only now, a failure there is reported in
+        //place of this page, which is left unused in the block the journal gives up
+        const int failure = take_failure(n, err);
+
+        nand_select_flash(p);
+        if (failure < 0) {
+            (void)wait_for_ready_nand(NULL);
+            return -1;
+        }
+    }
+
+    //while a failed page is kept, its buffer is taken and every page programs in the other one
+    if (!wait && failed.n == NULL) {
+        behind.n = n;
+        behind.p = p;
+        behind.buffer = load_buffer;
+        behind.start = k_cycle_get_32();
+        load_buffer = (load_buffer == load_buffers[0]) ? load_buffers[1] : load_buffers[0];
+        return 0;
+    }
+#endif
+
+    ret = wait_for_ready_nand(&status);
+    NAND_STATS_STOP(NAND_STATS_PROGRAM, start);
+    NAND_TRACE_END(NAND_TRACE_PROGRAM, 0, p, 0, trace_start);
     if (ret) {
         my_nand_handle->log("Failed to execute program, error",true ,true ,ret);
         return -1;
     }
 
-    if ((status & STAT_PROGRAM_FAILED) != 0) {
-        my_nand_handle->log("prog failed, page",true ,true ,p);
-        dhara_set_error(err, DHARA_E_BAD_BLOCK);
-        return -1;
-    }
-    
+    return check_program_status(p, status, err);
+}
 
-    return 0;
+
+/* Program the given page. The data pointer is a pointer to an entire
+ * page ((1 << log2_page_size) bytes). The operation status should be
+ * checked. If the operation fails, return -1 and set err to
+ * E_BAD_BLOCK.
+ * 
+ */
+int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data, dhara_error_t *err)
+{
+    //LOG_DBG("prog, page=%u", p);
+    nand_flash_device_t *dev = device_of(n);
+
+    stage_page(dev, data);
+    return program_load_buffer(dev, n, region_page(n, p), true, err);
+}
+
+
+int dhara_nand_prog_behind(const struct dhara_nand *n, dhara_page_t p, const uint8_t *data, dhara_error_t *err)
+{
+    nand_flash_device_t *dev = device_of(n);
+
+    stage_page(dev, data);
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    return program_load_buffer(dev, n, region_page(n, p), false, err);
+#else
+    return program_load_buffer(dev, n, region_page(n, p), true, err);
+#endif
 }
 
 
@@ -399,10 +1059,17 @@ int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p, const uint8_t *d
 
 int dhara_nand_is_free(const struct dhara_nand *n, dhara_page_t p)
 {
-    nand_flash_device_t *dev = CONTAINER_OF(n, nand_flash_device_t, dhara_nand);
+    nand_flash_device_t *dev = device_of(n);
     int ret;
     uint16_t used_marker = 0;
 
+    p = region_page(n, p);
+
+    finish_behind();
+    if (is_failed_page(n, p)) {
+        return 0;
+    }
+
     ret = read_page_and_wait(dev, p, NULL);
     if (ret) {
         my_nand_handle->log("Failed to read page",true ,true ,p);
@@ -424,6 +1091,101 @@ static int is_ecc_error(uint8_t status)
     return (status & STAT_ECC1) != 0 && (status & STAT_ECC0) == 0;
 }
 
+
+/**
+ * @brief Transfer a portion of the page held in the NAND cache to the MCU,
+ * through the software ECC if it is enabled.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int read_from_cache(nand_flash_device_t *dev, dhara_page_t p, size_t offset, size_t length,
+                           uint8_t *data, dhara_error_t *err)
+{
+#ifdef CONFIG_NAND_SOFT_ECC
+    return soft_ecc_read(dev, p, offset, length, data, err);
+#else
+    int ret = nand_read(data, offset, length);
+    if (ret != 0) {
+        my_nand_handle->log("Failed to read data from page",true ,true ,offset);
+        return -1;
+    }
+
+    return 0;
+#endif
+}
+
+
+#ifdef CONFIG_NAND_PAGE_CRC
+/**
+ * @brief Transfer the whole page in the cache and compare it with its stored checksum.
+ *
+ * @return 1 if the checksum matches or the page has none, 0 on a mismatch, -1 on failure.
+ */
+static int page_crc_check(nand_flash_device_t *dev, dhara_page_t p, uint8_t *data, dhara_error_t *err)
+{
+    uint32_t stored_crc;
+    int ret;
+
+    ret = read_from_cache(dev, p, 0, dev->page_size, data, err);
+    if (ret != 0) {
+        return -1;
+    }
+
+    ret = nand_read((uint8_t *)&stored_crc, dev->page_size + PAGE_CRC_SPARE_AREA_OFFSET, sizeof(stored_crc));
+    if (ret != 0) {
+        my_nand_handle->log("Failed to read page checksum",true ,true ,p);
+        return -1;
+    }
+
+    return stored_crc == 0xFFFFFFFF || crc32_nand(data, dev->page_size, CRC32_INIT) == stored_crc;
+}
+
+
+/**
+ * @brief Read a whole page and check it against the checksum stored at program time.
+ *
+ * This is the path of dhara_map_read(). A mismatch is usually a glitch on the SPI
+ * bus rather than a bad cell, so the page is transferred again (and loaded into
+ * the cache again) before giving up with DHARA_E_CHECKSUM. Pages written before
+ * the checksum existed carry 0xFFFFFFFF and are accepted unchecked.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int page_crc_read(nand_flash_device_t *dev, dhara_page_t p, uint8_t *data, dhara_error_t *err)
+{
+    int ret;
+
+    for (int attempt = 0; ; attempt++) {
+        ret = page_crc_check(dev, p, data, err);
+        if (ret < 0) {
+            return -1;
+        }
+
+        if (ret == 1) {
+            if (attempt > 0) {
+                my_nand_handle->log("Page checksum recovered by re-reading page",false ,true ,p);
+            }
+            return 0;
+        }
+
+        Page_CRC_mismatches++;
+        NAND_CLOCK_ANOMALY();
+        if (attempt == CONFIG_NAND_PAGE_CRC_RETRIES) {
+            break;
+        }
+
+        my_nand_handle->log("Page checksum mismatch, re-reading page",false ,true ,p);
+        if (read_page_and_wait(dev, p, NULL) != 0) {
+            return -1;
+        }
+    }
+
+    my_nand_handle->log("Page checksum mismatch on page",true ,true ,p);
+    dhara_set_error(err, DHARA_E_CHECKSUM);
+    return -1;
+}
+#endif // CONFIG_NAND_PAGE_CRC
+
 /* Read a portion of a page. ECC must be handled by the NAND
  * implementation. Returns 0 on sucess or -1 if an error occurs. If an
  * uncorrectable ECC error occurs, return -1 and set err to E_ECC.
@@ -432,11 +1194,20 @@ int dhara_nand_read(const struct dhara_nand *n, dhara_page_t p, size_t offset, s
                     uint8_t *data, dhara_error_t *err)
 {
     __ASSERT(p < n->num_blocks * (1 << n->log2_ppb), "Page out of range");
-    nand_flash_device_t *dev = CONTAINER_OF(n, nand_flash_device_t, dhara_nand);
+    nand_flash_device_t *dev = device_of(n);
     int ret;
     uint8_t status;
 
-    
+    p = region_page(n, p);
+
+    finish_behind();
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    if (is_failed_page(n, p)) {
+        memcpy(data, failed.buffer + offset, length);
+        return 0;
+    }
+#endif
+
     ret = read_page_and_wait(dev, p, &status);
     if(ret != 0){
         my_nand_handle->log("error in dhara nand read",true ,false ,0);
@@ -447,19 +1218,84 @@ int dhara_nand_read(const struct dhara_nand *n, dhara_page_t p, size_t offset, s
         my_nand_handle->log("ECC error on page",true ,true ,p);
         dhara_set_error(err, DHARA_E_ECC);
         Delta_ECC_counter++;
+        NAND_CLOCK_ANOMALY();
         return -1;
     }
 
-    ret = nand_read(data, offset, length);
-    if (ret != 0) {
-        my_nand_handle->log("Failed to read data from page",true ,true ,offset);
+#ifdef CONFIG_NAND_PAGE_CRC
+    if (offset == 0 && length == dev->page_size) {
+        return page_crc_read(dev, p, data, err);
+    }
+#endif
+
+    return read_from_cache(dev, p, offset, length, data, err);
+}
+
+
+
+
+#ifdef CONFIG_NAND_CACHE_READ
+struct seq_read {
+    nand_flash_device_t *dev;
+    uint8_t *data;
+    dhara_page_t first;
+    dhara_error_t *err;
+};
+
+/**
+ * @brief Transfer one page of a cache read sequence, see nand_read_pages_seq().
+ *
+ * Errors are neither logged nor counted, the caller reads the pages again one by
+ * one, which retries and accounts for them.
+ */
+static int seq_read_page(uint32_t page, uint8_t status, void *arg)
+{
+    struct seq_read *r = arg;
+    uint8_t *data = r->data + (size_t)(page - r->first) * r->dev->page_size;
+
+    if (is_ecc_error(status)) {
+        dhara_set_error(r->err, DHARA_E_ECC);
+        NAND_CLOCK_ANOMALY();
         return -1;
     }
 
-    return 0;
+#ifdef CONFIG_NAND_PAGE_CRC
+    int ret = page_crc_check(r->dev, page, data, r->err);
+    if (ret == 0) {
+        dhara_set_error(r->err, DHARA_E_CHECKSUM);
+    }
+    return ret == 1 ? 0 : -1;
+#else
+    return read_from_cache(r->dev, page, 0, r->dev->page_size, data, r->err);
+#endif
 }
 
 
+int dhara_nand_read_seq(const struct dhara_nand *n, dhara_page_t p, size_t count,
+                        uint8_t *data, dhara_error_t *err)
+{
+    __ASSERT(p + count <= n->num_blocks * (1 << n->log2_ppb), "Page out of range");
+    struct seq_read r = {
+        .dev = device_of(n),
+        .data = data,
+        .first = region_page(n, p),
+        .err = err
+    };
+
+    finish_behind();
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    //the caller reads the pages one by one, which serves the failed page from its buffer
+    if (failed.n == n && failed.p >= r.first && failed.p < r.first + count) {
+        return -1;
+    }
+#endif
+
+    if (nand_read_pages_seq(r.first, count, seq_read_page, &r) != 0) {
+        return -1;
+    }
+    return 0;
+}
+#endif //CONFIG_NAND_CACHE_READ
 
 
 /* Read a page from one location and reprogram it in another location.
@@ -468,14 +1304,42 @@ int dhara_nand_read(const struct dhara_nand *n, dhara_page_t p, size_t offset, s
  */
 int dhara_nand_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t dst, dhara_error_t *err)
 {
-    nand_flash_device_t *dev = CONTAINER_OF(n, nand_flash_device_t, dhara_nand);
+    nand_flash_device_t *dev = device_of(n);
+    const dhara_page_t src_phys = region_page(n, src);
     int ret;
     uint8_t status;
 
+    dst = region_page(n, dst);
+
+    if (take_failure(n, err) < 0) {
+        return -1;
+    }
+
+#ifdef CONFIG_NAND_SOFT_ECC
+    //the internal copy would move the page without looking at it, so a flipped bit
+    //would be written back with its old code. Route the page through the soft ECC instead.
+    const int copy_via_mcu = 1;
+#else
+    //the internal copy only works within one chip and plane, other pages go over SPI.
+    //A page that failed behind the caller is only intact in its buffer.
+    const int copy_via_mcu = !nand_copy_back_possible(src_phys, dst) || is_failed_page(n, src_phys);
+#endif
+
+    if (copy_via_mcu) {
+        memset(load_buffer, 0xFF, LOAD_BUFFER_SIZE);
+        ret = dhara_nand_read(n, src, 0, dev->page_size, load_buffer, err);
+        if (ret != 0) {
+            my_nand_handle->log("Copy, failed to read source page",true ,true ,src);
+            return -1;
+        }
+
+        return program_load_buffer(dev, n, dst, true, err);
+    }
+
    
-    ret = read_page_and_wait(dev, src, &status);
+    ret = read_page_and_wait(dev, src_phys, &status);
     if (ret != 0) {
-        my_nand_handle->log("Failed to read page",true ,true ,src);
+        my_nand_handle->log("Failed to read page",true ,true ,src_phys);
         return -1;
     }
 
@@ -484,6 +1348,7 @@ int dhara_nand_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t d
         my_nand_handle->log("Copy, ECC error detected",true ,false ,0);
         dhara_set_error(err, DHARA_E_ECC);
         Delta_ECC_counter++;
+        NAND_CLOCK_ANOMALY();
         return -1;
     }
 
@@ -494,6 +1359,18 @@ int dhara_nand_copy(const struct dhara_nand *n, dhara_page_t src, dhara_page_t d
         return -1;
     }
 
+    //copy-back: the page data, used marker, page CRC and ECC codes are all still
+    //valid in the cache, so no user byte crosses the SPI bus. Only per-block
+    //bookkeeping that differs between src and dst is patched in.
+#ifdef CONFIG_HEALTH_MONITORING
+    if (take_health_counters(dst)) {
+        ret = nand_program_load_random(spare_area_buffer, dev->page_size + ERASE_COUNTER_SPARE_AREA_OFFSET, 8);
+        if (ret != 0) {
+            my_nand_handle->log("Copy, failed to patch the spare area",true ,true ,ret);
+            return -1;
+        }
+    }
+#endif //CONFIG_HEALTH_MONITORING
 
     ret = program_execute_and_wait(dev, dst, &status);
     if (ret != 0) {
@@ -82,6 +82,19 @@ int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p,
 		    const uint8_t *data,
 		    dhara_error_t *err);
 
+/* Program the given page as dhara_nand_prog() does, but return as soon
+ * as the program has started. Its status is checked by the next call
+ * into this layer. If it failed, the next dhara_nand_prog(),
+ * dhara_nand_prog_behind() or dhara_nand_copy() on n returns -1 with
+ * err set to E_BAD_BLOCK and programs nothing. Until the block of the failed
+ * page is erased or marked bad, the page reads back as it was given.
+ *
+ * Without write-behind support, this is dhara_nand_prog().
+ */
+int dhara_nand_prog_behind(const struct dhara_nand *n, dhara_page_t p,
+			   const uint8_t *data,
+			   dhara_error_t *err);
+
 /* Check that the given page is erased */
 int dhara_nand_is_free(const struct dhara_nand *n, dhara_page_t p);
 
@@ -94,6 +107,17 @@ int dhara_nand_read(const struct dhara_nand *n, dhara_page_t p,
 		    uint8_t *data,
 		    dhara_error_t *err);
 
+#ifdef CONFIG_NAND_CACHE_READ
+/* Read count whole pages starting at p, all in one block, into data
+ * (count pages long). Uses the cache read sequence of the chip if it
+ * has one. Returns 0 on success or -1 if any page failed, the caller
+ * is expected to read the pages again with dhara_nand_read().
+ */
+int dhara_nand_read_seq(const struct dhara_nand *n, dhara_page_t p,
+			size_t count, uint8_t *data,
+			dhara_error_t *err);
+#endif
+
 /* Read a page from one location and reprogram it in another location.
  * This might be done using the chip's internal buffers, but it must use
  * ECC.
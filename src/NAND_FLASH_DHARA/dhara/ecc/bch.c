@@ -130,64 +130,62 @@ static void poly_add(gf13_elem_t *dst, const gf13_elem_t *src,
 	}
 }
 
-static gf13_elem_t poly_eval(const gf13_elem_t *s, gf13_elem_t x)
+/************************************************************************
+ * Error correction
+ */
+
+/* Raise the primitive element to the given power */
+static gf13_elem_t alpha_pow(unsigned int n)
 {
-	int i;
-	gf13_elem_t sum = 0;
-	gf13_elem_t t = x;
+	gf13_elem_t r = 1;
+	gf13_elem_t a = 2;
 
-	for (i = 0; i < MAX_POLY; i++) {
-		const gf13_elem_t c = s[i];
+	n %= GF13_ORDER;
 
-		if (c)
-			sum ^= gf13_mul(c, t);
+	while (n) {
+		if (n & 1)
+			r = gf13_mul(r, a);
 
-		t = gf13_mul(t, x);
+		a = gf13_mul(a, a);
+		n >>= 1;
 	}
 
-	return sum;
+	return r;
 }
 
-/************************************************************************
- * Error correction
+/* The received word is the data (bits 0..chunk_bits-1) followed by the
+ * stored remainder. Re-encoding the received data gives a valid
+ * codeword which differs from the received word only in the remainder
+ * part, so the syndromes follow from the remainder difference alone:
+ *
+ *     S(x) = x^chunk_bits * (stored ^ computed)(x)
+ *
+ * This costs at most one term per remainder bit instead of a pass over
+ * the chunk.
  */
-
-static gf13_elem_t syndrome(const struct bch_def *bch,
-			    const uint8_t *chunk,
-			    size_t len,
-			    bch_poly_t remainder,
-			    gf13_elem_t x)
+static gf13_elem_t syndrome(const struct bch_def *bch, bch_poly_t diff,
+			    int chunk_bits, gf13_elem_t x, int power)
 {
 	gf13_elem_t y = 0;
-	gf13_elem_t t = 1;
+	gf13_elem_t t = alpha_pow((unsigned int)power * chunk_bits);
 	int i;
 
-	for (i = 0; i < len; i++) {
-		uint8_t c = chunk[i] ^ 0xff;
-		int j;
-
-		for (j = 0; j < 8; j++) {
-			if (c & 1)
-				y ^= t;
-
-			c >>= 1;
-			t = gf13_mul(t, x);
-		}
-	}
-
 	for (i = 0; i < bch->degree; i++) {
-		if (remainder & 1)
+		if (diff & 1)
 			y ^= t;
 
-		remainder >>= 1;
+		diff >>= 1;
 		t = gf13_mul(t, x);
 	}
 
 	return y;
 }
 
-static void berlekamp_massey(const gf13_elem_t *s, int N,
-			     gf13_elem_t *sigma)
+/* Returns the degree of the error locator polynomial (the number of
+ * errors, if they are correctable).
+ */
+static int berlekamp_massey(const gf13_elem_t *s, int N,
+			    gf13_elem_t *sigma)
 {
 	gf13_elem_t C[MAX_POLY];
 	gf13_elem_t B[MAX_POLY];
@@ -233,43 +231,96 @@ static void berlekamp_massey(const gf13_elem_t *s, int N,
 		}
 	}
 
-	memcpy(sigma, C, MAX_POLY);
+	memcpy(sigma, C, sizeof(C));
+	return L;
 }
 
-void bch_repair(const struct bch_def *bch,
-		uint8_t *chunk, size_t len, uint8_t *ecc)
+int bch_verify_repair(const struct bch_def *bch,
+		      uint8_t *chunk, size_t len, uint8_t *ecc)
 {
-	const bch_poly_t remainder = unpack_poly(bch, ecc);
+	const bch_poly_t stored = unpack_poly(bch, ecc);
+	const bch_poly_t diff = chunk_remainder(bch, chunk, len) ^ stored;
 	const int chunk_bits = len << 3;
+	const int total_bits = chunk_bits + bch->degree;
 	gf13_elem_t syns[BCH_MAX_SYNS];
 	gf13_elem_t sigma[MAX_POLY];
+	gf13_elem_t step[MAX_POLY];
+	int where[BCH_MAX_SYNS / 2];
 	gf13_elem_t x;
+	int roots = 0;
+	int L;
 	int i;
 
+	/* Clean chunk: this is the common case */
+	if (!diff)
+		return 0;
+
 	/* Compute syndrome vector */
 	x = 2;
 	for (i = 0; i < bch->syns; i++) {
-		syns[i] = syndrome(bch, chunk, len, remainder, x);
+		syns[i] = syndrome(bch, diff, chunk_bits, x, i + 1);
 		x = gf13_mulx(x);
 	}
 
 	/* Compute sigma */
-	berlekamp_massey(syns, bch->syns, sigma);
-
-	/* Each root of sigma corresponds to an error location. Correct
-	 * errors in the chunk data first.
+	L = berlekamp_massey(syns, bch->syns, sigma);
+	if ((L < 1) || (L * 2 > bch->syns))
+		return -1;
+
+	/* Chien search. Each root of sigma corresponds to an error
+	 * location: position i is in error if sigma(a^-i) = 0. Term k of
+	 * the sum is multiplied by a^-k for every step, so that only the
+	 * L + 1 live terms are touched.
 	 */
-	x = 1;
-	for (i = 0; i < chunk_bits; i++) {
-		if (!poly_eval(sigma, x))
-			chunk[i >> 3] ^= 1 << (i & 7);
-		x = gf13_divx(x);
+	step[0] = 1;
+	for (i = 1; i <= L; i++)
+		step[i] = gf13_divx(step[i - 1]);
+
+	for (i = 0; i < total_bits; i++) {
+		gf13_elem_t sum = sigma[0];
+		int k;
+
+		for (k = 1; k <= L; k++) {
+			if (!sigma[k])
+				continue;
+
+			sum ^= sigma[k];
+			sigma[k] = gf13_mul(sigma[k], step[k]);
+		}
+
+		if (sum)
+			continue;
+
+		if (roots >= L)
+			return -1;
+
+		where[roots++] = i;
 	}
 
-	/* Then correct errors in the ECC data */
-	for (i = 0; i < bch->degree; i++) {
-		if (!poly_eval(sigma, x))
-			ecc[i >> 3] ^= 1 << (i & 7);
-		x = gf13_divx(x);
+	/* A locator without exactly L roots inside the codeword means
+	 * more errors than the code can correct. Leave the data alone.
+	 */
+	if (roots != L)
+		return -1;
+
+	/* Errors in the chunk data first, then in the ECC data */
+	for (i = 0; i < roots; i++) {
+		const int bit = where[i];
+
+		if (bit < chunk_bits) {
+			chunk[bit >> 3] ^= 1 << (bit & 7);
+		} else {
+			const int j = bit - chunk_bits;
+
+			ecc[j >> 3] ^= 1 << (j & 7);
+		}
 	}
+
+	return roots;
+}
+
+void bch_repair(const struct bch_def *bch,
+		uint8_t *chunk, size_t len, uint8_t *ecc)
+{
+	bch_verify_repair(bch, chunk, len, ecc);
 }
@@ -86,4 +86,13 @@ int bch_verify(const struct bch_def *bch,
 void bch_repair(const struct bch_def *bch,
 		uint8_t *chunk, size_t len, uint8_t *ecc);
 
+/* Verify and, if necessary, correct a chunk in a single call. A clean
+ * chunk costs one remainder computation; the decoder only runs on a
+ * mismatch. Returns the number of corrected bits (0 for a clean chunk),
+ * or -1 if the errors are not correctable, in which case the chunk and
+ * ECC data are left untouched.
+ */
+int bch_verify_repair(const struct bch_def *bch,
+		      uint8_t *chunk, size_t len, uint8_t *ecc);
+
 #endif
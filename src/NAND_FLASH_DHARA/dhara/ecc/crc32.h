@@ -43,4 +43,23 @@
 uint32_t crc32_nand(const uint8_t *block, size_t len,
 		    uint32_t carry);
 
+/* Prepare checksums of len bytes, usually the page size. Only needed
+ * with CRC32_HW_BACKEND, where it precomputes the correction term. Call
+ * it once before crc32_nand() is used concurrently.
+ */
+void crc32_nand_prepare(size_t len);
+
+/* Optional hardware backend. When CRC32_HW_BACKEND is defined, the
+ * platform must provide a standard IEEE 802.3 CRC update (reflected,
+ * complemented before and after, as zlib's crc32() or Zephyr's
+ * crc32_ieee_update()). crc32_nand() corrects its result.
+ */
+#if defined(CONFIG_NAND_CRC32_HW_BACKEND) && !defined(CRC32_HW_BACKEND)
+#define CRC32_HW_BACKEND
+#endif
+
+#ifdef CRC32_HW_BACKEND
+uint32_t crc32_hw_update(uint32_t crc, const uint8_t *data, size_t len);
+#endif
+
 #endif
@@ -53,16 +53,86 @@ static void flip_test(const struct bch_def *def,
 	assert(!i);
 }
 
+static void flip_count_test(const struct bch_def *def,
+			    const uint8_t *good, int nbits)
+{
+	uint8_t bad[TEST_CHUNK_SIZE];
+	int flipped[BCH_MAX_ECC];
+	int i;
+
+	memcpy(bad, good, sizeof(bad));
+
+	/* Distinct positions in data and ECC bytes */
+	for (i = 0; i < nbits; i++) {
+		int which;
+		int j;
+
+		do {
+			which = random() % ((BCH_CHUNK_SIZE << 3) +
+					    def->degree);
+			for (j = 0; j < i; j++)
+				if (flipped[j] == which)
+					break;
+		} while (j < i);
+
+		flipped[i] = which;
+		bad[which >> 3] ^= 1 << (which & 7);
+	}
+
+	i = bch_verify_repair(def, bad, BCH_CHUNK_SIZE, bad + BCH_CHUNK_SIZE);
+	assert(i == nbits);
+
+	i = memcmp(good, bad, BCH_CHUNK_SIZE + def->ecc_bytes);
+	assert(!i);
+}
+
+static void too_many_test(const struct bch_def *def, const uint8_t *good)
+{
+	uint8_t bad[TEST_CHUNK_SIZE];
+	uint8_t before[TEST_CHUNK_SIZE];
+	int i;
+
+	memcpy(bad, good, sizeof(bad));
+
+	for (i = 0; i <= def->syns; i++)
+		flip_one_bit(bad, BCH_CHUNK_SIZE);
+
+	/* Either detected and left alone, or miscorrected to some other
+	 * codeword. Never a half-repaired chunk.
+	 */
+	memcpy(before, bad, sizeof(bad));
+	i = bch_verify_repair(def, bad, BCH_CHUNK_SIZE, bad + BCH_CHUNK_SIZE);
+	if (i < 0) {
+		i = memcmp(before, bad, sizeof(bad));
+		assert(!i);
+	} else {
+		i = bch_verify(def, bad, BCH_CHUNK_SIZE, bad + BCH_CHUNK_SIZE);
+		assert(!i);
+	}
+}
+
 static void test_properties(const struct bch_def *def,
 			    const uint8_t *block)
 {
+	uint8_t copy[TEST_CHUNK_SIZE];
 	int i;
 
 	i = bch_verify(def, block, BCH_CHUNK_SIZE, block + BCH_CHUNK_SIZE);
 	assert(!i);
 
+	memcpy(copy, block, sizeof(copy));
+	i = bch_verify_repair(def, copy, BCH_CHUNK_SIZE,
+			      copy + BCH_CHUNK_SIZE);
+	assert(!i);
+
 	for (i = 0; i < 20; i++)
 		flip_test(def, block);
+
+	for (i = 0; i < 20; i++)
+		flip_count_test(def, block, 1 + i % (def->syns / 2));
+
+	for (i = 0; i < 20; i++)
+		too_many_test(def, block);
 }
 
 static void test_random_block(const struct bch_def *def)
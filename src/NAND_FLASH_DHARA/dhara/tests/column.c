@@ -0,0 +1,122 @@
+/* Dhara - NAND flash management layer
+ * Copyright (C) 2013 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "nand_column.h"
+
+/* The low byte of the result goes on the bus first: the high byte of
+ * the column, which holds the plane select bit.
+ */
+static void test_address(void)
+{
+	/* 2048 byte pages: plane select is bit 12 */
+	assert(nand_column_address(0, 0, 11) == 0x0000);
+	assert(nand_column_address(0, 1, 11) == 0x0010);
+	assert(nand_column_address(2047, 0, 11) == 0xff07);
+	assert(nand_column_address(2047, 1, 11) == 0xff17);
+	assert(nand_column_address(2111, 1, 11) == 0x3f18);
+
+	/* 4096 byte pages: plane select is bit 13 */
+	assert(nand_column_address(0, 1, 12) == 0x0020);
+	assert(nand_column_address(4096 + 255, 0, 12) == 0xff10);
+	assert(nand_column_address(4096 + 255, 1, 12) == 0xff30);
+}
+
+static void check_pair(uint32_t column, uint8_t log2_page_size,
+		       uint16_t oob_size, uint16_t chip_column,
+		       uint8_t plane, uint32_t piece)
+{
+	uint16_t c;
+	uint8_t p;
+
+	assert(nand_pair_column(column, log2_page_size, oob_size,
+				&c, &p) == piece);
+	assert(c == chip_column);
+	assert(p == plane);
+}
+
+static void test_pieces(void)
+{
+	/* Plane 0 data, plane 1 data, plane 0 spare, plane 1 spare */
+	check_pair(0, 11, 64, 0, 0, 2048);
+	check_pair(100, 11, 64, 100, 0, 1948);
+	check_pair(2047, 11, 64, 2047, 0, 1);
+	check_pair(2048, 11, 64, 0, 1, 2048);
+	check_pair(4095, 11, 64, 2047, 1, 1);
+	check_pair(4096, 11, 64, 2048, 0, 64);
+	check_pair(4159, 11, 64, 2111, 0, 1);
+	check_pair(4160, 11, 64, 2048, 1, UINT16_MAX);
+	check_pair(4223, 11, 64, 2111, 1, UINT16_MAX);
+
+	check_pair(4096, 12, 256, 0, 1, 4096);
+	check_pair(8192 + 255, 12, 256, 4096 + 255, 0, 1);
+	check_pair(8192 + 256, 12, 256, 4096, 1, UINT16_MAX);
+}
+
+/* Split a whole pair page into pieces as the driver does and check
+ * that every byte of both plane caches is hit exactly once.
+ */
+static void test_split(uint8_t log2_page_size, uint16_t oob_size)
+{
+	const uint32_t plane_size = (1U << log2_page_size) + oob_size;
+	const uint32_t length = 2 * plane_size;
+	uint8_t *hits = calloc(2, plane_size);
+	uint32_t column = 0;
+	int pieces = 0;
+	uint32_t i;
+
+	assert(hits);
+
+	while (column < length) {
+		uint16_t c;
+		uint8_t p;
+		uint32_t len = nand_pair_column(column, log2_page_size,
+						oob_size, &c, &p);
+
+		if (len > length - column)
+			len = length - column;
+
+		assert(len > 0);
+		assert(c + len <= plane_size);
+
+		for (i = 0; i < len; i++)
+			hits[p * plane_size + c + i]++;
+
+		column += len;
+		pieces++;
+	}
+
+	assert(pieces == 4);
+	for (i = 0; i < 2 * plane_size; i++)
+		assert(hits[i] == 1);
+
+	free(hits);
+}
+
+int main(void)
+{
+	test_address();
+	test_pieces();
+	test_split(11, 64);
+	test_split(11, 128);
+	test_split(12, 256);
+
+	printf("column: ok\n");
+	return 0;
+}
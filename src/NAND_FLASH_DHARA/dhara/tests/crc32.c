@@ -20,6 +20,49 @@
 #include "ecc/crc32.h"
 
 #define BLOCK_SIZE	512
+#define LONG_SIZE	2048
+
+/* Bit-at-a-time reference for crc32_nand(), following the definition
+ * (inverted coefficients) rather than any table.
+ */
+static uint32_t ref_crc32_nand(const uint8_t *block, size_t len, uint32_t c)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		int j;
+
+		c ^= block[i];
+
+		for (j = 0; j < 8; j++)
+			c = (c >> 1) ^ ((c & 1) ? 0xedb88320 : 0);
+
+		c ^= 0xff000000;
+	}
+
+	return c;
+}
+
+#ifdef CRC32_HW_BACKEND
+/* Stand-in for a CRC peripheral: the standard IEEE 802.3 update */
+uint32_t crc32_hw_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	crc = ~crc;
+
+	for (i = 0; i < len; i++) {
+		int j;
+
+		crc ^= data[i];
+
+		for (j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+	}
+
+	return ~crc;
+}
+#endif
 
 static void flip_one_bit(uint8_t *b, int size)
 {
@@ -60,6 +103,34 @@ static void test_random_block(void)
 		test_hd(block, crc, 4);
 }
 
+static void test_reference(void)
+{
+	uint8_t block[LONG_SIZE];
+	int i;
+
+	for (i = 0; i < LONG_SIZE; i++)
+		block[i] = random();
+
+	/* Unaligned starts, odd lengths, carried checksums */
+	for (i = 0; i < 200; i++) {
+		const size_t start = random() % 16;
+		const size_t len = random() % (LONG_SIZE - start);
+		const uint32_t carry = (i & 1) ? CRC32_INIT : random();
+
+		assert(crc32_nand(block + start, len, carry) ==
+		       ref_crc32_nand(block + start, len, carry));
+	}
+
+	/* Splitting a block anywhere gives the same checksum */
+	for (i = 0; i < 20; i++) {
+		const size_t split = random() % LONG_SIZE;
+		uint32_t c = crc32_nand(block, split, CRC32_INIT);
+
+		c = crc32_nand(block + split, LONG_SIZE - split, c);
+		assert(c == crc32_nand(block, LONG_SIZE, CRC32_INIT));
+	}
+}
+
 int main(void)
 {
 	uint8_t block[BLOCK_SIZE];
@@ -72,5 +143,11 @@ int main(void)
 	for (i = 0; i < 10; i++)
 		test_random_block();
 
+	test_reference();
+
+	/* The prepared length takes the precomputed correction */
+	crc32_nand_prepare(LONG_SIZE);
+	test_reference();
+
 	return 0;
 }
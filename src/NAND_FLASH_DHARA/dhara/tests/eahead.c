@@ -0,0 +1,107 @@
+/* Dhara - NAND flash management layer
+ * Copyright (C) 2013 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "dhara/journal.h"
+#include "sim.h"
+#include "util.h"
+#include "jtutil.h"
+
+/* Enqueue pages one at a time, erasing ahead after each as an idle
+ * worker would. Returns the number of pages enqueued.
+ */
+static int enqueue_idle(struct dhara_journal *j, int start, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		dhara_error_t err;
+
+		if (jt_enqueue_sequence(j, start + i, 1) < 1)
+			break;
+
+		if (dhara_journal_erase_ahead(j, &err) < 0 &&
+		    err != DHARA_E_BAD_BLOCK)
+			dabort("erase_ahead", err);
+
+		jt_check(j);
+	}
+
+	return i;
+}
+
+static void test(int bad)
+{
+	struct dhara_journal journal;
+	const size_t page_size = 1 << sim_nand.log2_page_size;
+	uint8_t page_buf[page_size];
+	int first = 0;
+	int next;
+	int i;
+
+	sim_reset();
+	if (bad) {
+		sim_inject_bad(10);
+		sim_inject_failed(10);
+	}
+
+	printf("Journal init, bad blocks: %d\n", bad);
+	dhara_journal_init(&journal, &sim_nand, page_buf);
+
+	/* Fill the journal, then keep it running around the chip */
+	next = enqueue_idle(&journal, 0, (int)(~0u >> 1));
+	printf("    enqueue count: %d\n", next);
+	assert(next > 0);
+
+	for (i = 0; i < 6; i++) {
+		const int half = (next - first) / 2;
+		int more;
+
+		jt_dequeue_sequence(&journal, first, half);
+		journal.tail_sync = journal.tail;
+		first += half;
+
+		more = enqueue_idle(&journal, next, half);
+		assert(more > 0);
+		next += more;
+	}
+
+	jt_dequeue_sequence(&journal, first, next - first);
+
+	printf("    erases: %d, ahead: %d\n", journal.stats.erases,
+	       journal.stats.erases_ahead);
+
+	/* Without bad blocks, only the very first block is erased inline */
+	if (!bad)
+		assert(journal.stats.erases - journal.stats.erases_ahead == 1);
+}
+
+int main(void)
+{
+	for (int i = 0; i < 20; i++) {
+		printf("--------------------------------"
+		       "--------------------------------\n");
+		printf("Seed: %d\n", i);
+		srandom(i);
+		test(0);
+		test(1);
+	}
+
+	return 0;
+}
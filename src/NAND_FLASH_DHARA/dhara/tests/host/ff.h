@@ -0,0 +1,18 @@
+/* Host stand-in for the FatFs types used by vfs_NAND_flash.h */
+
+#ifndef HOST_FF_H_
+#define HOST_FF_H_
+
+#include <stdint.h>
+
+typedef uint64_t FSIZE_t;
+
+typedef struct {
+	int unused;
+} FATFS;
+
+typedef struct {
+	FSIZE_t fptr;
+} FIL;
+
+#endif
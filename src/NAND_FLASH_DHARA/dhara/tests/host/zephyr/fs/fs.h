@@ -0,0 +1,10 @@
+/* Host stand-in for the Zephyr file system header */
+
+#ifndef HOST_ZEPHYR_FS_FS_H_
+#define HOST_ZEPHYR_FS_FS_H_
+
+struct fs_mount_t {
+	const char *mnt_point;
+};
+
+#endif
@@ -0,0 +1,59 @@
+/* Host stand-in for the few Zephyr kernel declarations used by the
+ * sources under test. The test defines the functions itself.
+ */
+
+#ifndef HOST_ZEPHYR_KERNEL_H_
+#define HOST_ZEPHYR_KERNEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <zephyr/sys/atomic.h>
+
+typedef struct {
+	int64_t ticks;
+} k_timeout_t;
+
+#define K_FOREVER		((k_timeout_t){ -1 })
+#define K_NO_WAIT		((k_timeout_t){ 0 })
+#define K_SEM_MAX_LIMIT		UINT32_MAX
+
+struct k_sem {
+	void *impl;
+};
+
+struct k_thread {
+	void *impl;
+};
+
+typedef struct k_thread *k_tid_t;
+typedef struct {
+	char unused;
+} k_thread_stack_t;
+typedef void (*k_thread_entry_t)(void *p1, void *p2, void *p3);
+
+#define K_THREAD_STACK_DEFINE(name, size)	k_thread_stack_t name[(size)]
+#define K_THREAD_STACK_SIZEOF(sym)		sizeof(sym)
+
+int k_sem_init(struct k_sem *sem, unsigned int initial, unsigned int limit);
+int k_sem_take(struct k_sem *sem, k_timeout_t timeout);
+void k_sem_give(struct k_sem *sem);
+
+k_tid_t k_thread_create(struct k_thread *thread, k_thread_stack_t *stack,
+			size_t stack_size, k_thread_entry_t entry,
+			void *p1, void *p2, void *p3,
+			int prio, uint32_t options, k_timeout_t delay);
+int k_thread_name_set(k_tid_t thread, const char *name);
+int k_thread_join(struct k_thread *thread, k_timeout_t timeout);
+
+uint32_t k_cycle_get_32(void);
+uint32_t k_cyc_to_us_floor32(uint32_t cycles);
+
+#define __aligned(x)		__attribute__((aligned(x)))
+#define ARG_UNUSED(x)		(void)(x)
+#define MIN(a, b)		((a) < (b) ? (a) : (b))
+#define MAX(a, b)		((a) > (b) ? (a) : (b))
+#define BUILD_ASSERT(c, msg)	_Static_assert(c, msg)
+
+#endif
@@ -0,0 +1,13 @@
+/* Host stand-in for Zephyr logging, errors go to stderr */
+
+#ifndef HOST_ZEPHYR_LOGGING_LOG_H_
+#define HOST_ZEPHYR_LOGGING_LOG_H_
+
+#include <stdio.h>
+
+#define CONFIG_LOG_DEFAULT_LEVEL	3
+#define LOG_MODULE_REGISTER(...)
+#define LOG_ERR(fmt, ...)	fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define LOG_INF(...)		do { } while (0)
+
+#endif
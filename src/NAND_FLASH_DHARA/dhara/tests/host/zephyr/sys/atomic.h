@@ -0,0 +1,30 @@
+/* Host stand-in for Zephyr's atomic API, on the compiler builtins */
+
+#ifndef HOST_ZEPHYR_SYS_ATOMIC_H_
+#define HOST_ZEPHYR_SYS_ATOMIC_H_
+
+#include <stdbool.h>
+
+typedef long atomic_t;
+typedef atomic_t atomic_val_t;
+
+#define ATOMIC_INIT(i)		(i)
+
+static inline atomic_val_t atomic_get(const atomic_t *target)
+{
+	return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_set(atomic_t *target, atomic_val_t value)
+{
+	return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline bool atomic_cas(atomic_t *target, atomic_val_t old_value,
+			      atomic_val_t new_value)
+{
+	return __atomic_compare_exchange_n(target, &old_value, new_value, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#endif
@@ -48,6 +48,9 @@ static void dump_info(struct dhara_journal *j)
 	printf("    capacity   = %d\n", dhara_journal_capacity(j));
 	printf("    bb_current = %d\n", j->bb_current);
 	printf("    bb_last    = %d\n", j->bb_last);
+	printf("    user pages = %d\n", j->stats.user_pages);
+	printf("    meta pages = %d\n", j->stats.meta_pages);
+	printf("    erases     = %d\n", j->stats.erases);
 }
 
 int main(void)
@@ -83,6 +86,15 @@ int main(void)
 	dump_info(&journal);
 	printf("\n");
 
+	/* Only factory-marked bad blocks: every enqueue programs exactly
+	 * one page, and no recovery is needed.
+	 */
+	assert(journal.stats.user_pages == 2000);
+	assert(journal.stats.copied_pages == 0);
+	assert(journal.stats.meta_pages > 0);
+	assert(journal.stats.erases > 0);
+	assert(journal.stats.recoveries == 0);
+
 	printf("Enqueue/dequeue, ~100 pages x20 (resume)\n");
 	for (rep = 0; rep < 20; rep++) {
 		uint8_t *cookie = dhara_journal_cookie(&journal);
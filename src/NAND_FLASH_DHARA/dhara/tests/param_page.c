@@ -0,0 +1,223 @@
+/* Dhara - NAND flash management layer
+ * Copyright (C) 2013 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include "nand_chip_info.h"
+
+/* CRC of the ONFI page built by build_onfi(), from an independent
+ * bitwise implementation of the ONFI definition.
+ */
+#define ONFI_PAGE_CRC		0xDBCA
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	put_le16(p, v);
+	put_le16(p + 2, v >> 16);
+}
+
+static void seal(uint8_t *page)
+{
+	put_le16(page + 254, nand_param_page_crc(page, 254));
+}
+
+/* A 1 Gbit, 2 plane part: 2048 + 128 byte pages, 64 pages per block,
+ * 1024 blocks, 8 bit ECC, tPROG 600 us, tBERS 2 ms, tR 70 us. The
+ * optional commands announce both cache program and cache read.
+ */
+static void build_onfi(uint8_t *page)
+{
+	memset(page, 0, NAND_PARAM_PAGE_SIZE);
+	memcpy(page, "ONFI", 4);
+	put_le16(page + 8, 0x0003);
+	memcpy(page + 44, "MT29F1G01ABAFD      ", 20);
+	put_le32(page + 80, 2048);
+	put_le16(page + 84, 128);
+	put_le32(page + 92, 64);
+	put_le32(page + 96, 1024);
+	page[100] = 1;
+	page[110] = 1;
+	page[112] = 8;
+	put_le16(page + 133, 600);
+	put_le16(page + 135, 2000);
+	put_le16(page + 137, 70);
+	seal(page);
+}
+
+static void test_crc(void)
+{
+	uint8_t page[NAND_PARAM_PAGE_SIZE];
+
+	/* Check value of the ONFI CRC-16 (CRC-16/BUYPASS with the
+	 * ONFI initial value).
+	 */
+	assert(nand_param_page_crc((const uint8_t *)"123456789", 9) == 0x2771);
+	assert(nand_param_page_crc(NULL, 0) == 0x4F4E);
+
+	build_onfi(page);
+	assert(page[254] == (ONFI_PAGE_CRC & 0xff));
+	assert(page[255] == (ONFI_PAGE_CRC >> 8));
+}
+
+static void test_onfi(void)
+{
+	uint8_t page[NAND_PARAM_PAGE_SIZE];
+	struct nand_chip_info info;
+
+	build_onfi(page);
+	memset(&info, 0, sizeof(info));
+
+	assert(!nand_chip_parse_param_page(page, &info));
+	assert(info.log2_page_size == 11);
+	assert(info.log2_ppb == 6);
+	assert(info.num_blocks == 1024);
+	assert(info.oob_size == 128);
+	assert(info.planes == 2);
+	assert(info.ecc_bits == 8);
+	assert(info.t_prog_us == 600);
+	assert(info.t_bers_us == 2000);
+	assert(info.t_r_us == 70);
+	assert(!strcmp(info.name, "MT29F1G01ABAFD"));
+	assert(info.features & NAND_CHIP_PARAM_PAGE);
+	assert(info.features & NAND_CHIP_CACHE_READ);
+
+	/* Cache program comes from the table only */
+	assert(!(info.features & NAND_CHIP_CACHE_PROGRAM));
+}
+
+static void test_planes(void)
+{
+	uint8_t page[NAND_PARAM_PAGE_SIZE];
+	struct nand_chip_info info;
+
+	/* No plane address bit */
+	build_onfi(page);
+	page[110] = 0;
+	seal(page);
+	memset(&info, 0, sizeof(info));
+	assert(!nand_chip_parse_param_page(page, &info));
+	assert(info.planes == 1);
+
+	/* Four planes are driven as two, the upper bits are ignored */
+	build_onfi(page);
+	page[110] = 0xf2;
+	seal(page);
+	memset(&info, 0, sizeof(info));
+	assert(!nand_chip_parse_param_page(page, &info));
+	assert(info.planes == 2);
+
+	/* LUNs multiply the blocks */
+	build_onfi(page);
+	page[100] = 2;
+	seal(page);
+	assert(!nand_chip_parse_param_page(page, &info));
+	assert(info.num_blocks == 2048);
+}
+
+static void test_reject(void)
+{
+	uint8_t page[NAND_PARAM_PAGE_SIZE];
+	struct nand_chip_info info;
+	struct nand_chip_info orig;
+
+	memset(&orig, 0x5a, sizeof(orig));
+
+	/* A flipped bit anywhere in the covered bytes */
+	build_onfi(page);
+	page[80] ^= 0x10;
+	info = orig;
+	assert(nand_chip_parse_param_page(page, &info) < 0);
+	assert(!memcmp(&info, &orig, sizeof(info)));
+
+	/* A flipped bit in the stored CRC */
+	build_onfi(page);
+	page[255] ^= 0x01;
+	assert(nand_chip_parse_param_page(page, &info) < 0);
+
+	/* Unknown signature, with a valid CRC */
+	build_onfi(page);
+	memcpy(page, "ONFX", 4);
+	seal(page);
+	assert(nand_chip_parse_param_page(page, &info) < 0);
+
+	/* Page size not a power of two */
+	build_onfi(page);
+	put_le32(page + 80, 2112);
+	seal(page);
+	assert(nand_chip_parse_param_page(page, &info) < 0);
+
+	/* Page size out of range */
+	build_onfi(page);
+	put_le32(page + 80, 256);
+	seal(page);
+	assert(nand_chip_parse_param_page(page, &info) < 0);
+
+	/* No blocks */
+	build_onfi(page);
+	put_le32(page + 96, 0);
+	seal(page);
+	assert(nand_chip_parse_param_page(page, &info) < 0);
+
+	assert(!memcmp(&info, &orig, sizeof(info)));
+}
+
+static void test_jedec(void)
+{
+	uint8_t page[NAND_PARAM_PAGE_SIZE];
+	struct nand_chip_info info;
+
+	build_onfi(page);
+	memcpy(page, "JESD", 4);
+	page[144] = 4;
+	seal(page);
+
+	memset(&info, 0, sizeof(info));
+	info.planes = 2;
+	info.t_r_us = 120;
+	info.t_prog_us = 700;
+	info.t_bers_us = 10000;
+
+	assert(!nand_chip_parse_param_page(page, &info));
+	assert(info.log2_page_size == 11);
+	assert(info.num_blocks == 1024);
+	assert(info.ecc_bits == 4);
+	assert(info.planes == 2);
+
+	/* Timings and read cache are kept from the table */
+	assert(info.t_r_us == 120);
+	assert(info.t_prog_us == 700);
+	assert(info.t_bers_us == 10000);
+	assert(!(info.features & NAND_CHIP_CACHE_READ));
+}
+
+int main(void)
+{
+	test_crc();
+	test_onfi();
+	test_planes();
+	test_reject();
+	test_jedec();
+
+	printf("param_page: ok\n");
+	return 0;
+}
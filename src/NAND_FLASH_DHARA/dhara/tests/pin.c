@@ -0,0 +1,140 @@
+/* Dhara - NAND flash management layer
+ * Copyright (C) 2013 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "dhara/journal.h"
+#include "dhara/bytes.h"
+#include "sim.h"
+#include "util.h"
+#include "jtutil.h"
+
+#define NUM_OLD		200
+
+/* Dequeue the first count pages and remember where they were */
+static void dequeue_locations(struct dhara_journal *j, dhara_page_t *loc,
+			      int count)
+{
+	int next = 0;
+
+	while (next < count) {
+		uint8_t meta[DHARA_META_SIZE];
+		dhara_page_t tail = dhara_journal_peek(j);
+		dhara_error_t err;
+
+		assert(tail != DHARA_PAGE_NONE);
+		if (dhara_journal_read_meta(j, tail, meta, &err) < 0)
+			dabort("read_meta", err);
+
+		dhara_journal_dequeue(j);
+		if (dhara_r32(meta) == 0xffffffff)
+			continue;
+
+		assert(dhara_r32(meta) == next);
+		loc[next++] = tail;
+	}
+}
+
+/* Count the old pages which still hold their data */
+static int count_intact(const dhara_page_t *loc, int count)
+{
+	const size_t page_size = 1 << sim_nand.log2_page_size;
+	uint8_t buf[page_size];
+	int intact = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		uint8_t expect[page_size];
+		dhara_error_t err;
+
+		seq_gen(i, expect, page_size);
+		if (dhara_nand_read(&sim_nand, loc[i], 0, page_size,
+				    buf, &err) < 0)
+			continue;
+
+		if (!memcmp(buf, expect, page_size))
+			intact++;
+	}
+
+	return intact;
+}
+
+static void test(int pinned)
+{
+	struct dhara_journal journal;
+	const size_t page_size = 1 << sim_nand.log2_page_size;
+	uint8_t page_buf[page_size];
+	dhara_page_t loc[NUM_OLD];
+	int count;
+	int intact;
+
+	sim_reset();
+	sim_inject_bad(10);
+
+	printf("Journal init, pinned: %d\n", pinned);
+	dhara_journal_init(&journal, &sim_nand, page_buf);
+
+	count = jt_enqueue_sequence(&journal, 0, NUM_OLD);
+	assert(count == NUM_OLD);
+
+	if (pinned)
+		dhara_journal_pin(&journal);
+
+	/* The old pages become garbage, as if they were overwritten */
+	dequeue_locations(&journal, loc, NUM_OLD);
+	journal.tail_sync = journal.tail;
+
+	printf("    enqueue until error...\n");
+	count = jt_enqueue_sequence(&journal, NUM_OLD, -1);
+	printf("    enqueue count: %d\n", count);
+
+	intact = count_intact(loc, NUM_OLD);
+	printf("    intact old pages: %d\n", intact);
+
+	if (!pinned) {
+		assert(intact < NUM_OLD);
+		return;
+	}
+
+	assert(intact == NUM_OLD);
+
+	/* Releasing the pin gives the space back */
+	dhara_journal_unpin(&journal);
+	jt_dequeue_sequence(&journal, NUM_OLD, count);
+	journal.tail_sync = journal.tail;
+
+	count = jt_enqueue_sequence(&journal, NUM_OLD + count, -1);
+	printf("    enqueue count after unpin: %d\n", count);
+	assert(count > 0);
+	assert(count_intact(loc, NUM_OLD) < NUM_OLD);
+}
+
+int main(void)
+{
+	for (int i = 0; i < 20; i++) {
+		printf("--------------------------------"
+		       "--------------------------------\n");
+		printf("Seed: %d\n", i);
+		srandom(i);
+		test(0);
+		test(1);
+	}
+
+	return 0;
+}
@@ -0,0 +1,259 @@
+/* Dhara - NAND flash management layer
+ * Copyright (C) 2013 Daniel Beer <dlbeer@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Host test of the recording pipeline. The writer thread runs on a
+ * pthread and writes into memory instead of a recording file. Build it
+ * with CFLAGS=-fsanitize=thread to check the ring under ThreadSanitizer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#include <zephyr/kernel.h>
+#include "recording_pipeline.h"
+
+#define SAMPLE_SIZE		30
+#define FILE_SIZE		(1 << 22)
+
+/* Kernel functions on pthreads */
+
+int k_sem_init(struct k_sem *sem, unsigned int initial, unsigned int limit)
+{
+	(void)limit;
+
+	if (!sem->impl)
+		sem->impl = malloc(sizeof(sem_t));
+	return sem_init(sem->impl, 0, initial);
+}
+
+int k_sem_take(struct k_sem *sem, k_timeout_t timeout)
+{
+	(void)timeout;
+	return sem_wait(sem->impl);
+}
+
+void k_sem_give(struct k_sem *sem)
+{
+	sem_post(sem->impl);
+}
+
+static pthread_t writer;
+static k_thread_entry_t writer_entry;
+
+static void *run_writer(void *arg)
+{
+	(void)arg;
+	writer_entry(NULL, NULL, NULL);
+	return NULL;
+}
+
+k_tid_t k_thread_create(struct k_thread *thread, k_thread_stack_t *stack,
+			size_t stack_size, k_thread_entry_t entry,
+			void *p1, void *p2, void *p3,
+			int prio, uint32_t options, k_timeout_t delay)
+{
+	writer_entry = entry;
+	assert(!pthread_create(&writer, NULL, run_writer, NULL));
+	return thread;
+}
+
+int k_thread_name_set(k_tid_t thread, const char *name)
+{
+	return 0;
+}
+
+int k_thread_join(struct k_thread *thread, k_timeout_t timeout)
+{
+	return pthread_join(writer, NULL);
+}
+
+uint32_t k_cycle_get_32(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t k_cyc_to_us_floor32(uint32_t cycles)
+{
+	return cycles;
+}
+
+/* The recording is a buffer in memory. While stall is set, the first
+ * write waits for the test to release it.
+ */
+
+static uint8_t *file;
+static size_t file_len;
+static sem_t release;
+static int stall;
+
+int nand_recording_open(struct nand_recording *rec, const char *path,
+			FSIZE_t reserve)
+{
+	memset(rec, 0, sizeof(*rec));
+	rec->reserved = reserve;
+	file_len = 0;
+	return 0;
+}
+
+int nand_recording_write(struct nand_recording *rec, const void *data,
+			 size_t len)
+{
+	if (__atomic_exchange_n(&stall, 0, __ATOMIC_SEQ_CST))
+		sem_wait(&release);
+
+	assert(file_len + len <= FILE_SIZE);
+	memcpy(file + file_len, data, len);
+	file_len += len;
+	rec->written += len;
+	return 0;
+}
+
+int nand_recording_close(struct nand_recording *rec)
+{
+	return 0;
+}
+
+static void make_sample(uint8_t *s, uint32_t seq)
+{
+	int i;
+
+	memcpy(s, &seq, 4);
+	for (i = 4; i < SAMPLE_SIZE; i++)
+		s[i] = seq * 7 + i;
+}
+
+/* Every sample in the file is intact, in order and one of the pushed
+ * ones. Returns the number of samples.
+ */
+static uint32_t check_file(uint32_t pushed)
+{
+	uint32_t count = 0;
+	uint32_t last = 0;
+	size_t o;
+
+	assert(file_len % SAMPLE_SIZE == 0);
+	for (o = 0; o < file_len; o += SAMPLE_SIZE) {
+		uint8_t expect[SAMPLE_SIZE];
+		uint32_t seq;
+
+		memcpy(&seq, file + o, 4);
+		assert(seq < pushed);
+		assert(!count || seq > last);
+		make_sample(expect, seq);
+		assert(!memcmp(file + o, expect, SAMPLE_SIZE));
+		last = seq;
+		count++;
+	}
+
+	return count;
+}
+
+static void test_no_loss(void)
+{
+	struct recording_pipeline_stats st;
+	const uint32_t samples = 50000;
+	uint32_t retries = 0;
+	uint32_t seq;
+
+	assert(!recording_pipeline_start("/NAND:/rec.bin", FILE_SIZE));
+	assert(recording_pipeline_start("/NAND:/rec.bin", 1) == -EBUSY);
+
+	/* A full ring is retried, so every sample has to arrive */
+	for (seq = 0; seq < samples; seq++) {
+		uint8_t s[SAMPLE_SIZE];
+
+		make_sample(s, seq);
+		while (recording_pipeline_push(s, sizeof(s)) == -ENOSPC) {
+			retries++;
+			usleep(100);
+		}
+	}
+
+	assert(!recording_pipeline_stop());
+	assert(recording_pipeline_stop() == -EALREADY);
+	assert(recording_pipeline_push("x", 1) == -EAGAIN);
+
+	recording_pipeline_get_stats(&st);
+	assert(check_file(samples) == samples);
+	assert(st.overflows == retries);
+	assert(st.dropped_bytes == retries * SAMPLE_SIZE);
+	assert(st.high_water <= CONFIG_NAND_RECORDING_PIPELINE_RING_SIZE);
+	assert(!st.error);
+
+	/* Whole chunks, and the rest at the stop */
+	assert(st.chunks ==
+	       (samples * SAMPLE_SIZE +
+		CONFIG_NAND_RECORDING_PIPELINE_CHUNK_SIZE - 1) /
+	       CONFIG_NAND_RECORDING_PIPELINE_CHUNK_SIZE);
+}
+
+static void test_overflow(void)
+{
+	struct recording_pipeline_stats st;
+	uint32_t accepted = 0;
+	uint32_t dropped = 0;
+	uint32_t seq;
+
+	__atomic_store_n(&stall, 1, __ATOMIC_SEQ_CST);
+	assert(!recording_pipeline_start("/NAND:/rec.bin", FILE_SIZE));
+
+	/* The writer hangs in its first write, the ring fills up */
+	for (seq = 0; dropped < 100; seq++) {
+		uint8_t s[SAMPLE_SIZE];
+
+		make_sample(s, seq);
+		if (!recording_pipeline_push(s, sizeof(s)))
+			accepted++;
+		else
+			dropped++;
+	}
+
+	sem_post(&release);
+	assert(!recording_pipeline_stop());
+
+	recording_pipeline_get_stats(&st);
+	assert(check_file(seq) == accepted);
+	assert(st.overflows == dropped);
+	assert(st.dropped_bytes == dropped * SAMPLE_SIZE);
+	assert(st.high_water > CONFIG_NAND_RECORDING_PIPELINE_RING_SIZE -
+	       SAMPLE_SIZE);
+	assert(!st.error);
+}
+
+int main(void)
+{
+	int i;
+
+	file = malloc(FILE_SIZE);
+	assert(file);
+	sem_init(&release, 0, 0);
+
+	for (i = 0; i < 3; i++) {
+		test_no_loss();
+		test_overflow();
+	}
+
+	free(file);
+	return 0;
+}
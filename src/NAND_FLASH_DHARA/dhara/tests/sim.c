@@ -75,6 +75,15 @@ static struct sim_stats stats;
 static struct block_status blocks[NUM_BLOCKS];
 static uint8_t pages[MEM_SIZE];
 
+/* Write-behind: a failed dhara_nand_prog_behind() is reported by the
+ * next program or copy. Until its block is erased or marked bad, the
+ * failed page reads back as it was given.
+ */
+static dhara_page_t failed_page;
+static int failed_kept;
+static int failed_pending;
+static uint8_t failed_data[PAGE_SIZE];
+
 void sim_reset(void)
 {
 	int i;
@@ -85,6 +94,25 @@ void sim_reset(void)
 
 	for (i = 0; i < NUM_BLOCKS; i++)
 		blocks[i].next_page = PAGES_PER_BLOCK;
+
+	failed_kept = 0;
+	failed_pending = 0;
+}
+
+static int take_failure(dhara_error_t *err)
+{
+	if (!failed_pending)
+		return 0;
+
+	failed_pending = 0;
+	dhara_set_error(err, DHARA_E_BAD_BLOCK);
+	return -1;
+}
+
+static void forget_failure(dhara_block_t bno)
+{
+	if (failed_kept && (failed_page >> LOG2_PAGES_PER_BLOCK) == bno)
+		failed_kept = 0;
 }
 
 static void timebomb_tick(dhara_block_t blk)
@@ -122,6 +150,7 @@ void dhara_nand_mark_bad(const struct dhara_nand *n, dhara_block_t bno)
 	if (!stats.frozen)
 		stats.mark_bad++;
 	blocks[bno].flags |= BLOCK_BAD_MARK;
+	forget_failure(bno);
 }
 
 int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t bno,
@@ -144,6 +173,7 @@ int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t bno,
 	if (!stats.frozen)
 		stats.erase++;
 	blocks[bno].next_page = 0;
+	forget_failure(bno);
 
 	timebomb_tick(bno);
 
@@ -159,8 +189,8 @@ int dhara_nand_erase(const struct dhara_nand *n, dhara_block_t bno,
 	return 0;
 }
 
-int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p,
-		    const uint8_t *data, dhara_error_t *err)
+static int prog_page(dhara_page_t p, const uint8_t *data,
+		     dhara_error_t *err)
 {
 	const int bno = p >> LOG2_PAGES_PER_BLOCK;
 	const int pno = p & ((1 << LOG2_PAGES_PER_BLOCK) - 1);
@@ -204,6 +234,35 @@ int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p,
 	return 0;
 }
 
+int dhara_nand_prog(const struct dhara_nand *n, dhara_page_t p,
+		    const uint8_t *data, dhara_error_t *err)
+{
+	if (take_failure(err) < 0)
+		return -1;
+
+	return prog_page(p, data, err);
+}
+
+int dhara_nand_prog_behind(const struct dhara_nand *n, dhara_page_t p,
+			   const uint8_t *data, dhara_error_t *err)
+{
+	if (take_failure(err) < 0)
+		return -1;
+
+	/* Only one failed page is kept, the others program directly */
+	if (failed_kept)
+		return prog_page(p, data, err);
+
+	if (prog_page(p, data, err) < 0) {
+		failed_page = p;
+		failed_kept = 1;
+		failed_pending = 1;
+		memcpy(failed_data, data, PAGE_SIZE);
+	}
+
+	return 0;
+}
+
 int dhara_nand_is_free(const struct dhara_nand *n, dhara_page_t p)
 {
 	const int bno = p >> LOG2_PAGES_PER_BLOCK;
@@ -246,6 +305,9 @@ int dhara_nand_read(const struct dhara_nand *n, dhara_page_t p,
 		stats.read_bytes += length;
 	}
 
+	if (failed_kept && p == failed_page)
+		page = failed_data;
+
 	memcpy(data, page + offset, length);
 	return 0;
 }
@@ -256,6 +318,9 @@ int dhara_nand_copy(const struct dhara_nand *n,
 {
 	uint8_t buf[PAGE_SIZE];
 
+	if (take_failure(err) < 0)
+		return -1;
+
 	if ((dhara_nand_read(n, src, 0, PAGE_SIZE, buf, err) < 0) ||
 	    (dhara_nand_prog(n, dst, buf, err) < 0))
 		return -1;
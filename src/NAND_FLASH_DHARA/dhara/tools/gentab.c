@@ -16,12 +16,16 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-static uint32_t table[256];
+#define MAX_SLICES	16
 
-static void fill_table(uint32_t poly)
+static uint32_t table[MAX_SLICES][256];
+
+static void fill_table(uint32_t poly, int slices)
 {
 	int i;
+	int k;
 
 	for (i = 0; i < 256; i++) {
 		uint32_t r = i;
@@ -30,16 +34,24 @@ static void fill_table(uint32_t poly)
 		for (j = 0; j < 8; j++)
 			r = (r >> 1) ^ ((r & 1) ? poly : 0);
 
-		table[i] = r;
+		table[0][i] = r;
 	}
+
+	/* Table k gives the remainder of a byte followed by k zero
+	 * bytes, as used by the slice-by-N loops.
+	 */
+	for (k = 1; k < slices; k++)
+		for (i = 0; i < 256; i++)
+			table[k][i] = (table[k - 1][i] >> 8) ^
+				table[0][table[k - 1][i] & 0xff];
 }
 
-static void print_table(void)
+static void print_table(int k)
 {
 	int i;
 
 	for (i = 0; i < 256; i++)
-		printf("0x%08x,%c", table[i], ((i & 3) == 3) ? '\n' : ' ');
+		printf("0x%08x,%c", table[k][i], ((i & 3) == 3) ? '\n' : ' ');
 }
 
 static int parse_poly(const char *text, uint32_t *out)
@@ -73,16 +85,33 @@ static int parse_poly(const char *text, uint32_t *out)
 int main(int argc, char **argv)
 {
 	uint32_t p;
+	int slices = 1;
+	int k;
 
 	if (argc < 2) {
-		fprintf(stderr, "usage: %s <polynomial>\n", argv[0]);
+		fprintf(stderr, "usage: %s <polynomial> [slices]\n", argv[0]);
 		return -1;
 	}
 
 	if (parse_poly(argv[1], &p) < 0)
 		return -1;
 
-	fill_table(p);
-	print_table();
+	if (argc >= 3) {
+		slices = atoi(argv[2]);
+		if ((slices < 1) || (slices > MAX_SLICES)) {
+			fprintf(stderr, "slices must be between 1 and %d\n",
+				MAX_SLICES);
+			return -1;
+		}
+	}
+
+	fill_table(p, slices);
+
+	for (k = 0; k < slices; k++) {
+		if (slices > 1)
+			printf("/* %d */\n", k);
+		print_table(k);
+	}
+
 	return 0;
 }
@@ -23,6 +23,11 @@ extern "C" {
 
 extern struct disk_info nand_disk;
 
+#ifdef CONFIG_NAND_SNAPSHOT
+//read-only view of nand_disk at the time of the last snapshot, exported over USB
+extern struct disk_info nand_snapshot_disk;
+#endif
+
 /**
  * Initializes the disk for NAND flash.
  *
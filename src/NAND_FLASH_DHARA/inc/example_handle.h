@@ -24,6 +24,25 @@ int init_nand_handle(void);
  */
 int my_transceive_function(nand_transaction_t *transaction);
 
+/**
+ * @brief Executes a sequence of SPI NAND transactions with the bus locked.
+ *
+ * The SPI controller is configured and acquired once for the whole sequence.
+ *
+ * @param transactions Array of the transactions, sent in order.
+ * @param count Number of transactions.
+ * @return 0 if successful, or the error of the first transaction that failed.
+ */
+int my_transceive_batch_function(nand_transaction_t *transactions, size_t count);
+
+/**
+ * @brief Changes the SPI clock of all NAND chips.
+ *
+ * @param hz SPI clock in Hz, used from the next transaction on.
+ * @return 0 if successful.
+ */
+int my_set_frequency_function(uint32_t hz);
+
 // Example log function
 void my_log_function(char *msg, bool is_err, bool has_int_arg, uint32_t arg);
 
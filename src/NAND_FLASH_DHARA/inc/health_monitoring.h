@@ -18,5 +18,6 @@ uint32_t read_bad_block_count(void);
 uint32_t read_erase_count(void);
 uint32_t read_program_erase_cycles(void);
 uint32_t read_ecc_errors(void);
+uint32_t read_write_amplification(void);
 
 int display_health(void);
\ No newline at end of file
@@ -0,0 +1,79 @@
+/**
+ * @file nand_chip_info.h
+ * @brief Geometry, timing and features of the detected NAND chip
+ *
+ * The chip is identified by its manufacturer and device ID. Its data comes from the
+ * ONFI or JEDEC parameter page when the chip has one, otherwise from the table of
+ * supported parts in nand_chip_info.c.
+ */
+
+#ifndef NAND_CHIP_INFO_H
+#define NAND_CHIP_INFO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//feature flags of struct nand_chip_info
+#define NAND_CHIP_QUAD          (1 << 0) //x4 program load and read commands
+#define NAND_CHIP_CACHE_READ    (1 << 1) //CMD_READ_CACHE_SEQ / CMD_READ_CACHE_END
+#define NAND_CHIP_CACHE_PROGRAM (1 << 2) //program load accepted while the previous page programs, table only
+#define NAND_CHIP_ON_DIE_ECC    (1 << 3) //ECC_EN in REG_CONFIG, result in STAT_ECC0/STAT_ECC1
+#define NAND_CHIP_PARAM_PAGE    (1 << 4) //read from the parameter page, not the table
+#define NAND_CHIP_DUAL_PLANE_PROGRAM (1 << 5) //one program execute programs the caches of both planes, table only
+#define NAND_CHIP_ERASE_SUSPEND (1 << 6) //CONFIG_NAND_ERASE_SUSPEND_OPCODE and _RESUME_OPCODE, table only
+
+#define NAND_PARAM_PAGE_SIZE    256
+#define NAND_PARAM_PAGE_COPIES  3
+
+struct nand_chip_info {
+    char name[21];              //model from the parameter page or the table
+    uint8_t manufacturer_id;
+    uint16_t device_id;
+    uint8_t log2_page_size;
+    uint8_t log2_ppb;
+    uint32_t num_blocks;        //of one chip
+    uint16_t oob_size;          //spare bytes per page
+    uint8_t planes;             //2: odd blocks are on plane 1, selected by a column address bit
+    uint8_t ecc_bits;           //bits the on-die ECC corrects per codeword, 0 without
+    uint16_t t_r_us;            //max time of a page read to the cache
+    uint16_t t_prog_us;         //max time of a program execute
+    uint16_t t_bers_us;         //max time of a block erase
+    uint8_t features;           //NAND_CHIP_* flags
+};
+
+/**
+ * @brief Identify the selected chip (my_nand_handle->active_flash).
+ *
+ * Reads the manufacturer and device ID, then the parameter page. Parts in the table
+ * without a valid parameter page keep the table data.
+ *
+ * @param[out] info Data of the chip.
+ * @return 0 on success, -1 if the ID read failed or the chip is unknown.
+ */
+int nand_chip_identify(struct nand_chip_info *info);
+
+/**
+ * @brief Take geometry, timing and features from one copy of a parameter page.
+ *
+ * @param page NAND_PARAM_PAGE_SIZE bytes.
+ * @param[in,out] info Updated only if the page is valid.
+ * @return 0 on success, -1 if the signature, checksum or geometry is invalid.
+ */
+int nand_chip_parse_param_page(const uint8_t *page, struct nand_chip_info *info);
+
+/**
+ * @brief CRC-16 of a parameter page, polynomial 0x8005, initial value 0x4F4E.
+ *
+ * Covers bytes 0 to 253, the result is stored little endian in bytes 254 and 255.
+ */
+uint16_t nand_param_page_crc(const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //NAND_CHIP_INFO_H
@@ -0,0 +1,65 @@
+/**
+ * @file nand_clock.h
+ * @brief Calibration of the SPI clock of the NAND chips
+ *
+ * At boot the clock is stepped up through a table of frequencies. At every step each
+ * chip has to return its manufacturer ID and test patterns loaded into its cache.
+ * The clock settles CONFIG_NAND_CLOCK_MARGIN_STEPS below the highest step that passed.
+ * ECC errors and page checksum mismatches are reported here, after
+ * CONFIG_NAND_CLOCK_ANOMALY_LIMIT of them the calibration runs again.
+ */
+
+#ifndef NAND_CLOCK_H
+#define NAND_CLOCK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct nand_flash_device_t;
+
+#ifdef CONFIG_NAND_CLOCK_CALIBRATION
+
+/**
+ * @brief Find the highest reliable SPI clock and switch to it.
+ *
+ * Overwrites the cache of every chip. Runs on all chips of my_nand_handle,
+ * after they were identified.
+ *
+ * @param dev Device with the detected chip.
+ * @return 0 on success, or -1 if no step passed, the clock is left at the slowest step.
+ */
+int nand_clock_calibrate(struct nand_flash_device_t *dev);
+
+/**
+ * @brief Count an ECC error or checksum mismatch, which may come from a too fast clock.
+ */
+void nand_clock_report_anomaly(void);
+
+/**
+ * @brief Calibrate again if enough anomalies were reported, the caller holds the NAND mutex.
+ *
+ * @param dev Device with the detected chip.
+ */
+void nand_clock_service(struct nand_flash_device_t *dev);
+
+/**
+ * @brief SPI clock set by the last calibration, 0 before.
+ */
+uint32_t nand_clock_get_hz(void);
+
+#define NAND_CLOCK_ANOMALY() nand_clock_report_anomaly()
+
+#else
+
+#define NAND_CLOCK_ANOMALY() ((void)0)
+
+#endif // CONFIG_NAND_CLOCK_CALIBRATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NAND_CLOCK_H
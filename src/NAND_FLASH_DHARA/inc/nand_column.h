@@ -0,0 +1,50 @@
+/**
+ * @file nand_column.h
+ * @brief Column addressing of the cache commands, with the plane select bit of 2-plane chips
+ *
+ * Kept free of Zephyr so the address math runs in the host tests (dhara/tests/column.c),
+ * the driver adds the chip of my_nand_handle and the plane of the last routed page.
+ */
+
+#ifndef NAND_COLUMN_H
+#define NAND_COLUMN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Column address of a cache command as it is sent on the bus.
+ *
+ * The plane select bit is the bit above the spare area, bit log2_page_size + 1. The two
+ * address bytes are swapped for the transceive functions, which send the low byte first.
+ *
+ * @param column Byte in the cache of the plane.
+ * @param plane 0 or 1.
+ * @param log2_page_size Data bytes per page of the chip, log2.
+ */
+uint32_t nand_column_address(uint16_t column, uint8_t plane, uint8_t log2_page_size);
+
+/**
+ * @brief Where a column of a plane pair page lies on the chip.
+ *
+ * A plane pair page holds the data of plane 0, then the data of plane 1, then the
+ * spare area of plane 0 and the one of plane 1.
+ *
+ * @param column Byte in the pair page.
+ * @param log2_page_size Data bytes per page of the chip, log2.
+ * @param oob_size Spare bytes per page of the chip.
+ * @param[out] chip_column Byte in the cache of the plane.
+ * @param[out] plane Plane of the column.
+ * @return number of bytes from column to the end of its piece, UINT16_MAX for the last piece.
+ */
+uint32_t nand_pair_column(uint32_t column, uint8_t log2_page_size, uint16_t oob_size,
+                          uint16_t *chip_column, uint8_t *plane);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //NAND_COLUMN_H
@@ -31,7 +31,7 @@ extern "C" {
 typedef struct {
     uint8_t command;          /**< Command byte to send */
     uint8_t address_bytes;    /**< Number of address bytes */
-    uint32_t address;         /**< Address for the transaction */
+    uint32_t address;         /**< Address for the transaction, in bus order: the least significant byte is sent first */
     uint32_t mosi_len;        /**< Length of the data to send */
     const uint8_t *mosi_data; /**< Pointer to the data to send */
     uint32_t miso_len;        /**< Length of the data to receive */
@@ -62,6 +62,18 @@ typedef struct nand_h {
 
   // === Interface function pointers. Optional. ===
 
+  /**
+   * @brief Function pointer for a sequence of NAND transactions to the chip active_flash.
+   * Each transaction is a command of its own, the chip select is released in between.
+   * Lets the bus stay locked for the whole sequence, e.g. write enable, program load
+   * and program execute. If not set, the driver calls transceive for each transaction.
+   *
+   * @param transactions Array of the transactions, sent in order.
+   * @param count Number of transactions.
+   * @return 0 if all were successful, or the error of the first that failed, the rest is not sent.
+   */
+  int (*transceive_batch)(nand_transaction_t *transactions, size_t count);
+
   /**
    * @brief Pointer to logging function.
    * Called by the driver to log status and error messages, with an optional integer
@@ -77,11 +89,31 @@ typedef struct nand_h {
    */
   void (*log)(char *msg, bool is_err, bool has_int_arg, uint32_t arg);
 
+  /**
+   * @brief Function pointer to change the SPI clock of all chips.
+   * Used by the clock calibration (CONFIG_NAND_CLOCK_CALIBRATION), the next
+   * transaction has to run at the new clock.
+   *
+   * @param hz SPI clock in Hz.
+   * @return 0 if successful, or a negative error code if the clock is not supported.
+   */
+  int (*set_frequency)(uint32_t hz);
+
+
+  /**
+   * @brief Number of NAND chips on the bus, striped into one dhara_nand.
+   * 0 or 1 means a single chip. With a power of two the pages of every block
+   * alternate between the chips: page p lives on chip p % number_of_flashes.
+   * Other counts interleave whole blocks: block b lives on chip b % number_of_flashes.
+   */
+  int number_of_flashes;
 
   /**
-   * @brief integer representing the flashes that are in parallel
+   * @brief Chip the next transaction is meant for.
+   * Set by the driver before every transaction, the transceive function routes
+   * the transaction to the chip select of this chip.
    */
-  int number_of_flashes = 1;
+  uint8_t active_flash;
   //uint8_t internal_regs[0x76]; //!< For internal use.???
 } nand_h;
 
@@ -97,17 +129,26 @@ extern nand_h *my_nand_handle;
 #define CMD_PROGRAM_LOAD    0x02
 #define CMD_PROGRAM_LOAD_X4 0x32
 #define CMD_PROGRAM_EXECUTE 0x10
-#define CMD_PROGRAM_LOAD_RAND 0x84
+#define CMD_PROGRAM_LOAD_RAND 0x84 //keeps the rest of the cache, also used for the second piece of a plane pair load
 #define CMD_PROGRAM_LOAD_RAND_X4 0xC4
 #define CMD_PAGE_READ       0x13
 #define CMD_READ_FAST       0x0B
 #define CMD_READ_X2         0x3B
 #define CMD_READ_X4         0x6B
+#define CMD_READ_CACHE_SEQ  0x31 //next page to the cache, the one after it is loaded meanwhile
+#define CMD_READ_CACHE_END  0x3F //last page of a sequence to the cache
 #define CMD_READ_ID         0x9F
 
 #define CMD_SET_REGISTER    0x1F //commands are used to monitor the device status and alter the device behavior, check this!! TODO
 #define CMD_READ_REGISTER   0x0F//The content of status register can be read by issuing the GET FEATURE (0FH) command, followed by the status register address C0H.
 #define CMD_Reset           0xFF
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+#if !defined(CONFIG_NAND_ERASE_SUSPEND_OPCODE) || !defined(CONFIG_NAND_ERASE_RESUME_OPCODE)
+#error "Set CONFIG_NAND_ERASE_SUSPEND_OPCODE and CONFIG_NAND_ERASE_RESUME_OPCODE from the datasheet"
+#endif
+#define CMD_ERASE_SUSPEND   CONFIG_NAND_ERASE_SUSPEND_OPCODE //not in every chip, opcodes differ between manufacturers
+#define CMD_ERASE_RESUME    CONFIG_NAND_ERASE_RESUME_OPCODE
+#endif
 
 #define DEVICE_ADDR_READ    0x01
 #define MANUFACTURER_ADDR_READ  0x00
@@ -126,6 +167,11 @@ extern nand_h *my_nand_handle;
 #define STAT_ECC0           (1 << 4)
 #define STAT_ECC1           (1 << 5)
 
+#define CFG_ECC_ENABLE      (1 << 4) //on-die ECC enable bit in REG_CONFIG
+#define CFG_OTP_ENABLE      (1 << 6) //OTP area, holds the parameter page, instead of the array
+
+#define PARAMETER_PAGE      0x01     //page of the parameter page in the OTP area
+
 // Commands, registers, and status flags definitions
 
 
@@ -200,6 +246,19 @@ int nand_program_execute(uint32_t page);
  */
 int nand_program_load(const uint8_t *data, uint16_t column, uint16_t length);
 
+/**
+ * @brief Load data into the NAND cache without clearing the rest of it.
+ *
+ * Unlike nand_program_load(), bytes outside the given range keep whatever the
+ * cache held before, e.g. a page fetched by nand_read_page().
+ *
+ * @param data Pointer to the data to be loaded.
+ * @param column Start column (byte) in the page from where to start writing.
+ * @param length Number of bytes to write.
+ * @return 0 on success, negative error code otherwise.
+ */
+int nand_program_load_random(const uint8_t *data, uint16_t column, uint16_t length);
+
 /**
  * @brief Erase a block on the NAND device.
  *
@@ -208,6 +267,141 @@ int nand_program_load(const uint8_t *data, uint16_t column, uint16_t length);
  */
 int nand_erase_block(uint32_t page);
 
+/**
+ * @brief Write enable and erase a block, as one batch of transactions.
+ *
+ * @param page Page number within the block to be erased.
+ * @return 0 on success, negative error code otherwise.
+ */
+int nand_enable_and_erase_block(uint32_t page);
+
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+/**
+ * @brief Suspend the running erase, the chip is busy until the suspend took effect.
+ *
+ * Page reads and cache reads are allowed while the erase is suspended.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int nand_erase_suspend(void);
+
+/**
+ * @brief Continue a suspended erase, the chip is busy again until the erase ends.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int nand_erase_resume(void);
+#endif
+
+/**
+ * @brief Write enable, program load and program execute of a page, as one batch of transactions.
+ *
+ * The load resets the rest of the cache to 0xFF, as nand_program_load(). Does not
+ * wait for the program to finish.
+ *
+ * @param page Page number to program.
+ * @param data Pointer to the data to be loaded.
+ * @param column Start column (byte) of the data in the page.
+ * @param length Number of bytes to load.
+ * @return 0 on success, negative error code otherwise.
+ */
+int nand_enable_and_program_page(uint32_t page, const uint8_t *data, uint16_t column, uint16_t length);
+
+
+/**
+ * @brief Select the chip holding the given page for the following transactions.
+ *
+ * Transactions without a page address (write enable, register access, cache
+ * reads and loads) go to the selected chip, so call this before starting a
+ * sequence on a page. The page based functions select the chip themselves.
+ *
+ * @param page Page number as seen by dhara (striped over all chips).
+ */
+void nand_select_flash(uint32_t page);
+
+/**
+ * @brief Number of chips the pages of one dhara block alternate between.
+ *
+ * number_of_flashes if it is a power of two, the page, erase and bad block operations
+ * on a block then go to each of these chips. 1 with a single chip or when whole blocks
+ * are interleaved.
+ */
+int nand_stripe_width(void);
+
+/**
+ * @brief Check whether two pages lie on the same chip.
+ *
+ * A chip busy with one of them does not delay an operation on the other one if not.
+ *
+ * @return 1 if both pages are on one chip, 0 otherwise.
+ */
+int nand_same_flash(uint32_t a, uint32_t b);
+
+/**
+ * @brief Check whether a page can be copied inside the chip.
+ *
+ * Internal copies (page read followed by program execute) only work within a chip,
+ * and on a 2-plane chip within a plane.
+ *
+ * @return 1 if src can be copied to dst without crossing the SPI bus, 0 otherwise.
+ */
+int nand_copy_back_possible(uint32_t src, uint32_t dst);
+
+#ifdef CONFIG_NAND_PLANE_PAIRS
+/**
+ * @brief ECC result of a whole plane pair page.
+ *
+ * A plane pair page is read with one page read per plane. Combines the ECC bits of
+ * the plane 0 read with the status of the plane 1 read, the worse one wins.
+ *
+ * @param status Status register after the wait for nand_read_page().
+ * @return status with the ECC bits of both planes, unchanged without plane pairs.
+ */
+uint8_t nand_pair_status(uint8_t status);
+#endif
+
+
+#ifdef CONFIG_NAND_CACHE_READ
+/**
+ * @brief Called for every page of nand_read_pages_seq() while the page is in the cache.
+ *
+ * @param page Page number as passed to nand_read_pages_seq().
+ * @param status Status register after the page reached the cache, holds its ECC bits.
+ * @param arg Argument of nand_read_pages_seq().
+ * @return 0 to continue, anything else stops the sequence and is returned.
+ */
+typedef int (*nand_page_cb_t)(uint32_t page, uint8_t status, void *arg);
+
+/**
+ * @brief Read consecutive pages of one block into the cache, one after the other.
+ *
+ * On chips with the cache read sequence (NAND_CHIP_CACHE_READ) the next page
+ * is loaded from the array while the callback clocks the current one out of the
+ * cache, which hides the page read time. Otherwise every page is read with
+ * CMD_PAGE_READ and a busy wait.
+ *
+ * @param first First page number as seen by dhara (striped over all chips).
+ * @param count Number of pages, they must not cross a block boundary.
+ * @param cb Reads the page out of the cache with nand_read().
+ * @param arg Passed to cb.
+ * @return 0 on success, the result of cb if it stopped, or a negative error code.
+ */
+int nand_read_pages_seq(uint32_t first, uint32_t count, nand_page_cb_t cb, void *arg);
+#endif
+
+/**
+ * @brief Read the parameter page of the selected chip.
+ *
+ * Switches to the OTP area with the on-die ECC off, loads PARAMETER_PAGE and
+ * restores the configuration register afterwards. The page is not routed like
+ * the dhara pages: it goes to my_nand_handle->active_flash, so it can be used
+ * before the geometry is known.
+ *
+ * @param[out] data Receives the page, ONFI and JEDEC store three 256 byte copies.
+ * @param length Number of bytes to read from column 0.
+ * @return 0 on success, negative error code otherwise.
+ */
+int nand_read_parameter_page(uint8_t *data, uint16_t length);
 
 /**
  * @brief Read out device ID
@@ -216,6 +410,14 @@ int nand_erase_block(uint32_t page);
 */
 int nand_device_id(uint8_t *device_id);
 
+/**
+ * @brief Read out the manufacturer ID
+ *
+ * @param[out] manufacturer_id Manufacturer ID
+ * @return 0 on success, negative error code otherwise.
+ */
+int nand_manufacturer_id(uint8_t *manufacturer_id);
+
 
 
 
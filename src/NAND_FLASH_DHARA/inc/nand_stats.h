@@ -0,0 +1,85 @@
+/**
+ * @file nand_stats.h
+ * @brief Latency histograms and operation counters of the NAND stack
+ *
+ * Every histogram keeps log2 buckets, bucket k counts the samples in [2^k, 2^(k+1)).
+ * Latencies are measured in hardware cycles (k_cycle_get_32), the other histograms
+ * count iterations or tree levels. Everything compiles away without CONFIG_NAND_STATS.
+ *
+ * The counters are updated without locking, all writers run under the NAND mutex
+ * of the top layer.
+ */
+
+#ifndef NAND_STATS_H
+#define NAND_STATS_H
+
+#include <stdint.h>
+
+#define NAND_STATS_BUCKETS 24 //samples above 2^24 land in the last bucket
+
+enum nand_stats_id {
+    NAND_STATS_PAGE_READ,       //page read to cache incl. busy wait, cycles
+    NAND_STATS_PROGRAM,         //program execute incl. busy wait, cycles
+    NAND_STATS_ERASE,           //block erase incl. busy wait, cycles
+    NAND_STATS_WAIT_SPINS,      //status register polls per busy wait
+    NAND_STATS_TRACE_DEPTH,     //metadata reads per radix tree walk (trace_path)
+    NAND_STATS_META_READ,       //dhara_journal_read_meta, cycles
+    NAND_STATS_GC_COPY,         //page copied by the garbage collector, cycles
+    NAND_STATS_SYNC_PAD,        //filler page written to reach a checkpoint, cycles
+    NAND_STATS_ID_COUNT
+};
+
+struct nand_stats_hist {
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t buckets[NAND_STATS_BUCKETS];
+};
+
+#ifdef CONFIG_NAND_STATS
+
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Add one sample to a histogram.
+ */
+void nand_stats_record(enum nand_stats_id id, uint32_t value);
+
+/**
+ * @brief Add one SPI transaction to the histogram of its command.
+ *
+ * @param command Opcode of the transaction.
+ * @param cycles Duration of the transaction.
+ * @param bytes Data bytes moved in either direction.
+ * @param result Return value of the transceive function, non-zero counts as error.
+ */
+void nand_stats_record_transceive(uint8_t command, uint32_t cycles, uint32_t bytes, int result);
+
+/**
+ * @brief Get a histogram for evaluation in a test.
+ */
+const struct nand_stats_hist *nand_stats_get(enum nand_stats_id id);
+
+/**
+ * @brief Clear all histograms and counters.
+ */
+void nand_stats_reset(void);
+
+/**
+ * @brief Log all non-empty histograms.
+ */
+void nand_stats_dump(void);
+
+#define NAND_STATS_START(start) uint32_t start = k_cycle_get_32()
+#define NAND_STATS_STOP(id, start) nand_stats_record((id), k_cycle_get_32() - (start))
+#define NAND_STATS_RECORD(id, value) nand_stats_record((id), (value))
+
+#else
+
+#define NAND_STATS_START(start)
+#define NAND_STATS_STOP(id, start) ((void)0)
+#define NAND_STATS_RECORD(id, value) ((void)sizeof(value)) //keeps counters that only feed the stats warning free
+
+#endif //CONFIG_NAND_STATS
+
+#endif //NAND_STATS_H
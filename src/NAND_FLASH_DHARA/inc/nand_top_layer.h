@@ -12,6 +12,7 @@
 
 #include <stdint.h>
 #include "../dhara/dhara/map.h"
+#include "nand_chip_info.h"
 
 #include <zephyr/kernel.h>
 
@@ -25,6 +26,29 @@ extern "C" {
 #define ROM_WAIT_THRESHOLD_US 1000
 
 
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+/**
+ * @brief When a sync requested by the file system reaches the flash.
+ *
+ * Every sync that lands inside a checkpoint group pads the group with filler pages.
+ * Deferring syncs saves these programs, at the price of losing the writes since the
+ * last sync if the power fails. dhara commits every full checkpoint group by itself,
+ * so a deferred sync often finds nothing left to do.
+ */
+enum nand_sync_policy {
+    NAND_SYNC_IMMEDIATE,    //every request syncs, no data is lost after f_sync
+    NAND_SYNC_BOUNDED,      //max_delay_ms after the first unsynced write, requests are not needed
+    NAND_SYNC_POWER_SIGNAL, //only on nand_flash_set_power_low() or after max_dirty_pages
+};
+
+struct nand_sync_config {
+    enum nand_sync_policy policy;
+    uint32_t max_delay_ms;      //NAND_SYNC_BOUNDED only
+    uint32_t max_dirty_pages;   //sync when this many pages are unsynced, 0 for no limit
+};
+#endif
+
+
 
 typedef struct nand_flash_device_t{
     uint8_t gc_factor;
@@ -35,6 +59,58 @@ typedef struct nand_flash_device_t{
     struct dhara_nand dhara_nand;
     uint8_t *work_buffer;
     struct k_sem mutex;  // Zephyr semaphore
+    struct nand_chip_info chip; // geometry, timings and features of the detected chip
+#ifdef CONFIG_NAND_PLANE_PAIRS
+    bool plane_pairs;           // a dhara block is the block pair of both planes, its pages twice the chip's
+#endif
+#ifdef CONFIG_NAND_HOT_COLD
+    struct dhara_map hot_map;   // sectors below hot_sectors, the FAT and root directory
+    struct dhara_nand hot_nand; // region of the last CONFIG_NAND_HOT_BLOCKS blocks
+    uint8_t *hot_work_buffer;
+    uint32_t hot_sectors;
+#endif
+#ifdef CONFIG_NAND_SNAPSHOT
+    struct dhara_map_snapshot snapshot;
+#ifdef CONFIG_NAND_HOT_COLD
+    struct dhara_map_snapshot hot_snapshot;
+#endif
+    bool snapshot_valid;
+    uint32_t snapshot_id;       // counts the snapshots taken, data read from an older one is stale
+#endif
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    uint32_t sector_size;       // CONFIG_NAND_SECTOR_SIZE, the dhara sectors stay whole pages
+    uint8_t *combine_buffer;    // page collecting sector writes
+    uint32_t combine_page;      // page in combine_buffer, UINT32_MAX if empty
+    uint32_t combine_mask;      // bit i set if sector i of combine_buffer holds new data
+    uint8_t *merge_buffer;      // last page read from the map
+    uint32_t merge_page;        // page in merge_buffer, UINT32_MAX if none
+#endif
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+    struct nand_sync_config sync_config;
+    struct k_work_delayable sync_work; // deadline of NAND_SYNC_BOUNDED
+    uint32_t dirty_pages;       // pages written since the maps were last clean
+    bool power_low;
+#endif
+#ifdef CONFIG_NAND_ERASE_AHEAD
+    struct k_work_delayable erase_ahead_work; // erases the next journal block once the writes pause
+#endif
+#ifdef CONFIG_NAND_SCRUB
+    struct k_work_delayable scrub_work; // relocates the sectors of scrub_queue
+    uint32_t scrub_queue[CONFIG_NAND_SCRUB_QUEUE_SIZE]; // map sectors whose read failed the ECC check, oldest first
+    dhara_page_t scrub_pages[CONFIG_NAND_SCRUB_QUEUE_SIZE]; // page of each queued sector when its read failed
+    uint8_t scrub_attempts[CONFIG_NAND_SCRUB_QUEUE_SIZE];
+    uint32_t scrub_count;
+    atomic_t scrub_urgent;      // scrub_count reached CONFIG_NAND_SCRUB_URGENT, set under the mutex
+    uint8_t *scrub_buffer;
+#endif
+#ifdef CONFIG_NAND_READ_PRIORITY
+    atomic_t readers_waiting;   // reads waiting for the mutex
+    struct k_sem write_gate;    // passed by everything but reads before the mutex
+#endif
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+    bool background_erase;      // the running erase comes from the erase ahead work
+    bool erase_suspended;       // reads are served while the background erase is suspended
+#endif
 }nand_flash_device_t;
 
 
@@ -61,6 +137,49 @@ extern nand_flash_device_t *device_handle;
  */
 int wait_for_ready(uint8_t *status_out);
 
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+/** @brief Wait for a background erase, suspending it for the reads that arrive meanwhile.
+ *
+ * Called by the erase in nand.c while the erase ahead work holds the mutex and the write gate.
+ * The mutex is passed to the waiting reads while the erase is suspended.
+ *
+ * @param dev The device, background_erase set and the chip flagged NAND_CHIP_ERASE_SUSPEND.
+ * @param page First page of the block being erased.
+ * @param[out] status_out status register content after the erase
+ * @return 0 on success, -1 if a status read, suspend or resume failed.
+ */
+int wait_for_erase_serving_reads(nand_flash_device_t *dev, uint32_t page, uint8_t *status_out);
+#endif
+
+#ifdef CONFIG_NAND_SOFT_ECC
+/** @brief Check that the software ECC codes of a page fit the spare area of the chip.
+ *
+ * Defined in nand.c. The codes must end within the spare area and keep clear of the
+ * markers, the page CRC and the health counters.
+ *
+ * @param dev The device, page_size and chip set.
+ * @return 0 if the layout fits, -1 with an error logged otherwise.
+ */
+int nand_soft_ecc_check_layout(const nand_flash_device_t *dev);
+#endif
+
+#ifdef CONFIG_NAND_WRITE_BEHIND
+/** @brief Wait for the page programming behind the last write.
+ *
+ * Defined in nand.c. Called before commands that bypass dhara, the chip is then
+ * idle. A failed page is still reported to dhara by its next program. The caller
+ * holds the device mutex, see nand_flash_lock_chips().
+ */
+void nand_write_behind_finish(void);
+
+/** @brief Wait for the page programming behind the last write and drop a failed page.
+ *
+ * Defined in nand.c. For an erase of the whole chip or a device shutdown, dhara starts
+ * over with a new map.
+ */
+void nand_write_behind_reset(void);
+#endif
+
 
 
 
@@ -76,32 +195,132 @@ int wait_for_ready(uint8_t *status_out);
 int nand_flash_init_device(nand_flash_device_t **handle);
 
 /** @brief Read a sector from the nand flash.
+ *
+ * A sector is one page, or CONFIG_NAND_SECTOR_SIZE bytes with CONFIG_NAND_SUBPAGE_SECTORS.
  *
  * @param handle The handle to the nand flash chip.
  * @param[out] buffer The output buffer to put the read data into.
  * @param sector_id The id of the sector to read.
  * @return 0 on success, or -1 if the read failed.
  */
-int nand_flash_read_sector(nand_flash_device_t *handle, uint8_t *buffer, uint16_t sector_id);
+int nand_flash_read_sector(nand_flash_device_t *handle, uint8_t *buffer, uint32_t sector_id);
 
 /** @brief Write a sector to the nand flash.
+ *
+ * With CONFIG_NAND_SUBPAGE_SECTORS the sector may stay in the page buffer until
+ * the rest of its page is written or nand_flash_sync() is called.
  *
  * @param handle The handle to the nand flash chip.
  * @param[out] buffer The input buffer containing the data to write.
  * @param sector_id The id of the sector to write.
  * @return 0 on success, or -1 if the write failed.
  */
-int nand_flash_write_sector(nand_flash_device_t *handle, const uint8_t *buffer, uint16_t sector_id);
+int nand_flash_write_sector(nand_flash_device_t *handle, const uint8_t *buffer, uint32_t sector_id);
+
+/** @brief Read consecutive sectors from the nand flash.
+ *
+ * Takes the device mutex once for the whole run instead of once per sector.
+ *
+ * @param handle The handle to the nand flash chip.
+ * @param[out] buffer The output buffer, count * sector size bytes.
+ * @param start_sector The id of the first sector to read.
+ * @param count Number of sectors to read.
+ * @return 0 on success, or the error of the first sector that failed.
+ */
+int nand_flash_read_sectors(nand_flash_device_t *handle, uint8_t *buffer, uint32_t start_sector, uint32_t count);
+
+/** @brief Write consecutive sectors to the nand flash.
+ *
+ * Takes the device mutex once for the whole run instead of once per sector.
+ *
+ * @param handle The handle to the nand flash chip.
+ * @param buffer The input buffer, count * sector size bytes.
+ * @param start_sector The id of the first sector to write.
+ * @param count Number of sectors to write.
+ * @return 0 on success, or the error of the first sector that failed.
+ */
+int nand_flash_write_sectors(nand_flash_device_t *handle, const uint8_t *buffer, uint32_t start_sector, uint32_t count);
+
+#ifdef CONFIG_NAND_SNAPSHOT
+/** @brief Freeze the current content of the nand flash as a read-only snapshot.
+ *
+ * Syncs the map first. A snapshot taken before is replaced.
+ *
+ * @param handle The handle to the nand flash chip.
+ * @return 0 on success, or the dhara error if the sync failed.
+ */
+int nand_flash_snapshot_take(nand_flash_device_t *handle);
+
+/** @brief Release the snapshot, its blocks can be reused by the journal again.
+ *
+ * @param handle The handle to the nand flash chip.
+ */
+void nand_flash_snapshot_release(nand_flash_device_t *handle);
+
+/** @brief Read consecutive sectors as they were when the snapshot was taken.
+ *
+ * @param handle The handle to the nand flash chip.
+ * @param[out] buffer The output buffer, count * sector size bytes.
+ * @param start_sector The id of the first sector to read.
+ * @param count Number of sectors to read.
+ * @return 0 on success, -1 if there is no snapshot, or the error of the first sector that failed.
+ */
+int nand_flash_read_snapshot_sectors(nand_flash_device_t *handle, uint8_t *buffer, uint32_t start_sector, uint32_t count);
+#endif
 
 /** @brief Synchronizes any cache to the device.
  *
  * After this method is called, the nand flash chip should be synchronized with the results of any previous read/writes.
+ * Writes the page buffer of CONFIG_NAND_SUBPAGE_SECTORS first.
  *
  * @param handle The handle to the nand flash chip.
  * @return 0 on success, or -1 if the synchronization failed.
  */
 int nand_flash_sync(nand_flash_device_t *handle);
 
+/** @brief Take the device mutex for code that reads the chips directly, like the health scans.
+ *
+ * With CONFIG_NAND_WRITE_BEHIND the page programming behind the last write is finished
+ * first, the chips are idle until nand_flash_unlock_chips().
+ *
+ * @param handle The handle to the nand flash chip.
+ */
+void nand_flash_lock_chips(nand_flash_device_t *handle);
+
+/** @brief Release the device mutex taken by nand_flash_lock_chips().
+ *
+ * @param handle The handle to the nand flash chip.
+ */
+void nand_flash_unlock_chips(nand_flash_device_t *handle);
+
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+/** @brief Sync according to the sync policy, used for the sync requests of the file system.
+ *
+ * @param handle The handle to the nand flash chip.
+ * @return 0 on success or if the sync was deferred, or the error of nand_flash_sync().
+ */
+int nand_flash_request_sync(nand_flash_device_t *handle);
+
+/** @brief Change the sync policy, pending writes are synced first.
+ *
+ * @param handle The handle to the nand flash chip.
+ * @param config The new policy, copied.
+ * @return 0 on success, or the error of nand_flash_sync().
+ */
+int nand_flash_set_sync_policy(nand_flash_device_t *handle, const struct nand_sync_config *config);
+
+/** @brief Signal a low battery, or its end.
+ *
+ * A low battery syncs at once and makes every further request sync immediately,
+ * whatever the policy, until it is cleared again.
+ *
+ * @param handle The handle to the nand flash chip.
+ * @param low true if the battery is low.
+ * @return 0 on success, or the error of nand_flash_sync().
+ */
+int nand_flash_set_power_low(nand_flash_device_t *handle, bool low);
+#endif
+
 /** @brief Retrieve the number of sectors available.
  *
  * @param handle The handle to the nand flash chip.
@@ -0,0 +1,96 @@
+/**
+ * @file nand_trace.h
+ * @brief Binary event trace of the NAND stack
+ *
+ * Every SPI command, busy wait and FTL step is stored as a 16 byte record in a RAM
+ * ring buffer, the oldest records are overwritten. Recording costs two cycle counter
+ * reads and a copy, so the timeline is not distorted the way string logging does.
+ * nand_trace_dump() prints the ring as hex lines, scripts/nand_trace_to_perfetto.py
+ * turns a captured dump into a Chrome trace / Perfetto JSON file.
+ *
+ * Everything compiles away without CONFIG_NAND_TRACE.
+ */
+
+#ifndef NAND_TRACE_H
+#define NAND_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+//record types, keep in sync with scripts/nand_trace_to_perfetto.py
+enum nand_trace_type {
+    NAND_TRACE_CMD = 1,     //SPI transaction, code = opcode, arg = chip << 24 | address, len = data bytes
+    NAND_TRACE_BUSY,        //busy wait on the status register, arg = polls
+    NAND_TRACE_PAGE_READ,   //page read to cache incl. busy wait, arg = page
+    NAND_TRACE_PROGRAM,     //program execute incl. busy wait, arg = page
+    NAND_TRACE_ERASE,       //block erase incl. busy wait, arg = block
+    NAND_TRACE_META_READ,   //dhara_journal_read_meta, arg = page
+    NAND_TRACE_TRACE_PATH,  //radix tree walk, arg = sector, len = metadata reads
+    NAND_TRACE_GC_COPY,     //page moved by the garbage collector, arg = source page
+    NAND_TRACE_SYNC_PAD,    //filler page written to reach a checkpoint, arg = page
+    NAND_TRACE_RECOVERY,    //journal recovery started, arg = head page, no duration
+    NAND_TRACE_SECTOR_READ, //top layer sector read, arg = sector, code = error
+    NAND_TRACE_SECTOR_WRITE,//top layer sector write, arg = sector, code = error
+    NAND_TRACE_SYNC,        //top layer sync, code = error
+};
+
+/**
+ * @brief One trace record, little endian, 16 bytes.
+ */
+struct nand_trace_record {
+    uint32_t start;     //k_cycle_get_32() at the start of the event
+    uint32_t duration;  //in cycles, 0 for instant events
+    uint32_t arg;       //page, block, sector or count, see nand_trace_type
+    uint8_t type;       //enum nand_trace_type
+    uint8_t code;       //opcode or error
+    uint16_t len;       //bytes or count
+} __attribute__((packed));
+
+#ifdef CONFIG_NAND_TRACE
+
+#include <zephyr/kernel.h>
+
+/**
+ * @brief Store one record. Use the macros below instead of calling this directly.
+ */
+void nand_trace_record(uint8_t type, uint8_t code, uint32_t arg, uint16_t len, uint32_t start);
+
+/**
+ * @brief Start or stop recording, e.g. to freeze the ring right after a stall.
+ */
+void nand_trace_enable(bool enable);
+
+/**
+ * @brief Drop all records.
+ */
+void nand_trace_clear(void);
+
+/**
+ * @brief Copy the complete records, oldest first, records being written are skipped.
+ *
+ * @param[out] out Destination for the records.
+ * @param max Capacity of out in records.
+ * @return number of records copied.
+ */
+size_t nand_trace_snapshot(struct nand_trace_record *out, size_t max);
+
+/**
+ * @brief Print the ring with printk, one "NTR <32 hex digits>" line per record.
+ *
+ * Recording is paused while dumping.
+ */
+void nand_trace_dump(void);
+
+#define NAND_TRACE_START(start) uint32_t start = k_cycle_get_32()
+#define NAND_TRACE_END(type, code, arg, len, start) nand_trace_record((type), (code), (arg), (len), (start))
+#define NAND_TRACE_EVENT(type, code, arg, len) nand_trace_record((type), (code), (arg), (len), k_cycle_get_32())
+
+#else
+
+#define NAND_TRACE_START(start)
+#define NAND_TRACE_END(type, code, arg, len, start) ((void)0)
+#define NAND_TRACE_EVENT(type, code, arg, len) ((void)0)
+
+#endif //CONFIG_NAND_TRACE
+
+#endif //NAND_TRACE_H
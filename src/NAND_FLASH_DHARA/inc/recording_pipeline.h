@@ -0,0 +1,65 @@
+/**
+ * @file recording_pipeline.h
+ * @brief Producer/consumer pipeline between the sampling code and the flash
+ *
+ * The sampling side pushes its samples into a lock-free single producer, single
+ * consumer ring buffer. A writer thread drains the ring one chunk (page) at a time
+ * into a preallocated recording (nand_recording_open()). A garbage collection step or
+ * a sync of the flash stack only delays the writer, the producer never waits; if the
+ * ring runs full the sample is dropped and counted instead.
+ *
+ * Size the ring for the longest flash stall: sample rate * stall time, with
+ * recording_pipeline_get_stats() telling how close a session came.
+ */
+
+#ifndef RECORDING_PIPELINE_H
+#define RECORDING_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vfs_NAND_flash.h"
+
+struct recording_pipeline_stats {
+    uint32_t high_water;    //most bytes waiting in the ring at once
+    uint32_t overflows;     //samples dropped because the ring was full
+    uint32_t dropped_bytes; //bytes of the dropped samples
+    uint32_t chunks;        //writes of the writer thread
+    uint32_t max_write_us;  //slowest of these writes
+    int error;              //first write error, 0 if none
+};
+
+/**
+ * @brief Open a preallocated recording and start the writer thread.
+ *
+ * @param path Zephyr path of the file, e.g. "/NAND:/rec.bin".
+ * @param reserve Bytes to preallocate, see nand_recording_open().
+ * @return 0 on success, -EBUSY if a session is running, or the error of nand_recording_open().
+ */
+int recording_pipeline_start(const char *path, FSIZE_t reserve);
+
+/**
+ * @brief Append a sample, never blocks.
+ *
+ * Single producer: call it from one thread or one ISR only.
+ *
+ * @return 0 on success, -ENOSPC if the ring is full (the sample is dropped and counted),
+ *         -EAGAIN if no session is running.
+ */
+int recording_pipeline_push(const void *data, size_t len);
+
+/**
+ * @brief Write what is left in the ring, stop the writer thread and close the recording.
+ *
+ * Stop the producer first, samples pushed while stopping may be lost.
+ *
+ * @return 0 on success, or the first error of the session.
+ */
+int recording_pipeline_stop(void);
+
+/**
+ * @brief Get the counters of the current or last session.
+ */
+void recording_pipeline_get_stats(struct recording_pipeline_stats *stats);
+
+#endif //RECORDING_PIPELINE_H
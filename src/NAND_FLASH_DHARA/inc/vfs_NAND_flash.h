@@ -13,6 +13,9 @@
  * Date: [10.03.2024]
  */
 
+#ifndef VFS_NAND_FLASH_H
+#define VFS_NAND_FLASH_H
+
 #include <zephyr/fs/fs.h>
 #include <ff.h>  // FatFs API
 
@@ -22,4 +25,55 @@ extern struct fs_mount_t nand_mount_fat;
 
 int mount_nand_fs(void);
 
-int unmount_nand_fs(void);
\ No newline at end of file
+int unmount_nand_fs(void);
+
+
+/**
+ * @brief A recording file with preallocated clusters, see nand_recording_open().
+ */
+struct nand_recording {
+    FIL fil;
+    FSIZE_t written;  // bytes written so far, the file is truncated to this on close
+    FSIZE_t reserved; // preallocated size
+};
+
+/**
+ * @brief Create a recording file and allocate its clusters up front.
+ *
+ * The whole cluster chain is written to the FAT once, contiguous with f_expand if
+ * FatFs was built with FF_USE_EXPAND, otherwise by seeking past the end. Appends
+ * inside the reservation then only write data sectors, the FAT and the directory
+ * entry are left alone until nand_recording_sync() or nand_recording_close().
+ * Until then the file has the reserved size on the disk.
+ *
+ * @param rec Recording to initialise.
+ * @param path Zephyr path of the file, e.g. "/NAND:/rec.bin", an existing file is replaced.
+ * @param reserve Bytes to preallocate.
+ * @return 0 on success, or a negative errno code.
+ */
+int nand_recording_open(struct nand_recording *rec, const char *path, FSIZE_t reserve);
+
+/**
+ * @brief Append to a recording.
+ *
+ * Writing past the reservation works, but grows the cluster chain the usual way.
+ *
+ * @return 0 on success, or a negative errno code.
+ */
+int nand_recording_write(struct nand_recording *rec, const void *data, size_t len);
+
+/**
+ * @brief Flush the data and the directory entry of a recording.
+ *
+ * @return 0 on success, or a negative errno code.
+ */
+int nand_recording_sync(struct nand_recording *rec);
+
+/**
+ * @brief Trim the unused part of the reservation and close the recording.
+ *
+ * @return 0 on success, or a negative errno code.
+ */
+int nand_recording_close(struct nand_recording *rec);
+
+#endif // VFS_NAND_FLASH_H
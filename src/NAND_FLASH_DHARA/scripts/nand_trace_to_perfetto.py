@@ -0,0 +1,164 @@
+"""
+Convert a NAND trace dump (CONFIG_NAND_TRACE, nand_trace_dump()) to Chrome trace JSON.
+
+The dump is taken from the serial log, any other lines in the file are ignored:
+    NTR hz=64000000 records=1024 dropped=0
+    NTR 1a2b3c4d...   (one record, 16 bytes as hex)
+    NTR end
+
+Usage:
+    python nand_trace_to_perfetto.py log_data.txt trace.json
+and open trace.json in https://ui.perfetto.dev or chrome://tracing.
+"""
+import json
+import re
+import struct
+import sys
+
+# keep in sync with enum nand_trace_type in inc/nand_trace.h
+TYPES = {
+    1: "cmd",
+    2: "busy wait",
+    3: "page read",
+    4: "program",
+    5: "erase",
+    6: "meta read",
+    7: "trace_path",
+    8: "gc copy",
+    9: "sync pad",
+    10: "recovery",
+    11: "sector read",
+    12: "sector write",
+    13: "sync",
+}
+
+# opcodes from inc/nand_driver.h
+COMMANDS = {
+    0x06: "write enable",
+    0x0F: "get feature",
+    0x1F: "set feature",
+    0x9F: "read id",
+    0x13: "page read",
+    0x0B: "read cache",
+    0x31: "read cache sequential",
+    0x3F: "read cache end",
+    0x02: "program load",
+    0x84: "program load random",
+    0x10: "program execute",
+    0xD8: "block erase",
+    0xFF: "reset",
+}
+
+# one timeline row per layer, SPI commands get one row per chip
+THREADS = {
+    "top layer": 1,
+    "dhara": 2,
+    "nand": 3,
+    "busy": 4,
+}
+SPI_THREAD_BASE = 10
+
+RECORD = struct.Struct("<IIIBBH")
+
+
+def read_dump(file_path):
+    hz = None
+    records = []
+    with open(file_path, "r", errors="replace") as file:
+        for line in file:
+            match = re.search(r"NTR hz=(\d+) records=(\d+) dropped=(\d+)", line)
+            if match:
+                # a new dump starts, only the last one is converted
+                hz = int(match.group(1))
+                records = []
+                print(f"dump with {match.group(2)} records, {match.group(3)} dropped")
+                continue
+            match = re.search(r"NTR ([0-9a-f]{32})\b", line)
+            if match:
+                records.append(RECORD.unpack(bytes.fromhex(match.group(1))))
+    if hz is None:
+        sys.exit("no 'NTR hz=' header found")
+    return hz, records
+
+
+def unwrap(records):
+    # records are stored when an event ends, so the end times are monotonic,
+    # which is enough to undo the wrap around of the 32 bit cycle counter
+    offset = 0
+    last_end = None
+    for start, duration, arg, rtype, code, length in records:
+        end = (start + duration) & 0xFFFFFFFF
+        if last_end is not None and end < last_end and last_end - end > 0x80000000:
+            offset += 1 << 32
+        last_end = end
+        yield offset + end - duration, duration, arg, rtype, code, length
+
+
+def to_event(hz, start, duration, arg, rtype, code, length):
+    name = TYPES.get(rtype, f"type {rtype}")
+    args = {"arg": arg}
+
+    if rtype == 1:
+        name = COMMANDS.get(code, f"cmd 0x{code:02x}")
+        tid = SPI_THREAD_BASE + (arg >> 24)
+        args = {"address": f"0x{arg & 0xFFFFFF:06x}", "bytes": length}
+    elif rtype == 2:
+        tid = THREADS["busy"]
+        args = {"polls": arg}
+    elif rtype in (3, 4):
+        tid = THREADS["nand"]
+        args = {"page": arg}
+    elif rtype == 5:
+        tid = THREADS["nand"]
+        args = {"block": arg}
+    elif rtype == 7:
+        tid = THREADS["dhara"]
+        args = {"sector": arg, "meta reads": length, "found": code == 0}
+    elif rtype in (6, 8, 9, 10):
+        tid = THREADS["dhara"]
+        args = {"page": arg}
+    else:
+        tid = THREADS["top layer"]
+        args = {"sector": arg, "error": code}
+
+    event = {
+        "name": name,
+        "cat": "nand",
+        "pid": 1,
+        "tid": tid,
+        "ts": start * 1e6 / hz,
+        "args": args,
+    }
+    if duration == 0:
+        event["ph"] = "i"
+        event["s"] = "t"
+    else:
+        event["ph"] = "X"
+        event["dur"] = duration * 1e6 / hz
+    return event
+
+
+def convert(file_path, out_path):
+    hz, records = read_dump(file_path)
+    events = [to_event(hz, *record) for record in unwrap(records)]
+
+    if events:
+        t0 = min(event["ts"] for event in events)
+        for event in events:
+            event["ts"] -= t0
+
+    names = [{"name": "thread_name", "ph": "M", "pid": 1, "tid": tid, "args": {"name": name}}
+             for name, tid in THREADS.items()]
+    chips = {event["tid"] for event in events if event["tid"] >= SPI_THREAD_BASE}
+    names += [{"name": "thread_name", "ph": "M", "pid": 1, "tid": tid,
+               "args": {"name": f"spi chip {tid - SPI_THREAD_BASE}"}} for tid in sorted(chips)]
+
+    with open(out_path, "w") as file:
+        json.dump({"traceEvents": names + events, "displayTimeUnit": "ns"}, file)
+    print(f"{len(events)} events written to {out_path}")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit("usage: nand_trace_to_perfetto.py <log file> <trace.json>")
+    convert(sys.argv[1], sys.argv[2])
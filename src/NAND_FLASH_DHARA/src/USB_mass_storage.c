@@ -38,7 +38,12 @@ USBD_DEVICE_DEFINE(sample_usbd,
 		   0x2fe3, 0x0008);
 
 
+#ifdef CONFIG_NAND_SNAPSHOT
+//the host gets the frozen view, the firmware keeps writing to the live disk
+USBD_DEFINE_MSC_LUN(NAND_SNAP, "Relab", "NAND_SNAP", "0.00");
+#else
 USBD_DEFINE_MSC_LUN(NAND, "Relab", "NAND", "0.00");
+#endif
 
 static int enable_usb_device_next(void)
 {
@@ -10,6 +10,7 @@
 #include <zephyr/drivers/gpio.h> 
 #include <zephyr/devicetree.h>
 #include <errno.h>
+#include <string.h>
 
 
 
@@ -46,11 +47,237 @@ struct disk_info nand_disk = {
 
 
 
+/////////////////////////           READ AHEAD (OPTIONAL)        ///////////////////////////////////
+
+#ifdef CONFIG_NAND_USB_OFFLOAD
+/*
+ * Two read ahead windows in ping-pong: while one serves the requests of a sequential
+ * stream (e.g. a USB host copying a recording), the work queue fills the other with the
+ * sectors that follow. The NAND page reads of the next request thus overlap with the USB
+ * IN transfer of the current one. The live disk and the snapshot disk have windows of
+ * their own, a host reading one does not evict the stream of the other.
+ */
+
+#define WINDOW_SIZE CONFIG_NAND_USB_OFFLOAD_WINDOW_SIZE
+
+typedef int (*readahead_read_t)(nand_flash_device_t *handle, uint8_t *buffer, uint32_t start_sector, uint32_t count);
+
+struct readahead_window {
+    uint32_t start;
+    uint32_t count;//0 if the window holds nothing
+    uint32_t generation;//of the data the window was filled from
+    uint8_t buf[WINDOW_SIZE] __aligned(4);
+};
+
+struct readahead_stream {
+    struct readahead_window windows[2];
+    uint32_t next;//first sector after the last request, for detecting sequential reads
+    struct readahead_window *fill_window;
+    uint32_t fill_start;
+    uint32_t fill_count;
+    struct k_mutex mutex;
+    struct k_work work;
+    readahead_read_t read;
+    uint32_t (*generation)(void);//changes when the sectors change under the windows, NULL if never
+};
+
+static K_THREAD_STACK_DEFINE(readahead_stack, CONFIG_NAND_USB_OFFLOAD_STACK_SIZE);
+static struct k_work_q readahead_queue;
+
+static struct readahead_stream live_stream = {
+    .read = nand_flash_read_sectors,
+};
+
+#ifdef CONFIG_NAND_SNAPSHOT
+static uint32_t snapshot_generation(void)
+{
+    return device_handle->snapshot_id;
+}
+
+static struct readahead_stream snapshot_stream = {
+    .read = nand_flash_read_snapshot_sectors,
+    .generation = snapshot_generation,
+};
+#endif
+
+
+static inline uint32_t stream_generation(const struct readahead_stream *stream)
+{
+    return stream->generation ? stream->generation() : 0;
+}
+
+static void readahead_fill(struct k_work *work)
+{
+    struct readahead_stream *stream = CONTAINER_OF(work, struct readahead_stream, work);
+    struct readahead_window *w = stream->fill_window;
+    const uint32_t generation = stream_generation(stream);
+
+    //the requests flush this work before touching the windows, so no lock is needed here
+    if (stream->read(device_handle, w->buf, stream->fill_start, stream->fill_count) == 0 &&
+        stream_generation(stream) == generation) {
+        w->start = stream->fill_start;
+        w->count = stream->fill_count;
+        w->generation = generation;
+    }
+}
+
+static struct readahead_window *window_holding(struct readahead_stream *stream, uint32_t sector)
+{
+    const uint32_t generation = stream_generation(stream);
+
+    for (size_t w = 0; w < ARRAY_SIZE(stream->windows); w++) {
+        struct readahead_window *window = &stream->windows[w];
+
+        if (window->count != 0 && window->generation != generation) {
+            window->count = 0;//filled from a snapshot that was replaced since
+        }
+        if (window->count != 0 && sector >= window->start && sector - window->start < window->count) {
+            return window;
+        }
+    }
+    return NULL;
+}
+
+static void readahead_invalidate(struct readahead_stream *stream, uint32_t start_sector, uint32_t num_sector)
+{
+    for (size_t w = 0; w < ARRAY_SIZE(stream->windows); w++) {
+        struct readahead_window *window = &stream->windows[w];
+
+        if (window->count != 0 && start_sector < window->start + window->count &&
+            window->start < start_sector + num_sector) {
+            window->count = 0;
+        }
+    }
+}
+
+/**
+ * @brief Queue the read of the window after the one serving the stream, stream mutex held.
+ */
+static void readahead_schedule(struct readahead_stream *stream, uint32_t sector_size, uint32_t capacity)
+{
+    const struct readahead_window *current = window_holding(stream, stream->next);
+    struct readahead_window *other;
+    uint32_t start = stream->next;
+
+    if (current) {
+        other = (current == &stream->windows[0]) ? &stream->windows[1] : &stream->windows[0];
+        start = current->start + current->count;
+        if (other->count != 0 && other->start == start) {
+            return;//already read ahead
+        }
+    } else {
+        other = &stream->windows[0];
+    }
+
+    if (start >= capacity) {
+        return;
+    }
+
+    other->count = 0;
+    stream->fill_window = other;
+    stream->fill_start = start;
+    stream->fill_count = MIN(WINDOW_SIZE / sector_size, capacity - start);
+    k_work_submit_to_queue(&readahead_queue, &stream->work);
+}
+
+static int readahead_read(struct readahead_stream *stream, uint8_t *data_buf, uint32_t start_sector,
+                          uint32_t num_sector, uint32_t sector_size)
+{
+    int ret = 0;
+    uint32_t capacity;
+    struct k_work_sync sync;
+
+    k_mutex_lock(&stream->mutex, K_FOREVER);
+    k_work_flush(&stream->work, &sync);
+
+    //serve what the windows hold, the rest directly
+    while (num_sector > 0) {
+        const struct readahead_window *w = window_holding(stream, start_sector);
+        if (!w) {
+            break;
+        }
+        const uint32_t offset = start_sector - w->start;
+        const uint32_t n = MIN(num_sector, w->count - offset);
+
+        memcpy(data_buf, w->buf + offset * sector_size, n * sector_size);
+        data_buf += n * sector_size;
+        start_sector += n;
+        num_sector -= n;
+    }
+
+    const bool sequential = (start_sector == stream->next) || window_holding(stream, start_sector - 1) != NULL;
+
+    if (num_sector > 0) {
+        ret = stream->read(device_handle, data_buf, start_sector, num_sector);
+    }
+    stream->next = start_sector + num_sector;
+
+    if (ret == 0 && sequential && nand_flash_get_capacity(device_handle, &capacity) == 0 &&
+        WINDOW_SIZE >= sector_size) {
+        readahead_schedule(stream, sector_size, capacity);
+    }
+
+    k_mutex_unlock(&stream->mutex);
+    return ret;
+}
+
+static int readahead_write(const uint8_t *data_buf, uint32_t start_sector, uint32_t num_sector)
+{
+    struct k_work_sync sync;
+
+    k_mutex_lock(&live_stream.mutex, K_FOREVER);
+    k_work_flush(&live_stream.work, &sync);
+    readahead_invalidate(&live_stream, start_sector, num_sector);
+    int ret = nand_flash_write_sectors(device_handle, data_buf, start_sector, num_sector);
+    k_mutex_unlock(&live_stream.mutex);
+    return ret;
+}
+
+static void readahead_reset(struct readahead_stream *stream)
+{
+    struct k_work_sync sync;
+
+    k_mutex_lock(&stream->mutex, K_FOREVER);
+    k_work_flush(&stream->work, &sync);
+    stream->windows[0].count = 0;
+    stream->windows[1].count = 0;
+    stream->next = UINT32_MAX;
+    k_mutex_unlock(&stream->mutex);
+}
+
+static void readahead_init(void)
+{
+    static bool started;
+
+    if (!started) {
+        k_work_queue_init(&readahead_queue);
+        k_work_queue_start(&readahead_queue, readahead_stack, K_THREAD_STACK_SIZEOF(readahead_stack),
+                           CONFIG_NAND_USB_OFFLOAD_PRIORITY, NULL);
+        k_mutex_init(&live_stream.mutex);
+        k_work_init(&live_stream.work, readahead_fill);
+#ifdef CONFIG_NAND_SNAPSHOT
+        k_mutex_init(&snapshot_stream.mutex);
+        k_work_init(&snapshot_stream.work, readahead_fill);
+#endif
+        started = true;
+    }
+    readahead_reset(&live_stream);
+#ifdef CONFIG_NAND_SNAPSHOT
+    readahead_reset(&snapshot_stream);
+#endif
+}
+#endif //CONFIG_NAND_USB_OFFLOAD
+/////////////////////////           READ AHEAD END (OPTIONAL)        ///////////////////////////////////
+
+
 int nand_disk_access_init(struct disk_info *disk) {
     // disk->name = "NAND_DISK";
     // disk->ops = &nand_disk_ops;
     // disk->dev = DEVICE_DT_GET(DT_BUS(DT_NODELABEL(nand_device)));
     int ret = nand_flash_init_device(&device_handle);
+#ifdef CONFIG_NAND_USB_OFFLOAD
+    readahead_init();
+#endif
     return ret;
 }
 
@@ -72,12 +299,14 @@ int nand_disk_access_read(struct disk_info *disk, uint8_t *data_buf, uint32_t st
         return -EIO;
     }
 
-    for (uint32_t i = 0; i < num_sector; ++i) {
-        ret = nand_flash_read_sector(device_handle, data_buf + i * sector_size, start_sector + i);
-        if (ret < 0) {
-            LOG_ERR("Failed to read sector %d: %d", start_sector + i, ret);
-            return -EIO;
-        }
+#ifdef CONFIG_NAND_USB_OFFLOAD
+    ret = readahead_read(&live_stream, data_buf, start_sector, num_sector, sector_size);
+#else
+    ret = nand_flash_read_sectors(device_handle, data_buf, start_sector, num_sector);
+#endif
+    if (ret != 0) {
+        LOG_ERR("Failed to read sectors %u..%u: %d", start_sector, start_sector + num_sector - 1, ret);
+        return -EIO;
     }
     return 0;
 
@@ -85,19 +314,15 @@ int nand_disk_access_read(struct disk_info *disk, uint8_t *data_buf, uint32_t st
 
 int nand_disk_access_write(struct disk_info *disk, const uint8_t *data_buf, uint32_t start_sector, uint32_t num_sector) {
     LOG_DBG("nand_disk_access_write - disk=%s, start_sector=%u, num_sector=%u", nand_disk.name, start_sector, num_sector);
-    uint32_t sector_size;
-    int ret = nand_flash_get_sector_size(device_handle, &sector_size);
-    if (ret < 0) {
-        LOG_ERR("Error getting sector size: %d", ret);
-        return -EIO;
-    }
 
-    for (uint32_t i = 0; i < num_sector; ++i) {
-        ret = nand_flash_write_sector(device_handle, data_buf + i * sector_size, start_sector + i);
-        if (ret < 0) {
-            LOG_ERR("Failed to write sector %d: %d", start_sector + i, ret);
-            return DISK_STATUS_WR_PROTECT;
-        }
+#ifdef CONFIG_NAND_USB_OFFLOAD
+    int ret = readahead_write(data_buf, start_sector, num_sector);
+#else
+    int ret = nand_flash_write_sectors(device_handle, data_buf, start_sector, num_sector);
+#endif
+    if (ret != 0) {
+        LOG_ERR("Failed to write sectors %u..%u: %d", start_sector, start_sector + num_sector - 1, ret);
+        return DISK_STATUS_WR_PROTECT;
     }
     return 0;
 
@@ -129,7 +354,11 @@ int nand_disk_access_ioctl(struct disk_info *disk, uint8_t cmd, void *buff) {
 
         case DISK_IOCTL_CTRL_SYNC:
             // Assuming that the sync function only requires the device handle and returns status
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+            ret = nand_flash_request_sync(device_handle);//may be deferred, see enum nand_sync_policy
+#else
             ret = nand_flash_sync(device_handle);
+#endif
             if (ret < 0) {
                 LOG_ERR("Failed to sync device: error %d", ret);
                 return -EIO;
@@ -148,6 +377,90 @@ int nand_disk_access_ioctl(struct disk_info *disk, uint8_t cmd, void *buff) {
 }
 
 
+
+/////////////////////////           SNAPSHOT DISK (OPTIONAL)        ///////////////////////////////////
+
+#ifdef CONFIG_NAND_SNAPSHOT
+/*
+ * Read-only disk "NAND_SNAP" for the USB LUN: serves the sectors as they were when the
+ * snapshot was taken, so the host sees a consistent file system while the firmware keeps
+ * logging to "NAND". The snapshot is taken when the disk is initialized (USB enable),
+ * nand_flash_snapshot_take() refreshes it, the host has to remount to see the new data.
+ */
+
+static int nand_snapshot_access_init(struct disk_info *disk)
+{
+#ifdef CONFIG_NAND_USB_OFFLOAD
+    readahead_init();
+#endif
+    if (device_handle->snapshot_valid) {
+        return 0;
+    }
+    return nand_flash_snapshot_take(device_handle) == 0 ? 0 : -EIO;
+}
+
+static int nand_snapshot_access_status(struct disk_info *disk)
+{
+    if (!device_handle->snapshot_valid) {
+        return DISK_STATUS_NOMEDIA;
+    }
+    return DISK_STATUS_WR_PROTECT;
+}
+
+static int nand_snapshot_access_read(struct disk_info *disk, uint8_t *data_buf, uint32_t start_sector, uint32_t num_sector)
+{
+#ifdef CONFIG_NAND_USB_OFFLOAD
+    uint32_t sector_size;
+    int ret = nand_flash_get_sector_size(device_handle, &sector_size);
+
+    if (ret == 0) {
+        ret = readahead_read(&snapshot_stream, data_buf, start_sector, num_sector, sector_size);
+    }
+#else
+    int ret = nand_flash_read_snapshot_sectors(device_handle, data_buf, start_sector, num_sector);
+#endif
+    if (ret != 0) {
+        LOG_ERR("Failed to read snapshot sectors %u..%u: %d", start_sector, start_sector + num_sector - 1, ret);
+        return -EIO;
+    }
+    return 0;
+}
+
+static int nand_snapshot_access_write(struct disk_info *disk, const uint8_t *data_buf, uint32_t start_sector, uint32_t num_sector)
+{
+    LOG_ERR("The snapshot is read-only");
+    return -EROFS;
+}
+
+static int nand_snapshot_access_ioctl(struct disk_info *disk, uint8_t cmd, void *buff)
+{
+    switch (cmd) {
+        case DISK_IOCTL_CTRL_SYNC:
+            return 0;//nothing to write back
+
+        default:
+            //same geometry as the live disk
+            return nand_disk_access_ioctl(&nand_disk, cmd, buff);
+    }
+}
+
+static const struct disk_operations nand_snapshot_disk_ops = {
+    .init = nand_snapshot_access_init,
+    .status = nand_snapshot_access_status,
+    .read = nand_snapshot_access_read,
+    .write = nand_snapshot_access_write,
+    .ioctl = nand_snapshot_access_ioctl
+};
+
+struct disk_info nand_snapshot_disk = {
+    .name = "NAND_SNAP",
+    .ops = &nand_snapshot_disk_ops,
+    .dev = DEVICE_DT_GET(DT_BUS(DT_NODELABEL(nand_device)))
+};
+#endif //CONFIG_NAND_SNAPSHOT
+/////////////////////////           SNAPSHOT DISK END (OPTIONAL)        ///////////////////////////////////
+
+
 int disk_nand_init(void)
 {
     //k_mutex_lock(&disk_mutex, K_FOREVER);
@@ -163,6 +476,13 @@ int disk_nand_init(void)
     }else{
         LOG_ERR("no linked node for disk");
     }
+#ifdef CONFIG_NAND_SNAPSHOT
+    ret = disk_access_register(&nand_snapshot_disk);
+    if (ret) {
+        LOG_ERR("Failed to register NAND snapshot disk");
+        return ret;
+    }
+#endif
     return 0;
 }
 
@@ -173,6 +493,13 @@ int disk_nand_uninit(void)
         LOG_ERR("Failed to unregister NAND disk");
         return ret;
     }
+#ifdef CONFIG_NAND_SNAPSHOT
+    ret = disk_access_unregister(&nand_snapshot_disk);
+    if (ret) {
+        LOG_ERR("Failed to unregister NAND snapshot disk");
+        return ret;
+    }
+#endif
     return 0;
 }
 
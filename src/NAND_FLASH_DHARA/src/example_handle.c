@@ -5,6 +5,7 @@
 #include <zephyr/devicetree.h>
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
+#include <string.h>
 
 
 #define SPI_OP   SPI_OP_MODE_MASTER | SPI_TRANSFER_MSB | SPI_WORD_SET(8) | SPI_LINES_SINGLE
@@ -19,185 +20,194 @@ nand_h *my_nand_handle = &Global_handle;
 
 
 
-// Example transceive function
-int my_transceive_function(nand_transaction_t *transaction) {
-    //transmitter preparation before sending
-    //address bytes + data bytes + the command byte + dummy byte
-    
-	const struct spi_dt_spec spidev_dt = SPI_DT_SPEC_GET(DT_NODELABEL(nand_device), SPI_OP, 0);
-
-    //handle transmissions of 1 byte 
-    //(CMD_WRITE_ENABLE and CMD_WRITE_DISABLE)
-    if (transaction->address_bytes == 0) {
-        struct spi_buf tx_bufs_one_byte;
-        tx_bufs_one_byte.buf = &transaction->command;
-        tx_bufs_one_byte.len = 1;
-
-        const struct spi_buf_set tx = {
-            .buffers = &tx_bufs_one_byte,
-            .count = 1
-        };
-
-        return spi_write_dt(&spidev_dt, &tx);
+// One entry per NAND chip, in striping order (see number_of_flashes in nand_driver.h).
+// Further chips are picked up from the devicetree nodes nand_device_1 ... nand_device_3.
+static const struct spi_dt_spec nand_dt_specs[] = {
+    SPI_DT_SPEC_GET(DT_NODELABEL(nand_device), SPI_OP, 0),
+#if DT_NODE_EXISTS(DT_NODELABEL(nand_device_1))
+    SPI_DT_SPEC_GET(DT_NODELABEL(nand_device_1), SPI_OP, 0),
+#endif
+#if DT_NODE_EXISTS(DT_NODELABEL(nand_device_2))
+    SPI_DT_SPEC_GET(DT_NODELABEL(nand_device_2), SPI_OP, 0),
+#endif
+#if DT_NODE_EXISTS(DT_NODELABEL(nand_device_3))
+    SPI_DT_SPEC_GET(DT_NODELABEL(nand_device_3), SPI_OP, 0),
+#endif
+};
+
+#define NAND_CHIPS ARRAY_SIZE(nand_dt_specs)
+
+// Bus configurations in use, [set][chip]. Zephyr only reconfigures the controller when a
+// transfer brings another spi_config than the last one, so a new clock is written to the
+// set the controller has not seen yet. The locked copies are used for batches.
+static struct spi_dt_spec nand_specs[2][NAND_CHIPS];
+static struct spi_dt_spec nand_locked_specs[2][NAND_CHIPS];
+static uint8_t nand_spec_set;
+static bool nand_spec_set_used;
+
+
+// How an opcode is framed on the bus
+enum nand_cmd_dir {
+    NAND_DIR_NONE,  //command and address only
+    NAND_DIR_IN,    //followed by miso_len bytes from the chip
+    NAND_DIR_OUT,   //followed by mosi_len bytes to the chip
+};
+
+#define NAND_CMD_VARIABLE 0xF //address or dummy bytes taken from the transaction
+
+struct nand_cmd_desc {
+    uint8_t address_bytes : 4;  //sent most significant byte first
+    uint8_t dummy_bytes : 4;
+    uint8_t dir : 2;            //enum nand_cmd_dir
+    uint8_t lanes : 3;          //data lines of the data phase, 0 for an unknown opcode
+};
+
+// Command set of the supported chips, indexed by opcode. A new command is one more entry.
+static const struct nand_cmd_desc nand_cmds[256] = {
+    [CMD_WRITE_ENABLE]         = {0, 0, NAND_DIR_NONE, 1},
+    [CMD_WRITE_DISABLE]        = {0, 0, NAND_DIR_NONE, 1},
+    [CMD_Reset]                = {0, 0, NAND_DIR_NONE, 1},
+    [CMD_READ_CACHE_SEQ]       = {0, 0, NAND_DIR_NONE, 1},
+    [CMD_READ_CACHE_END]       = {0, 0, NAND_DIR_NONE, 1},
+    [CMD_READ_REGISTER]        = {1, 0, NAND_DIR_IN,   1},
+    [CMD_SET_REGISTER]         = {1, 0, NAND_DIR_OUT,  1},
+    //the ID is read with an address or after dummy bytes, depending on the manufacturer
+    [CMD_READ_ID]              = {NAND_CMD_VARIABLE, NAND_CMD_VARIABLE, NAND_DIR_IN, 1},
+    [CMD_PAGE_READ]            = {3, 0, NAND_DIR_NONE, 1},
+    [CMD_PROGRAM_EXECUTE]      = {3, 0, NAND_DIR_NONE, 1},
+    [CMD_ERASE_BLOCK]          = {3, 0, NAND_DIR_NONE, 1},
+    [CMD_READ_FAST]            = {2, 1, NAND_DIR_IN,   1},
+    [CMD_READ_X2]              = {2, 1, NAND_DIR_IN,   2},
+    [CMD_READ_X4]              = {2, 1, NAND_DIR_IN,   4},
+    [CMD_PROGRAM_LOAD]         = {2, 0, NAND_DIR_OUT,  1},
+    [CMD_PROGRAM_LOAD_RAND]    = {2, 0, NAND_DIR_OUT,  1},
+    [CMD_PROGRAM_LOAD_X4]      = {2, 0, NAND_DIR_OUT,  4},
+    [CMD_PROGRAM_LOAD_RAND_X4] = {2, 0, NAND_DIR_OUT,  4},
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+    [CMD_ERASE_SUSPEND]        = {0, 0, NAND_DIR_NONE, 1},
+    [CMD_ERASE_RESUME]         = {0, 0, NAND_DIR_NONE, 1},
+#endif
+};
+
+
+// One transaction as SPI buffers, built before anything is sent
+struct spi_frame {
+    uint8_t header[8];          //command, address and dummy bytes
+    struct spi_buf tx_bufs[2];  //header, data to send
+    struct spi_buf rx_bufs[2];  //skipped while the header is sent, data received
+    struct spi_buf_set tx;
+    struct spi_buf_set rx;
+    bool receive;
+};
+
+
+static int build_frame(const nand_transaction_t *transaction, struct spi_frame *frame)
+{
+    const struct nand_cmd_desc *cmd = &nand_cmds[transaction->command];
+
+    //only single line transfers go through the spi_dt_spec, x2 and x4 need a controller that switches lines
+    if (cmd->lanes != 1) {
+        return -ENOTSUP;
     }
 
+    const uint8_t address_bytes = cmd->address_bytes == NAND_CMD_VARIABLE ? transaction->address_bytes : cmd->address_bytes;
+    const uint8_t dummy_bytes = cmd->dummy_bytes == NAND_CMD_VARIABLE ? transaction->dummy_bytes : cmd->dummy_bytes;
+    const size_t header_len = 1 + address_bytes + dummy_bytes;
 
+    if (header_len > sizeof(frame->header)) {
+        return -EINVAL;
+    }
 
-
-    //handle transmissions of 3 bytes
-    if (transaction->address_bytes == 1) {
-
-        //differentiate between only writing and or transceiving
-
-        //send: set feature
-        if(transaction->miso_len == 0){
-            uint8_t combined_buf[3]; 
-
-            combined_buf[0] = transaction->command;
-            combined_buf[1] = transaction->address;
-            combined_buf[2] = *(uint8_t *)transaction->mosi_data;//it's only 1 byte
-
-            struct spi_buf tx_bufs_three_bytes;
-            tx_bufs_three_bytes.buf = combined_buf;
-            tx_bufs_three_bytes.len = 3;
-
-            const struct spi_buf_set tx = {
-                .buffers = &tx_bufs_three_bytes,
-                .count = 1
-            };
-
-            return spi_write_dt(&spidev_dt, &tx);
-        }else if(transaction->miso_len == 2){
-            uint8_t combined_buf[2];
-            combined_buf[0] = transaction->command;
-            combined_buf[1] = transaction->address;
-
-            struct spi_buf tx_bufs_two_bytes;
-            tx_bufs_two_bytes.buf = combined_buf;
-            tx_bufs_two_bytes.len = 2;
-
-            const struct spi_buf_set tx = {
-                .buffers = &tx_bufs_two_bytes,
-                .count = 1
-            };
-
-            struct spi_buf rx_bufs;
-
-            rx_bufs.buf = transaction->miso_data - 3;//shifting the pointer      
-            rx_bufs.len = 4;
-
-            const struct spi_buf_set rx = {
-                .buffers = &rx_bufs,
-                .count = 1
-            };
-            
-            return spi_transceive_dt(&spidev_dt, &tx, &rx);
-        }else{
-            uint8_t combined_buf[2];
-            combined_buf[0] = transaction->command;
-            combined_buf[1] = transaction->address;
-
-            struct spi_buf tx_bufs_two_bytes;
-            tx_bufs_two_bytes.buf = combined_buf;
-            tx_bufs_two_bytes.len = 2;
-
-            const struct spi_buf_set tx = {
-                .buffers = &tx_bufs_two_bytes,
-                .count = 1
-            };
-
-            struct spi_buf rx_bufs;
-
-            rx_bufs.buf = transaction->miso_data - 2;//shifting the pointer      
-            rx_bufs.len = 3;
-
-            const struct spi_buf_set rx = {
-                .buffers = &rx_bufs,
-                .count = 1
-            };
-            
-            return spi_transceive_dt(&spidev_dt, &tx, &rx);
-        }
+    //the driver stores the address in bus order, the first byte to send is the least significant one
+    frame->header[0] = transaction->command;
+    for (uint8_t i = 0; i < address_bytes; i++) {
+        frame->header[1 + i] = (uint8_t)(transaction->address >> (8 * i));
     }
+    memset(&frame->header[1 + address_bytes], dummy_byte_value, dummy_bytes);
 
+    frame->tx_bufs[0] = (struct spi_buf){ .buf = frame->header, .len = header_len };
+    frame->tx_bufs[1] = (struct spi_buf){ .buf = (uint8_t *)transaction->mosi_data, .len = transaction->mosi_len };
+    frame->tx = (struct spi_buf_set){ .buffers = frame->tx_bufs, .count = cmd->dir == NAND_DIR_OUT ? 2 : 1 };
 
+    //nothing useful comes back during the header, a NULL buffer discards it
+    frame->rx_bufs[0] = (struct spi_buf){ .buf = NULL, .len = header_len };
+    frame->rx_bufs[1] = (struct spi_buf){ .buf = transaction->miso_data, .len = transaction->miso_len };
+    frame->rx = (struct spi_buf_set){ .buffers = frame->rx_bufs, .count = 2 };
+    frame->receive = cmd->dir == NAND_DIR_IN;
+    return 0;
+}
 
-    //handle transmissions of 4 bytes / address bytes = 3
-    if (transaction->address_bytes == 3){//block erase, program execute, page read to cache
-        uint8_t combined_buf[4]; 
-        uint8_t *address_bytes = (uint8_t *)&transaction->address;
 
-        combined_buf[0] = transaction->command;
-        combined_buf[1] = address_bytes[0]; // A23-A16
-        combined_buf[2] = address_bytes[1]; // A15-A8
-        combined_buf[3] = address_bytes[2]; // A7-A0
+static int send_frame(const struct spi_dt_spec *spidev_dt, const struct spi_frame *frame)
+{
+    if (frame->receive) {
+        return spi_transceive_dt(spidev_dt, &frame->tx, &frame->rx);
+    }
+    return spi_write_dt(spidev_dt, &frame->tx);
+}
 
-        struct spi_buf tx_bufs_four_bytes;
-        tx_bufs_four_bytes.buf = combined_buf;
-        tx_bufs_four_bytes.len = 4;
 
-        const struct spi_buf_set tx = {
-            .buffers = &tx_bufs_four_bytes,
-            .count = 1
-        };
+// Example transceive function
+int my_transceive_function(nand_transaction_t *transaction) {
+    struct spi_frame frame;
 
-        return spi_write_dt(&spidev_dt, &tx);
+    if (my_nand_handle->active_flash >= NAND_CHIPS) {
+        return -EINVAL;
     }
+    //the driver selects the chip, each chip has its own chip select
+    int ret = build_frame(transaction, &frame);
+    if (ret != 0) {
+        return ret;
+    }
+    nand_spec_set_used = true;
+    return send_frame(&nand_specs[nand_spec_set][my_nand_handle->active_flash], &frame);
+}
 
-    //transmissions of more than 4 bytes/ program load
-    if(transaction->mosi_len > 0){
-        uint8_t combined_buf[3]; 
-        uint8_t *address_bytes = (uint8_t *)&transaction->address;
-
-        combined_buf[0] = transaction->command;
-        combined_buf[1] = address_bytes[0]; // A23-A16
-        combined_buf[2] = address_bytes[1]; // A15-A8
-        
-
-        struct spi_buf tx_bufs_many_bytes[2] = {0};
-        tx_bufs_many_bytes[0].buf = combined_buf;
-        tx_bufs_many_bytes[0].len = 3;
 
-        tx_bufs_many_bytes[1].buf = (uint8_t *)transaction -> mosi_data;
-        tx_bufs_many_bytes[1].len = transaction -> mosi_len;
+#define BATCH_FRAMES 8
 
-        const struct spi_buf_set tx = {
-            .buffers = tx_bufs_many_bytes,
-            .count = 2
-        };
+// Example batch transceive function
+int my_transceive_batch_function(nand_transaction_t *transactions, size_t count) {
+    struct spi_frame frames[BATCH_FRAMES];
+    int ret = 0;
 
-        return spi_write_dt(&spidev_dt, &tx);
+    if (my_nand_handle->active_flash >= NAND_CHIPS) {
+        return -EINVAL;
     }
 
-    if(transaction->miso_len > 0){ //read from cache
-        uint8_t combined_buf[4];
-        uint8_t *address_bytes = (uint8_t *)&transaction->address;
-        combined_buf[0] = transaction->command;
-        combined_buf[1] = address_bytes[0]; // A23-A16
-        combined_buf[2] = address_bytes[1]; // A15-A8
-        combined_buf[3] = dummy_byte_value;
+    //SPI_LOCK_ON keeps the controller configured and owned from the first transfer
+    //until spi_release_dt(). The chip select is still released after every transfer,
+    //each command has to end with it (SPI_HOLD_ON_CS would merge them).
+    const struct spi_dt_spec *locked = &nand_locked_specs[nand_spec_set][my_nand_handle->active_flash];
+    nand_spec_set_used = true;
 
-        struct spi_buf tx_bufs_four_bytes_miso;
-        tx_bufs_four_bytes_miso.buf = combined_buf;
-        tx_bufs_four_bytes_miso.len = 4;
+    for (size_t done = 0; done < count && ret == 0; ) {
+        const size_t n = MIN(count - done, BATCH_FRAMES);
 
-        const struct spi_buf_set tx = {
-            .buffers = &tx_bufs_four_bytes_miso,
-            .count = 1
-        };
-
-        struct spi_buf rx_bufs;
+        for (size_t i = 0; i < n && ret == 0; i++) {
+            ret = build_frame(&transactions[done + i], &frames[i]);
+        }
+        for (size_t i = 0; i < n && ret == 0; i++) {
+            ret = send_frame(locked, &frames[i]);
+        }
+        done += n;
+    }
 
-        rx_bufs.buf = transaction->miso_data - 4;//shifting the pointer      
-        rx_bufs.len = transaction->miso_len + 4;
+    spi_release_dt(locked);
+    return ret;
+}
 
-        const struct spi_buf_set rx = {
-            .buffers = &rx_bufs,
-            .count = 1
-        };
+// Example clock function, applies to all chips
+int my_set_frequency_function(uint32_t hz) {
+    //the set of the last transfers stays untouched until the controller has seen the other one
+    const uint8_t set = nand_spec_set_used ? nand_spec_set ^ 1 : nand_spec_set;
 
-        return spi_transceive_dt(&spidev_dt, &tx, &rx);
+    for (size_t i = 0; i < NAND_CHIPS; i++) {
+        nand_specs[set][i].config.frequency = hz;
+        nand_locked_specs[set][i].config.frequency = hz;
     }
+    nand_spec_set = set;
+    nand_spec_set_used = false;
     return 0;
 }
 
@@ -221,11 +231,37 @@ void my_log_function(char *msg, bool is_err, bool has_int_arg, uint32_t arg) {
 
 
 
+#ifdef CONFIG_NAND_CRC32_HW_BACKEND
+#include <zephyr/sys/crc.h>
+#include "../dhara/ecc/crc32.h"
+
+// Example CRC backend for crc32_nand(), standard IEEE 802.3 update.
+// Point this to the CRC peripheral of your MCU; the software version only keeps the build working.
+uint32_t crc32_hw_update(uint32_t crc, const uint8_t *data, size_t len) {
+    return crc32_ieee_update(crc, data, len);
+}
+#endif // CONFIG_NAND_CRC32_HW_BACKEND
+
+
+
 // Initialization somewhere in your code
 int init_nand_handle() {
+    // Both sets start with the clock of the devicetree
+    for (size_t set = 0; set < 2; set++) {
+        for (size_t i = 0; i < NAND_CHIPS; i++) {
+            nand_specs[set][i] = nand_dt_specs[i];
+            nand_locked_specs[set][i] = nand_dt_specs[i];
+            nand_locked_specs[set][i].config.operation |= SPI_LOCK_ON;
+        }
+    }
+
     // Initialize the handle's function pointers and other members
     my_nand_handle->transceive = my_transceive_function;  
+    my_nand_handle->transceive_batch = my_transceive_batch_function;
     my_nand_handle->log = my_log_function;
+    my_nand_handle->set_frequency = my_set_frequency_function;
+    my_nand_handle->number_of_flashes = NAND_CHIPS;
+    my_nand_handle->active_flash = 0;
 
     // // Link the input handle to the global handle
     // my_nand_handle = handle;
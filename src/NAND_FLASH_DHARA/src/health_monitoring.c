@@ -25,6 +25,17 @@
 
 LOG_MODULE_REGISTER(health_monitoring, CONFIG_LOG_DEFAULT_LEVEL);
 
+#ifdef CONFIG_NAND_SOFT_ECC
+//maintained by the software ECC in nand.c
+extern uint32_t Soft_ECC_corrected_bits;
+extern uint32_t Soft_ECC_corrected_chunks;
+#endif
+
+#ifdef CONFIG_NAND_PAGE_CRC
+//maintained by the page checksum check in nand.c
+extern uint32_t Page_CRC_mismatches;
+#endif
+
 //Bad Block Count, percentage of capacity
 //Erase Count / Wear Leveling to estimate live cycle, Number of times each block has been erased and programmed
 //Program / Erase Cycles, Number of program/erase cycles the flash memory has undergone.
@@ -37,15 +48,77 @@ struct flash_health_metrics {
     uint32_t bad_block_count;//overall bad block counter
     uint32_t erase_count;//Number of times each block has been erased and programmed
     uint32_t ecc_errors;//Indicates the level of data corruption and the effectiveness of error correction. An increasing number of ECC corrections can signal degrading memory cells
-    
+#ifdef CONFIG_NAND_SOFT_ECC
+    uint32_t corrected_bits;//bits repaired by the software ECC since start up, rises long before the first uncorrectable page
+    uint32_t corrected_chunks;//chunks that needed at least one repaired bit
+#endif
+#ifdef CONFIG_NAND_PAGE_CRC
+    uint32_t crc_mismatches;//page checksum mismatches, mostly transfer glitches on the SPI bus
+#endif
+    struct dhara_map_stats ftl;//programs, copies and erases of the FTL since start up, for the write amplification
 };
 
+/**
+ * @brief Counters of the dhara map, summed over the hot region with CONFIG_NAND_HOT_COLD.
+ */
+static void read_ftl_stats(struct dhara_map_stats *stats)
+{
+    dhara_map_get_stats(&device_handle->dhara_map, stats);
+#ifdef CONFIG_NAND_HOT_COLD
+    struct dhara_map_stats hot;
+
+    dhara_map_get_stats(&device_handle->hot_map, &hot);
+    stats->user_writes += hot.user_writes;
+    stats->gc_copies += hot.gc_copies;
+    stats->pad_pages += hot.pad_pages;
+    stats->journal.user_pages += hot.journal.user_pages;
+    stats->journal.copied_pages += hot.journal.copied_pages;
+    stats->journal.meta_pages += hot.journal.meta_pages;
+    stats->journal.erases += hot.journal.erases;
+    stats->journal.erases_ahead += hot.journal.erases_ahead;
+    stats->journal.recoveries += hot.journal.recoveries;
+#endif
+}
+
 // Function to initialize and retrieve flash health metrics
 void get_flash_health_metrics(struct flash_health_metrics *metrics) {
+    //the block scans below read the chips directly, no write may run in between
+    nand_flash_lock_chips(device_handle);
     // Code to retrieve and populate metrics
     metrics->bad_block_count = read_bad_block_count();
     metrics->erase_count = read_erase_count();
     metrics->ecc_errors = read_ecc_errors();
+#ifdef CONFIG_NAND_SOFT_ECC
+    metrics->corrected_bits = Soft_ECC_corrected_bits;
+    metrics->corrected_chunks = Soft_ECC_corrected_chunks;
+#endif
+#ifdef CONFIG_NAND_PAGE_CRC
+    metrics->crc_mismatches = Page_CRC_mismatches;
+#endif
+    read_ftl_stats(&metrics->ftl);
+    nand_flash_unlock_chips(device_handle);
+}
+
+
+/**
+ * @brief Physical page programs per user write, times 100.
+ *
+ * Every user write costs its own page plus the garbage collection copies,
+ * sync pads and checkpoint pages it causes. 100 means no overhead at all.
+ *
+ * @return the write amplification in percent, 0 if nothing was written yet.
+ */
+uint32_t read_write_amplification(void)
+{
+    struct dhara_map_stats stats;
+
+    read_ftl_stats(&stats);
+    if (stats.user_writes == 0) {
+        return 0;
+    }
+
+    const uint64_t programs = (uint64_t)stats.journal.user_pages + stats.journal.copied_pages + stats.journal.meta_pages;
+    return (uint32_t)(programs * 100 / stats.user_writes);
 }
 
 
@@ -57,6 +130,18 @@ int display_health(){
     LOG_INF("Total Bad Block Count: %u", metrics.bad_block_count);
     LOG_INF("Mean Erase Count per Block: %u", metrics.erase_count);
     LOG_INF("Total ECC Errors: %u", metrics.ecc_errors);
+#ifdef CONFIG_NAND_SOFT_ECC
+    LOG_INF("Soft ECC corrected bits: %u in %u chunks", metrics.corrected_bits, metrics.corrected_chunks);
+#endif
+#ifdef CONFIG_NAND_PAGE_CRC
+    LOG_INF("Page checksum mismatches: %u", metrics.crc_mismatches);
+#endif
+    LOG_INF("User writes: %u, GC copies: %u, Pad pages: %u", metrics.ftl.user_writes, metrics.ftl.gc_copies, metrics.ftl.pad_pages);
+    LOG_INF("Programmed pages: %u user, %u copied, %u metadata", metrics.ftl.journal.user_pages,
+            metrics.ftl.journal.copied_pages, metrics.ftl.journal.meta_pages);
+    LOG_INF("Erases: %u (%u ahead), Recoveries: %u", metrics.ftl.journal.erases,
+            metrics.ftl.journal.erases_ahead, metrics.ftl.journal.recoveries);
+    LOG_INF("Write amplification: %u%%", read_write_amplification());
     return 0;
 }
 
@@ -0,0 +1,248 @@
+/**
+ * @file nand_chip_info.c
+ * @brief Identification of the NAND chip, see nand_chip_info.h
+ *
+ * The parameter page is preferred: it gives the exact geometry and the worst case
+ * timings of the part, it is parsed in nand_param_page.c. The table covers the
+ * supported parts without one, e.g. the Alliance and Winbond chips, its timings are
+ * the maxima of the datasheets.
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include "../inc/nand_driver.h"
+#include "../inc/nand_chip_info.h"
+#include "../inc/nand_flash_devices.h"
+
+//worst cases of the supported parts, for timings neither source gives
+#define DEFAULT_T_R_US          120
+#define DEFAULT_T_PROG_US       700
+#define DEFAULT_T_BERS_US       10000
+
+/**
+ * @brief How the device ID of a manufacturer is read.
+ *
+ * Alliance returns it at address DEVICE_ADDR_READ, the others after the dummy
+ * byte and the manufacturer ID. Winbond has a two byte device ID.
+ */
+struct nand_vendor {
+    uint8_t manufacturer_id;
+    uint8_t address_bytes;
+    uint8_t dummy_bytes;
+    uint8_t id_len;
+};
+
+static const struct nand_vendor vendors[] = {
+    {NAND_FLASH_ALLIANCE_MI,   1, 0, 1},
+    {NAND_FLASH_WINBOND_MI,    0, 2, 2},
+    {NAND_FLASH_GIGADEVICE_MI, 0, 2, 1},
+    {NAND_FLASH_MICRON_MI,     0, 2, 1},
+};
+
+struct nand_chip_entry {
+    uint8_t manufacturer_id;
+    uint16_t device_id;
+    uint8_t log2_page_size;
+    uint16_t num_blocks;        //0 if only the parameter page knows it
+    uint16_t oob_size;
+    uint8_t planes;
+    uint8_t ecc_bits;
+    uint16_t t_r_us;
+    uint16_t t_prog_us;
+    uint16_t t_bers_us;
+    uint8_t features;
+    const char *name;
+};
+
+#define WINBOND(di, blocks, name) \
+    {NAND_FLASH_WINBOND_MI, di, 11, blocks, 64, 1, 1, 60, 700, 10000, NAND_CHIP_QUAD | NAND_CHIP_ON_DIE_ECC, name}
+#define ALLIANCE(di, page, blocks, oob, planes, name) \
+    {NAND_FLASH_ALLIANCE_MI, di, page, blocks, oob, planes, 8, 115, 700, 5000, NAND_CHIP_QUAD | NAND_CHIP_ON_DIE_ECC, name}
+#define GIGADEVICE(di, blocks, oob, planes, name) \
+    {NAND_FLASH_GIGADEVICE_MI, di, 11, blocks, oob, planes, 8, 120, 700, 10000, \
+     NAND_CHIP_QUAD | NAND_CHIP_CACHE_READ | NAND_CHIP_ON_DIE_ECC, name}
+#define MICRON(di, page, blocks, planes, name) \
+    {NAND_FLASH_MICRON_MI, di, page, blocks, 64 << (page - 11), planes, 8, 70, 600, 10000, \
+     NAND_CHIP_QUAD | NAND_CHIP_CACHE_READ | NAND_CHIP_ON_DIE_ECC, name}
+
+//all parts have 64 pages per block. NAND_CHIP_CACHE_PROGRAM is only set for a part once a
+//program load during its busy time was read back correctly on it (test_write_behind_read_back),
+//the page cache program bit of the ONFI parameter page does not promise that for SPI parts.
+//NAND_CHIP_DUAL_PLANE_PROGRAM likewise waits for a plane pair read back on the part
+//(test_plane_pair_write_read), a second plane alone does not make the execute program both.
+//NAND_CHIP_ERASE_SUSPEND marks parts whose datasheet has erase suspend and resume with the
+//opcodes of CONFIG_NAND_ERASE_SUSPEND_OPCODE and CONFIG_NAND_ERASE_RESUME_OPCODE.
+static const struct nand_chip_entry chips[] = {
+    WINBOND(WINBOND_DI_AA20, 512, "W25N512GV"),
+    WINBOND(WINBOND_DI_BA20, 512, "W25N512GW"),
+    WINBOND(WINBOND_DI_AA21, 1024, "W25N01GV"),
+    WINBOND(WINBOND_DI_BA21, 1024, "W25N01GW"),
+    WINBOND(WINBOND_DI_BC21, 1024, "W25N01JW"),
+
+    ALLIANCE(ALLIANCE_DI_25, 11, 1024, 64, 1, "AS5F31G04SND-08LIN"),
+    ALLIANCE(ALLIANCE_DI_2E, 11, 2048, 128, 1, "AS5F32G04SND-08LIN"),
+    ALLIANCE(ALLIANCE_DI_8E, 11, 2048, 128, 1, "AS5F12G04SND-10LIN"),
+    ALLIANCE(ALLIANCE_DI_2F, 11, 4096, 128, 2, "AS5F34G04SND-08LIN"),
+    ALLIANCE(ALLIANCE_DI_8F, 11, 4096, 128, 1, "AS5F14G04SND-10LIN"),
+    ALLIANCE(ALLIANCE_DI_2D, 12, 4096, 256, 2, "AS5F38G04SND-08LIN"),
+    ALLIANCE(ALLIANCE_DI_8D, 12, 4096, 256, 1, "AS5F18G04SND-10LIN"),
+
+    GIGADEVICE(GIGADEVICE_DI_21, 1024, 128, 1, "GD5F1G 0x21"),
+    GIGADEVICE(GIGADEVICE_DI_31, 1024, 128, 1, "GD5F1G 0x31"),
+    GIGADEVICE(GIGADEVICE_DI_41, 1024, 128, 1, "GD5F1G 0x41"),
+    GIGADEVICE(GIGADEVICE_DI_51, 1024, 128, 1, "GD5F1G 0x51"),
+    GIGADEVICE(GIGADEVICE_DI_22, 2048, 128, 2, "GD5F2G 0x22"),
+    GIGADEVICE(GIGADEVICE_DI_32, 2048, 128, 2, "GD5F2G 0x32"),
+    GIGADEVICE(GIGADEVICE_DI_42, 2048, 128, 2, "GD5F2G 0x42"),
+    GIGADEVICE(GIGADEVICE_DI_52, 2048, 128, 2, "GD5F2G 0x52"),
+    GIGADEVICE(GIGADEVICE_DI_25, 4096, 128, 2, "GD5F4G 0x25"),
+    GIGADEVICE(GIGADEVICE_DI_35, 4096, 128, 2, "GD5F4G 0x35"),
+    GIGADEVICE(GIGADEVICE_DI_45, 4096, 128, 2, "GD5F4G 0x45"),
+    GIGADEVICE(GIGADEVICE_DI_55, 4096, 128, 2, "GD5F4G 0x55"),
+
+    //Micron parts carry an ONFI parameter page, the table is the fallback
+    MICRON(MICRON_DI_A1, 11, 1024, 1, "MT29F1G08ABBDA"),
+    MICRON(MICRON_DI_F1, 11, 1024, 1, "MT29F1G08"),
+    MICRON(MICRON_DI_AA, 11, 2048, 2, "MT29F2G08"),
+    MICRON(MICRON_DI_DA, 11, 2048, 2, "MT29F2G08"),
+    MICRON(MICRON_DI_AC, 11, 4096, 2, "MT29F4G08ABBDA"),
+    MICRON(MICRON_DI_DC, 11, 4096, 2, "MT29F4G08"),
+    MICRON(MICRON_DI_A3, 11, 8192, 2, "MT29F8G08ADBDA"),
+    MICRON(MICRON_DI_35, 12, 2048, 2, "MT29F4G01"),
+    MICRON(MICRON_DI_47, 12, 4096, 2, "MT29F8G01"),
+    MICRON(MICRON_DI_38, 11, 0, 1, "MT29F8G08AB"),
+    MICRON(MICRON_DI_48, 11, 0, 1, "MT29F"),
+    MICRON(MICRON_DI_68, 11, 0, 1, "MT29F"),
+    MICRON(MICRON_DI_A8, 11, 0, 1, "MT29F256G08"),
+    MICRON(MICRON_DI_D3, 11, 0, 1, "MT29F"),
+    MICRON(MICRON_DI_D5, 11, 0, 1, "MT29F"),
+    MICRON(MICRON_DI_D7, 11, 0, 1, "MT29F64G08TAA"),
+};
+
+
+/**
+ * @brief Read the parameter page, the first of the redundant copies with a valid checksum wins.
+ */
+static int read_param_page(struct nand_chip_info *info)
+{
+    static uint8_t page[NAND_PARAM_PAGE_SIZE * NAND_PARAM_PAGE_COPIES];
+
+    if (nand_read_parameter_page(page, sizeof(page)) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < NAND_PARAM_PAGE_COPIES; i++) {
+        if (nand_chip_parse_param_page(page + i * NAND_PARAM_PAGE_SIZE, info) == 0) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+static int read_id(const nand_transaction_t *template, uint8_t *id, uint32_t len)
+{
+    nand_transaction_t t = *template;
+
+    t.miso_len = len;
+    t.miso_data = id;
+    return my_nand_handle->transceive(&t);
+}
+
+
+int nand_chip_identify(struct nand_chip_info *info)
+{
+    uint8_t manufacturer_id;
+    uint8_t device_id[2] = {0};
+    const struct nand_vendor *vendor = NULL;
+    const struct nand_chip_entry *entry = NULL;
+
+    // address 0 normally selects the manufacturer id. Some chips ignore it, but still expect 8 dummy bits here
+    const nand_transaction_t mi_read = {
+        .command = CMD_READ_ID,
+        .address = MANUFACTURER_ADDR_READ,
+        .address_bytes = 1,
+    };
+    int err = read_id(&mi_read, &manufacturer_id, 1);
+    if (err != 0) {
+        my_nand_handle->log("Failed to read manufacturer ID, error", true, true, err);
+        return -1;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(vendors); i++) {
+        if (vendors[i].manufacturer_id == manufacturer_id) {
+            vendor = &vendors[i];
+        }
+    }
+    if (vendor == NULL) {
+        my_nand_handle->log("Invalid manufacturer ID", true, true, manufacturer_id);
+        return -1;
+    }
+
+    const nand_transaction_t di_read = {
+        .command = CMD_READ_ID,
+        .address = DEVICE_ADDR_READ,
+        .address_bytes = vendor->address_bytes,
+        .dummy_bytes = vendor->dummy_bytes,
+    };
+    err = read_id(&di_read, device_id, vendor->id_len);
+    if (err != 0) {
+        my_nand_handle->log("Failed to read device ID, error", true, true, err);
+        return -1;
+    }
+
+    memset(info, 0, sizeof(*info));
+    info->manufacturer_id = manufacturer_id;
+    info->device_id = vendor->id_len == 2 ? (device_id[0] << 8) | device_id[1] : device_id[0];
+
+    for (size_t i = 0; i < ARRAY_SIZE(chips); i++) {
+        if (chips[i].manufacturer_id == manufacturer_id && chips[i].device_id == info->device_id) {
+            entry = &chips[i];
+        }
+    }
+
+    if (entry != NULL) {
+        strncpy(info->name, entry->name, sizeof(info->name) - 1);
+        info->log2_page_size = entry->log2_page_size;
+        info->log2_ppb = 6;
+        info->num_blocks = entry->num_blocks;
+        info->oob_size = entry->oob_size;
+        info->planes = entry->planes;
+        info->ecc_bits = entry->ecc_bits;
+        info->t_r_us = entry->t_r_us;
+        info->t_prog_us = entry->t_prog_us;
+        info->t_bers_us = entry->t_bers_us;
+        info->features = entry->features;
+    }
+
+    if (read_param_page(info) != 0 && entry == NULL) {
+        my_nand_handle->log("Invalid device ID", true, true, info->device_id);
+        return -1;
+    }
+
+    if (info->num_blocks == 0) {
+        my_nand_handle->log("No parameter page, unknown number of blocks for device ID", true, true, info->device_id);
+        return -1;
+    }
+
+    if (info->t_r_us == 0) {
+        info->t_r_us = DEFAULT_T_R_US;
+    }
+    if (info->t_prog_us == 0) {
+        info->t_prog_us = DEFAULT_T_PROG_US;
+    }
+    if (info->t_bers_us == 0) {
+        info->t_bers_us = DEFAULT_T_BERS_US;
+    }
+
+    my_nand_handle->log("Automatic recognition of flash", false, false, 0);
+    my_nand_handle->log(info->name, false, true, info->num_blocks);
+    if ((info->features & NAND_CHIP_PARAM_PAGE) == 0) {
+        my_nand_handle->log("No parameter page, using the device table for ID", false, true, info->device_id);
+    }
+
+    return 0;
+}
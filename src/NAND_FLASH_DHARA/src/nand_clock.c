@@ -0,0 +1,171 @@
+/**
+ * @file nand_clock.c
+ * @brief Calibration of the SPI clock of the NAND chips, see nand_clock.h
+ *
+ * The test patterns only go to the cache of the chip, no page is programmed. The cache
+ * is written and read with the same commands and byte counts as the page data, so a
+ * clock that moves the patterns without error also moves the pages.
+ */
+
+#ifdef CONFIG_NAND_CLOCK_CALIBRATION
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include "../inc/nand_driver.h"
+#include "../inc/nand_top_layer.h"
+#include "../inc/nand_clock.h"
+
+#define CLOCK_PATTERN_LEN   256 //not METADATA_SIZE, the metadata buffer of nand_read() stays out
+#define CLOCK_PATTERNS      4
+#define CLOCK_PATTERN_COLUMN 0
+
+//steps of the calibration, slowest first
+static const uint32_t clock_steps[] = {
+    1000000,
+    5000000,
+    10000000,
+    20000000,
+    25000000,
+    33000000,
+    40000000,
+    50000000,
+    66000000,
+    80000000,
+    104000000,
+};
+
+static uint8_t pattern_out[CLOCK_PATTERN_LEN];
+static uint8_t pattern_in[CLOCK_PATTERN_LEN];
+
+static uint32_t clock_hz;
+static uint32_t anomalies;
+
+
+static void fill_pattern(int pattern, uint8_t *dst, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        switch (pattern) {
+        case 0: //every bit toggles from byte to byte
+            dst[i] = (i & 1) ? 0xAA : 0x55;
+            break;
+        case 1: //long runs of one level followed by a full swing
+            dst[i] = (i & 8) ? 0xFF : 0x00;
+            break;
+        case 2: //walking one
+            dst[i] = 1 << (i & 7);
+            break;
+        default: //counter, catches shifted or dropped bytes
+            dst[i] = (uint8_t)(i ^ (i >> 8) ^ 0x3C);
+            break;
+        }
+    }
+}
+
+
+/**
+ * @brief Check the selected chip at the current clock.
+ *
+ * @return 0 if the ID and all patterns came back unchanged.
+ */
+static int verify_chip(uint8_t manufacturer_id)
+{
+    uint8_t id = 0;
+
+    if (nand_manufacturer_id(&id) != 0 || id != manufacturer_id) {
+        return -1;
+    }
+
+    for (int pattern = 0; pattern < CLOCK_PATTERNS; pattern++) {
+        fill_pattern(pattern, pattern_out, sizeof(pattern_out));
+        memset(pattern_in, 0, sizeof(pattern_in));
+
+        if (nand_program_load(pattern_out, CLOCK_PATTERN_COLUMN, sizeof(pattern_out)) != 0 ||
+            nand_read(pattern_in, CLOCK_PATTERN_COLUMN, sizeof(pattern_in)) != 0) {
+            return -1;
+        }
+        if (memcmp(pattern_in, pattern_out, sizeof(pattern_in)) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int verify_all_chips(const struct nand_flash_device_t *dev)
+{
+    const int flashes = my_nand_handle->number_of_flashes > 1 ? my_nand_handle->number_of_flashes : 1;
+    int ret = 0;
+
+    for (int i = 0; i < flashes && ret == 0; i++) {
+        my_nand_handle->active_flash = i;
+        ret = verify_chip(dev->chip.manufacturer_id);
+    }
+
+    my_nand_handle->active_flash = 0;
+    return ret;
+}
+
+
+int nand_clock_calibrate(struct nand_flash_device_t *dev)
+{
+    int highest = -1;
+
+    if (my_nand_handle->set_frequency == NULL) {
+        my_nand_handle->log("NAND CLOCK: no set_frequency in the handle, clock not calibrated", false, false, 0);
+        return 0;
+    }
+
+    //the first failing step ends the search, the steps above it are not reliable either
+    for (int i = 0; i < (int)ARRAY_SIZE(clock_steps) && clock_steps[i] <= CONFIG_NAND_CLOCK_MAX_HZ; i++) {
+        if (my_nand_handle->set_frequency(clock_steps[i]) != 0 || verify_all_chips(dev) != 0) {
+            break;
+        }
+        highest = i;
+    }
+
+    anomalies = 0;
+
+    if (highest < 0) {
+        clock_hz = clock_steps[0];
+        my_nand_handle->set_frequency(clock_hz);
+        my_nand_handle->log("NAND CLOCK: no clock passed, using the slowest [Hz]", true, true, clock_hz);
+        return -1;
+    }
+
+    clock_hz = clock_steps[MAX(highest - CONFIG_NAND_CLOCK_MARGIN_STEPS, 0)];
+    my_nand_handle->set_frequency(clock_hz);
+    my_nand_handle->log("NAND CLOCK: highest passing clock [Hz]", false, true, clock_steps[highest]);
+    my_nand_handle->log("NAND CLOCK: SPI clock set to [Hz]", false, true, clock_hz);
+    return 0;
+}
+
+
+void nand_clock_report_anomaly(void)
+{
+    anomalies++;
+}
+
+
+void nand_clock_service(struct nand_flash_device_t *dev)
+{
+    if (CONFIG_NAND_CLOCK_ANOMALY_LIMIT == 0 || anomalies < CONFIG_NAND_CLOCK_ANOMALY_LIMIT) {
+        return;
+    }
+
+    my_nand_handle->log("NAND CLOCK: calibrating again after anomalies", false, true, anomalies);
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    //the patterns overwrite the cache, the page programming behind the last write goes first
+    nand_write_behind_finish();
+#endif
+    (void)nand_clock_calibrate(dev);
+}
+
+
+uint32_t nand_clock_get_hz(void)
+{
+    return clock_hz;
+}
+
+#endif // CONFIG_NAND_CLOCK_CALIBRATION
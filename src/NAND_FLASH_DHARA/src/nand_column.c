@@ -0,0 +1,32 @@
+/**
+ * @file nand_column.c
+ * @brief Column addressing of the cache commands, see nand_column.h
+ */
+
+#include "../inc/nand_column.h"
+
+
+uint32_t nand_column_address(uint16_t column, uint8_t plane, uint8_t log2_page_size)
+{
+    const uint16_t col = column | (uint16_t)(plane << (log2_page_size + 1));
+
+    return ((col & 0x00FF) << 8) | ((col & 0xFF00) >> 8); // big to small endian
+}
+
+
+uint32_t nand_pair_column(uint32_t column, uint8_t log2_page_size, uint16_t oob_size,
+                          uint16_t *chip_column, uint8_t *plane)
+{
+    const uint32_t half = 1U << log2_page_size;
+
+    if (column < 2 * half) {
+        *plane = column >= half;
+        *chip_column = column - *plane * half;
+        return half - *chip_column;
+    }
+
+    const uint32_t spare = column - 2 * half;
+    *plane = spare >= oob_size;
+    *chip_column = half + spare - *plane * oob_size;
+    return *plane ? UINT16_MAX : half + oob_size - *chip_column;
+}
@@ -11,7 +11,10 @@
 #include <stdint.h>
 
 #include "../inc/nand_driver.h"
+#include "../inc/nand_column.h"
 #include "../inc/example_handle.h"
+#include "../inc/nand_stats.h"
+#include "../inc/nand_trace.h"
 
 /**
  * S5F14G04SND-10LIN
@@ -64,32 +67,337 @@ static void store_in_buffer(uint8_t *data, uint32_t page_address, uint16_t colum
 
 
 
-uint32_t convert_address(uint32_t page){
-    if (my_nand_handle && my_nand_handle->number_of_flashes != 1) {
-        return page - (my_nand_handle->number_of_flashes * device_handle->block_size * device_handle->num_blocks);
+// Forget the buffered metadata of an erased block
+static void invalidate_block_in_buffer(uint32_t page_address) {
+    const uint32_t block_mask = ~((1U << device_handle->dhara_nand.log2_ppb) - 1);
+
+    for (uint8_t i = 0; i < CONFIG_DHARA_METADATA_BUFFER_SIZE; i++) {
+        if ((metadata_buffer[i].page_address & block_mask) == (page_address & block_mask)) {
+            metadata_buffer[i].page_address = 0;
+        }
     }
-    return page;
 }
 
 
 #endif //CONFIG_DHARA_METADATA_BUFFER
 
-//address_bytes = 0
-int nand_write_enable(void)
+
+
+static inline int flash_count(void)
 {
-    nand_transaction_t  t = {
-        .command = CMD_WRITE_ENABLE
-    };
+    return (my_nand_handle && my_nand_handle->number_of_flashes > 1) ? my_nand_handle->number_of_flashes : 1;
+}
+
+int nand_stripe_width(void)
+{
+    const int flashes = flash_count();
+
+    //the pages of a block alternate between the chips, other counts interleave whole blocks
+    return (flashes & (flashes - 1)) == 0 ? flashes : 1;
+}
 
-    if (my_nand_handle && my_nand_handle->transceive) {
-        return my_nand_handle->transceive(&t);
-    } else {
+/**
+ * @brief Hand a transaction to the transceive function of the handle.
+ *
+ * Every SPI transaction of the driver goes through here.
+ */
+static int nand_transceive(nand_transaction_t *t)
+{
+    if (!my_nand_handle || !my_nand_handle->transceive) {
         // Handle error if the function pointer is not set
         if (my_nand_handle && my_nand_handle->log) {
             my_nand_handle->log("Transceive function pointer not set", true, false, 0);
         }
         return -1;
     }
+
+#if defined(CONFIG_NAND_STATS) || defined(CONFIG_NAND_TRACE)
+    const uint32_t start = k_cycle_get_32();
+    const uint32_t bytes = t->mosi_len + t->miso_len;
+    int ret = my_nand_handle->transceive(t);
+
+#ifdef CONFIG_NAND_STATS
+    nand_stats_record_transceive(t->command, k_cycle_get_32() - start, bytes, ret);
+#endif
+    //the address is logged as sent on the bus, i.e. byte swapped
+    NAND_TRACE_END(NAND_TRACE_CMD, t->command, ((uint32_t)my_nand_handle->active_flash << 24) | (t->address & 0xFFFFFF),
+                   MIN(bytes, UINT16_MAX), start);
+    return ret;
+#else
+    return my_nand_handle->transceive(t);
+#endif
+}
+
+
+/**
+ * @brief Hand a sequence of transactions for one chip to the handle.
+ *
+ * Uses transceive_batch of the handle if it has one, otherwise the transactions
+ * are sent one by one. Stops at the first failure.
+ */
+static int nand_transceive_batch(nand_transaction_t *t, size_t count)
+{
+    if (!my_nand_handle || !my_nand_handle->transceive_batch) {
+        int ret = 0;
+        for (size_t i = 0; i < count && ret == 0; i++) {
+            ret = nand_transceive(&t[i]);
+        }
+        return ret;
+    }
+
+#if defined(CONFIG_NAND_STATS) || defined(CONFIG_NAND_TRACE)
+    const uint32_t start = k_cycle_get_32();
+    int ret = my_nand_handle->transceive_batch(t, count);
+    const uint32_t cycles = k_cycle_get_32() - start;
+
+    //the batch is timed as a whole, its commands share the time
+    for (size_t i = 0; i < count; i++) {
+        const uint32_t bytes = t[i].mosi_len + t[i].miso_len;
+#ifdef CONFIG_NAND_STATS
+        nand_stats_record_transceive(t[i].command, cycles / count, bytes, ret);
+#endif
+        NAND_TRACE_END(NAND_TRACE_CMD, t[i].command, ((uint32_t)my_nand_handle->active_flash << 24) | (t[i].address & 0xFFFFFF),
+                       MIN(bytes, UINT16_MAX), start);
+    }
+    ARG_UNUSED(cycles);
+    return ret;
+#else
+    return my_nand_handle->transceive_batch(t, count);
+#endif
+}
+
+//most transactions of one batch: write enable, the 4 pieces of a plane pair load, program execute
+#define NAND_BATCH_MAX 6
+
+
+//plane of the last routed page on a 2-plane chip, the column commands address its cache
+static uint8_t cache_plane = 0;
+
+#ifdef CONFIG_NAND_PLANE_PAIRS
+//status after the plane 0 half of the last plane pair page read, see nand_pair_status()
+static uint8_t pair_status = 0;
+#endif
+
+static inline bool plane_pairs(void)
+{
+#ifdef CONFIG_NAND_PLANE_PAIRS
+    return device_handle->plane_pairs;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Translate a striped page number into the page number on its chip.
+ *
+ * With a power of two chip count N the pages are interleaved: page p lives on chip
+ * p % N as page p / N, a dhara block spans the same block of every chip. Otherwise
+ * blocks are interleaved: block b lives on chip b % N as block b / N. With plane pairs
+ * the block on the chip is the plane 0 block of the pair, the column decides the plane.
+ *
+ * @param[out] flash Chip of the page.
+ */
+static uint32_t chip_page(uint32_t page, uint8_t *flash)
+{
+    const int flashes = flash_count();
+    const int width = nand_stripe_width();
+    const uint8_t log2_ppb = device_handle->chip.log2_ppb;
+    const uint32_t offset_mask = (1U << log2_ppb) - 1;
+    uint32_t block;
+
+    *flash = 0;
+    if (width > 1) {
+        *flash = page & (width - 1);
+        page >>= __builtin_ctz(width);
+    }
+
+    block = page >> log2_ppb;
+    if (width == 1 && flashes > 1) {
+        *flash = block % flashes;
+        block /= flashes;
+    }
+    if (plane_pairs()) {
+        block *= 2;
+    }
+
+    return (block << log2_ppb) | (page & offset_mask);
+}
+
+
+/**
+ * @brief Select the chip of a striped page and the plane of its block.
+ *
+ * @return page number on the chip.
+ */
+static uint32_t route_page(uint32_t page)
+{
+    uint8_t flash;
+
+    page = chip_page(page, &flash);
+    if (flash_count() > 1) {
+        my_nand_handle->active_flash = flash;
+    }
+
+    cache_plane = device_handle->chip.planes > 1 ? ((page >> device_handle->chip.log2_ppb) & 1) : 0;
+    return page;
+}
+
+
+/**
+ * @brief Row address of a page as sent on the bus.
+ */
+static inline uint32_t row_address(uint32_t page)
+{
+    return ((page & 0x00FF0000) >> 16) |  // Move A23-A16 to the correct position (middle byte)
+           ((page & 0x0000FF00))       |  // Keep A15-A8 in its place
+           ((page & 0x000000FF) << 16);   // Move A7-A0 to the top position
+}
+
+
+/**
+ * @brief Column address as sent on the bus, with the plane select bit above the spare area.
+ */
+static inline uint32_t column_address(uint16_t column, uint8_t plane)
+{
+    return nand_column_address(column, plane, device_handle->chip.log2_page_size);
+}
+
+
+/**
+ * @brief Where a column of the page seen by dhara lies on the chip.
+ *
+ * With plane pairs see nand_pair_column(). Otherwise the column is passed on with the
+ * plane of the last routed page.
+ *
+ * @return number of bytes from column to the end of its piece.
+ */
+static uint32_t locate_column(uint32_t column, uint16_t *chip_column, uint8_t *plane)
+{
+    if (plane_pairs()) {
+        return nand_pair_column(column, device_handle->chip.log2_page_size, device_handle->chip.oob_size,
+                                chip_column, plane);
+    }
+
+    *plane = cache_plane;
+    *chip_column = column;
+    return UINT16_MAX;
+}
+
+
+/**
+ * @brief Build the transactions of a column command (cache read or program load), split at the plane pieces.
+ *
+ * With plane pairs a CMD_PROGRAM_LOAD resets the cache of both planes: the first piece
+ * of each plane uses it, the following pieces continue with CMD_PROGRAM_LOAD_RAND and a
+ * plane without data gets an empty load.
+ *
+ * @param[out] t Room for NAND_BATCH_MAX - 2 transactions.
+ * @return number of transactions.
+ */
+static size_t column_transactions(uint8_t command, uint16_t column, uint8_t *miso, const uint8_t *mosi, uint16_t length,
+                                  nand_transaction_t *t)
+{
+    uint8_t loaded = 0;//planes whose cache was reset by this command
+    size_t count = 0;
+
+    do {
+        uint16_t chip_column;
+        uint8_t plane;
+        const uint16_t len = MIN(length, locate_column(column, &chip_column, &plane));
+        const bool reset = command == CMD_PROGRAM_LOAD && (loaded & BIT(plane)) == 0;
+
+        t[count] = (nand_transaction_t){
+            .command = (command == CMD_PROGRAM_LOAD && !reset) ? CMD_PROGRAM_LOAD_RAND : command,
+            .address_bytes = 2,
+            .address = column_address(chip_column, plane),
+            .dummy_bytes = miso ? 1 : 0
+        };
+        if (miso) {
+            t[count].miso_len = len;
+            t[count].miso_data = miso;
+            miso += len;
+        } else {
+            t[count].mosi_len = len;//(N+1)*8+24
+            t[count].mosi_data = mosi;
+            mosi += len;
+        }
+        loaded |= reset ? BIT(plane) : 0;
+        count++;
+
+        column += len;
+        length -= len;
+    } while (length > 0);
+
+    if (command == CMD_PROGRAM_LOAD && plane_pairs()) {
+        for (uint8_t plane = 0; plane < 2; plane++) {
+            if ((loaded & BIT(plane)) == 0) {
+                t[count++] = (nand_transaction_t){
+                    .command = CMD_PROGRAM_LOAD,
+                    .address_bytes = 2,
+                    .address = column_address(0, plane)
+                };
+            }
+        }
+    }
+
+    return count;
+}
+
+
+/**
+ * @brief Issue a column command (cache read or program load), see column_transactions().
+ */
+static int column_command(uint8_t command, uint16_t column, uint8_t *miso, const uint8_t *mosi, uint16_t length)
+{
+    nand_transaction_t t[NAND_BATCH_MAX];
+
+    return nand_transceive_batch(t, column_transactions(command, column, miso, mosi, length, t));
+}
+
+
+void nand_select_flash(uint32_t page)
+{
+    (void)route_page(page);
+}
+
+
+int nand_same_flash(uint32_t a, uint32_t b)
+{
+    uint8_t flash_a;
+    uint8_t flash_b;
+
+    (void)chip_page(a, &flash_a);
+    (void)chip_page(b, &flash_b);
+    return flash_a == flash_b;
+}
+
+
+int nand_copy_back_possible(uint32_t src, uint32_t dst)
+{
+    const uint8_t log2_ppb = device_handle->chip.log2_ppb;
+    uint8_t src_flash;
+    uint8_t dst_flash;
+    const uint32_t src_page = chip_page(src, &src_flash);
+    const uint32_t dst_page = chip_page(dst, &dst_flash);
+
+    if (src_flash != dst_flash) {
+        return 0;
+    }
+
+    //a 2-plane chip copies within a plane only, plane pairs keep the plane of every half
+    return plane_pairs() || device_handle->chip.planes < 2 ||
+           ((src_page >> log2_ppb) & 1) == ((dst_page >> log2_ppb) & 1);
+}
+
+
+//address_bytes = 0
+int nand_write_enable(void)
+{
+    nand_transaction_t  t = {
+        .command = CMD_WRITE_ENABLE
+    };
+
+    return nand_transceive(&t);
 }
 
 
@@ -106,15 +414,7 @@ int nand_read_register(uint8_t reg, uint8_t *val)
         .miso_data = val
     };
 
-    if (my_nand_handle && my_nand_handle->transceive) {
-        return my_nand_handle->transceive(&t);
-    } else {
-        // Handle error if the function pointer is not set
-        if (my_nand_handle && my_nand_handle->log) {
-            my_nand_handle->log("Transceive function pointer not set", true, false, 0);
-        }
-        return -1;
-    }
+    return nand_transceive(&t);
 }
 
 int nand_write_register(uint8_t reg, uint8_t val)
@@ -127,15 +427,7 @@ int nand_write_register(uint8_t reg, uint8_t val)
         .mosi_data = &val
     };
 
-    if (my_nand_handle && my_nand_handle->transceive) {
-        return my_nand_handle->transceive(&t);
-    } else {
-        // Handle error if the function pointer is not set
-        if (my_nand_handle && my_nand_handle->log) {
-            my_nand_handle->log("Transceive function pointer not set", true, false, 0);
-        }
-        return -1;
-    }
+    return nand_transceive(&t);
 }
 
 int nand_device_id(uint8_t *device_id){
@@ -148,15 +440,20 @@ int nand_device_id(uint8_t *device_id){
         .miso_data = device_id,
     };
 
-    if (my_nand_handle && my_nand_handle->transceive) {
-        return my_nand_handle->transceive(&t);
-    } else {
-        // Handle error if the function pointer is not set
-        if (my_nand_handle && my_nand_handle->log) {
-            my_nand_handle->log("Transceive function pointer not set", true, false, 0);
-        }
-        return -1;
-    }
+    return nand_transceive(&t);
+}
+
+int nand_manufacturer_id(uint8_t *manufacturer_id){
+
+    nand_transaction_t  t = {
+        .command = CMD_READ_ID,
+        .address_bytes = 1,
+        .address = MANUFACTURER_ADDR_READ,
+        .miso_len = 1,
+        .miso_data = manufacturer_id,
+    };
+
+    return nand_transceive(&t);
 }
 
 
@@ -174,57 +471,30 @@ int nand_read(uint8_t *data, uint16_t column, uint16_t length) {
     }
     #endif //CONFIG_DHARA_METADATA_BUFFER
 
-    nand_transaction_t t = {
-        .command = CMD_READ_FAST,
-        .address_bytes = 2,
-        .address = ((column & 0x00FF) << 8) | ((column & 0xFF00) >> 8), // big to small endian
-        .miso_len = length, // usually 2 bytes
-        .miso_data = data,
-        .dummy_bytes = 1
-    };
-
     //  my_nand_handle->log("OPER: Reading start at column", false, true, column);
     //  my_nand_handle->log("OPER: Reading length", false, true, length);
 
-    if (my_nand_handle && my_nand_handle->transceive) {
-        int result = my_nand_handle->transceive(&t);
-        #ifdef CONFIG_DHARA_METADATA_BUFFER
-        if (result == 0 && length == METADATA_SIZE && last_read_page_in_NAND_cache != 0) {
-            // Store the metadata in the buffer
-            store_in_buffer(data, last_read_page_in_NAND_cache, column);
-        }
-        #endif //CONFIG_DHARA_METADATA_BUFFER
-        return result;
-    } else {
-        // Handle error if the function pointer is not set
-        if (my_nand_handle && my_nand_handle->log) {
-            my_nand_handle->log("Transceive function pointer not set", true, false, 0);
-        }
-        return -1;
+    int result = column_command(CMD_READ_FAST, column, data, NULL, length);
+    #ifdef CONFIG_DHARA_METADATA_BUFFER
+    if (result == 0 && length == METADATA_SIZE && last_read_page_in_NAND_cache != 0) {
+        // Store the metadata in the buffer
+        store_in_buffer(data, last_read_page_in_NAND_cache, column);
     }
+    #endif //CONFIG_DHARA_METADATA_BUFFER
+    return result;
 }
 
 int nand_program_load(const uint8_t *data, uint16_t column, uint16_t length)
 {
     //last_read_page_in_NAND_cache = 0;
-    nand_transaction_t  t = {
-        .command = CMD_PROGRAM_LOAD,
-        .address_bytes = 2,
-        .address = ((column & 0x00FF) << 8) | ((column & 0xFF00) >> 8),
-        .mosi_len = length,//(N+1)*8+24
-        .mosi_data = data
-    };
     //my_nand_handle->log("OPER: Loading start at column", false, true, column);
     //my_nand_handle->log("OPER: Loading length", false, true, length);
-    if (my_nand_handle && my_nand_handle->transceive) {
-        return my_nand_handle->transceive(&t);
-    } else {
-        // Handle error if the function pointer is not set
-        if (my_nand_handle && my_nand_handle->log) {
-            my_nand_handle->log("Transceive function pointer not set", true, false, 0);
-        }
-        return -1;
-    }
+    return column_command(CMD_PROGRAM_LOAD, column, NULL, data, length);
+}
+
+int nand_program_load_random(const uint8_t *data, uint16_t column, uint16_t length)
+{
+    return column_command(CMD_PROGRAM_LOAD_RAND, column, NULL, data, length);
 }
 
 
@@ -237,73 +507,249 @@ int nand_read_page(uint32_t page)
     // if(last_read_page_in_NAND_cache == page && page != 0){
     //     return 0;    
     // }
-    page = convert_address(page);
-
+    //the metadata buffer is keyed by the striped page number, which is unique across chips
     last_read_page_in_NAND_cache = page;
+    page = route_page(page);
+
     nand_transaction_t  t = {
         .command = CMD_PAGE_READ,
         .address_bytes = 3,
-        .address = ((page & 0x00FF0000) >> 16) |  // Move A23-A16 to the correct position (middle byte)
-                   ((page & 0x0000FF00))       |  // Keep A15-A8 in its place
-                   ((page & 0x000000FF) << 16)   // Move A7-A0 to the top position
+        .address = row_address(page)
     };
     //my_nand_handle->log("OPER: Reading page", false, true, page);
-    if (my_nand_handle && my_nand_handle->transceive) {
-        return my_nand_handle->transceive(&t);
-    } else {
-        // Handle error if the function pointer is not set
-        if (my_nand_handle && my_nand_handle->log) {
-            my_nand_handle->log("Transceive function pointer not set", true, false, 0);
+#ifdef CONFIG_NAND_PLANE_PAIRS
+    if (plane_pairs()) {
+        //every plane reads into its own cache, plane 1 is left loading for the caller's wait
+        int ret = nand_transceive(&t);
+        if (ret == 0) {
+            ret = wait_for_ready(&pair_status);
         }
-        return -1;
+        if (ret != 0) {
+            return ret;
+        }
+        t.address = row_address(page + (1U << device_handle->chip.log2_ppb));
     }
+#endif
+    return nand_transceive(&t);
+}
+
+int nand_enable_and_program_page(uint32_t page, const uint8_t *data, uint16_t column, uint16_t length)
+{
+    nand_transaction_t t[NAND_BATCH_MAX] = {
+        { .command = CMD_WRITE_ENABLE }
+    };
+
+    page = route_page(page);//before the load, it picks the chip and the plane
+    size_t count = 1 + column_transactions(CMD_PROGRAM_LOAD, column, NULL, data, length, &t[1]);
+    t[count++] = (nand_transaction_t){
+        .command = CMD_PROGRAM_EXECUTE,
+        .address_bytes = 3,
+        .address = row_address(page)
+    };
+
+    return nand_transceive_batch(t, count);
 }
 
 int nand_program_execute(uint32_t page)
 {
-    page = convert_address(page);
+    page = route_page(page);
+    //with plane pairs the execute on the plane 0 block programs the caches of both planes
     nand_transaction_t  t = {
         .command = CMD_PROGRAM_EXECUTE,
         .address_bytes = 3,
-        .address = ((page & 0x00FF0000) >> 16) |  // Move A23-A16 to the correct position (middle byte)
-                   ((page & 0x0000FF00))       |  // Keep A15-A8 in its place
-                   ((page & 0x000000FF) << 16)   // Move A7-A0 to the top position
+        .address = row_address(page)
     };
 
     //my_nand_handle->log("OPER: Execution page", false, true, page);
-    if (my_nand_handle && my_nand_handle->transceive) {
-        return my_nand_handle->transceive(&t);
-    } else {
-        // Handle error if the function pointer is not set
-        if (my_nand_handle && my_nand_handle->log) {
-            my_nand_handle->log("Transceive function pointer not set", true, false, 0);
+    return nand_transceive(&t);
+}
+
+/**
+ * @brief Erase the block of a page, with plane pairs the blocks of both planes.
+ *
+ * @param write_enable Send the write enable in the same batch as the erase.
+ */
+static int erase_block(uint32_t page, bool write_enable)
+{
+#ifdef CONFIG_DHARA_METADATA_BUFFER
+    invalidate_block_in_buffer(page);
+#endif
+    page = route_page(page);
+    nand_transaction_t t[2] = {
+        { .command = CMD_WRITE_ENABLE },
+        {
+            .command = CMD_ERASE_BLOCK,
+            .address_bytes = 3,
+            .address = row_address(page)
         }
-        return -1;
+    };
+    nand_transaction_t *first = write_enable ? &t[0] : &t[1];
+
+#ifdef CONFIG_NAND_PLANE_PAIRS
+    if (plane_pairs()) {
+        uint8_t status;
+        int ret = nand_transceive_batch(first, &t[2] - first);
+        if (ret == 0) {
+            ret = wait_for_ready(&status);
+        }
+        if (ret != 0 || (status & STAT_ERASE_FAILED) != 0) {
+            return ret;//a failed erase stays in the status register for the caller's wait
+        }
+
+        //the erase cleared the write enable latch
+        first = &t[0];
+        t[1].address = row_address(page + (1U << device_handle->chip.log2_ppb));
     }
+#endif
+    return nand_transceive_batch(first, &t[2] - first);
 }
 
 int nand_erase_block(uint32_t page)
 {
-    page = convert_address(page);
-    nand_transaction_t  t = {
-        .command = CMD_ERASE_BLOCK,
-        .address_bytes = 3,
-        .address = ((page & 0x00FF0000) >> 16) |  // Move A23-A16 to the correct position (middle byte)
-                   ((page & 0x0000FF00))       |  // Keep A15-A8 in its place
-                   ((page & 0x000000FF) << 16)   // Move A7-A0 to the top position
+    return erase_block(page, false);
+}
+
+int nand_enable_and_erase_block(uint32_t page)
+{
+    return erase_block(page, true);
+}
+
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+int nand_erase_suspend(void)
+{
+    nand_transaction_t t = {
+        .command = CMD_ERASE_SUSPEND,
     };
 
-    if (my_nand_handle && my_nand_handle->transceive) {
-        return my_nand_handle->transceive(&t);
-    } else {
-        // Handle error if the function pointer is not set
-        if (my_nand_handle && my_nand_handle->log) {
-            my_nand_handle->log("Transceive function pointer not set", true, false, 0);
-        }
-        return -1;
+    return nand_transceive(&t);
+}
+
+int nand_erase_resume(void)
+{
+    nand_transaction_t t = {
+        .command = CMD_ERASE_RESUME,
+    };
+
+    return nand_transceive(&t);
+}
+#endif
+
+
+#ifdef CONFIG_NAND_PLANE_PAIRS
+uint8_t nand_pair_status(uint8_t status)
+{
+    const uint8_t ecc_mask = STAT_ECC0 | STAT_ECC1;
+    const uint8_t uncorrectable = STAT_ECC1;
+
+    if (!plane_pairs()) {
+        return status;
     }
+
+    const uint8_t plane_0 = pair_status & ecc_mask;
+    const uint8_t plane_1 = status & ecc_mask;
+    const uint8_t worst = (plane_0 == uncorrectable || plane_1 == uncorrectable) ? uncorrectable : MAX(plane_0, plane_1);
+
+    return (status & ~ecc_mask) | worst;
 }
+#endif
 
 
 
+int nand_read_parameter_page(uint8_t *data, uint16_t length)
+{
+    uint8_t config;
+    int ret = nand_read_register(REG_CONFIG, &config);
+    if (ret != 0) {
+        return ret;
+    }
+
+    //the redundant copies protect the page, the on-die ECC would only garble it
+    ret = nand_write_register(REG_CONFIG, (config | CFG_OTP_ENABLE) & ~CFG_ECC_ENABLE);
+    if (ret == 0) {
+        nand_transaction_t t = {
+            .command = CMD_PAGE_READ,
+            .address_bytes = 3,
+            .address = (PARAMETER_PAGE & 0xFF) << 16 // A7-A0 to the top position, as in nand_read_page()
+        };
+        last_read_page_in_NAND_cache = 0;//the cache no longer holds an array page
+        cache_plane = 0;
+        ret = nand_transceive(&t);
+    }
+    if (ret == 0) {
+        ret = wait_for_ready(NULL);
+    }
+    if (ret == 0) {
+        ret = nand_read(data, 0, length);
+    }
 
+    //restore even after a failure, the chip would stay in the OTP area otherwise
+    const int restore = nand_write_register(REG_CONFIG, config);
+    return ret != 0 ? ret : restore;
+}
+
+
+
+#ifdef CONFIG_NAND_CACHE_READ
+//address_bytes = 0, the cache read commands continue with the page after the last one
+
+static int nand_read_cache_step(uint8_t command)
+{
+    nand_transaction_t t = {
+        .command = command
+    };
+    return nand_transceive(&t);
+}
+
+int nand_read_pages_seq(uint32_t first, uint32_t count, nand_page_cb_t cb, void *arg)
+{
+    const uint8_t log2_ppb = device_handle->dhara_nand.log2_ppb;
+    uint8_t status;
+    int ret = 0;
+
+    //the sequence stays on one chip, interleaved pages alternate between the chips
+    if ((device_handle->chip.features & NAND_CHIP_CACHE_READ) == 0 || plane_pairs() || nand_stripe_width() > 1 ||
+        count < 2 || (first >> log2_ppb) != ((first + count - 1) >> log2_ppb)) {
+        for (uint32_t i = 0; i < count && ret == 0; i++) {
+            ret = nand_read_page(first + i);
+            if (ret == 0) {
+                ret = wait_for_ready(&status);
+            }
+#ifdef CONFIG_NAND_PLANE_PAIRS
+            status = nand_pair_status(status);
+#endif
+            if (ret == 0) {
+                ret = cb(first + i, status, arg);
+            }
+        }
+        return ret;
+    }
+
+    ret = nand_read_page(first);
+    if (ret == 0) {
+        ret = wait_for_ready(NULL);
+    }
+
+    bool ended = true;
+    for (uint32_t i = 0; i < count && ret == 0; i++) {
+        const bool last = i == count - 1;
+
+        ret = nand_read_cache_step(last ? CMD_READ_CACHE_END : CMD_READ_CACHE_SEQ);
+        ended = last;
+        if (ret == 0) {
+            ret = wait_for_ready(&status);
+        }
+        if (ret == 0) {
+            last_read_page_in_NAND_cache = first + i;
+            ret = cb(first + i, status, arg);
+        }
+    }
+
+    if (!ended) {
+        //the chip still loads the next page, leave the sequence before other commands
+        if (nand_read_cache_step(CMD_READ_CACHE_END) == 0) {
+            wait_for_ready(NULL);
+        }
+    }
+    return ret;
+}
+#endif //CONFIG_NAND_CACHE_READ
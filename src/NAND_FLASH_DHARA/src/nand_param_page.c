@@ -0,0 +1,140 @@
+/**
+ * @file nand_param_page.c
+ * @brief Parsing of the ONFI and JEDEC parameter page, see nand_chip_info.h
+ *
+ * Kept free of Zephyr so the parser and the checksum run in the host tests
+ * (dhara/tests/param_page.c), the page itself is read in nand_chip_info.c.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "../inc/nand_chip_info.h"
+
+#define PARAM_PAGE_CRC_INIT     0x4F4E
+#define PARAM_PAGE_CRC_POLY     0x8005
+#define PARAM_PAGE_CRC_OFFSET   254
+
+//field offsets, the geometry is at the same place in ONFI and JEDEC pages
+#define PP_SIGNATURE            0
+#define PP_OPT_COMMANDS         8   //ONFI: bit 1 read cache
+#define PP_MODEL                44
+#define PP_MODEL_LEN            20
+#define PP_PAGE_SIZE            80
+#define PP_OOB_SIZE             84
+#define PP_PAGES_PER_BLOCK      92
+#define PP_BLOCKS_PER_LUN       96
+#define PP_LUNS                 100
+#define PP_ONFI_PLANE_BITS      110 //bits 3:0, number of plane address bits
+#define PP_ONFI_ECC_BITS        112
+#define PP_ONFI_T_PROG          133
+#define PP_ONFI_T_BERS          135
+#define PP_ONFI_T_R             137
+#define PP_JEDEC_ECC_BITS       144
+
+#define ONFI_OPT_CACHE_READ     (1 << 1)
+
+
+//the parameter page is little endian whatever the MCU is
+static uint16_t get_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+uint16_t nand_param_page_crc(const uint8_t *data, size_t len)
+{
+    uint16_t crc = PARAM_PAGE_CRC_INIT;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ PARAM_PAGE_CRC_POLY) : (uint16_t)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+
+static int log2_exact(uint32_t value, uint8_t min, uint8_t max, uint8_t *log2_out)
+{
+    if (value == 0 || (value & (value - 1)) != 0) {
+        return -1;
+    }
+
+    const uint8_t log2 = (uint8_t)__builtin_ctz(value);
+    if (log2 < min || log2 > max) {
+        return -1;
+    }
+
+    *log2_out = log2;
+    return 0;
+}
+
+
+int nand_chip_parse_param_page(const uint8_t *page, struct nand_chip_info *info)
+{
+    const bool onfi = memcmp(page + PP_SIGNATURE, "ONFI", 4) == 0;
+    const bool jedec = memcmp(page + PP_SIGNATURE, "JESD", 4) == 0;
+    uint8_t log2_page_size;
+    uint8_t log2_ppb;
+
+    if (!onfi && !jedec) {
+        return -1;
+    }
+
+    if (nand_param_page_crc(page, PARAM_PAGE_CRC_OFFSET) != get_le16(page + PARAM_PAGE_CRC_OFFSET)) {
+        return -1;
+    }
+
+    const uint32_t num_blocks = get_le32(page + PP_BLOCKS_PER_LUN) * (page[PP_LUNS] > 1 ? page[PP_LUNS] : 1);
+    if (log2_exact(get_le32(page + PP_PAGE_SIZE), 9, 14, &log2_page_size) != 0 ||
+        log2_exact(get_le32(page + PP_PAGES_PER_BLOCK), 4, 10, &log2_ppb) != 0 ||
+        num_blocks == 0) {
+        return -1;
+    }
+
+    info->log2_page_size = log2_page_size;
+    info->log2_ppb = log2_ppb;
+    info->num_blocks = num_blocks;
+    info->oob_size = get_le16(page + PP_OOB_SIZE);
+    if (onfi) {
+        //more than two planes are driven as two
+        info->planes = (page[PP_ONFI_PLANE_BITS] & 0x0F) != 0 ? 2 : 1;
+    } else if (info->planes == 0) {
+        info->planes = 1;
+    }
+    info->features |= NAND_CHIP_PARAM_PAGE;
+
+    //the model is space padded
+    size_t len = PP_MODEL_LEN;
+    while (len > 0 && page[PP_MODEL + len - 1] == ' ') {
+        len--;
+    }
+    memcpy(info->name, page + PP_MODEL, len);
+    info->name[len] = '\0';
+
+    if (onfi) {
+        const uint16_t commands = get_le16(page + PP_OPT_COMMANDS);
+
+        info->ecc_bits = page[PP_ONFI_ECC_BITS];
+        info->t_prog_us = get_le16(page + PP_ONFI_T_PROG);
+        info->t_bers_us = get_le16(page + PP_ONFI_T_BERS);
+        info->t_r_us = get_le16(page + PP_ONFI_T_R);
+        if (commands & ONFI_OPT_CACHE_READ) {
+            info->features |= NAND_CHIP_CACHE_READ;
+        }
+    } else {
+        //the timings of a JEDEC page are kept from the table
+        info->ecc_bits = page[PP_JEDEC_ECC_BITS];
+    }
+
+    return 0;
+}
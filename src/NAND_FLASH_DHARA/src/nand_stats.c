@@ -0,0 +1,217 @@
+/**
+ * @file nand_stats.c
+ * @brief Latency histograms and operation counters of the NAND stack
+ *
+ * Fed by the SPI choke point in nand_driver.c, the busy waits in nand.c and
+ * the tree walks and garbage collection in the dhara map. Read out with
+ * nand_stats_dump() or the "nand_stats" shell command.
+ */
+
+#ifdef CONFIG_NAND_STATS
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#ifdef CONFIG_NAND_STATS_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "../inc/nand_driver.h"
+#include "../inc/nand_stats.h"
+
+LOG_MODULE_REGISTER(nand_stats, CONFIG_LOG_DEFAULT_LEVEL);
+
+
+static const char *const stats_names[NAND_STATS_ID_COUNT] = {
+    [NAND_STATS_PAGE_READ]   = "page read [cycles]",
+    [NAND_STATS_PROGRAM]     = "program [cycles]",
+    [NAND_STATS_ERASE]       = "erase [cycles]",
+    [NAND_STATS_WAIT_SPINS]  = "busy wait [polls]",
+    [NAND_STATS_TRACE_DEPTH] = "trace_path [meta reads]",
+    [NAND_STATS_META_READ]   = "meta read [cycles]",
+    [NAND_STATS_GC_COPY]     = "gc copy [cycles]",
+    [NAND_STATS_SYNC_PAD]    = "sync pad [cycles]",
+};
+
+//the commands the driver issues, everything else is counted as "other"
+static const struct {
+    uint8_t command;
+    const char *name;
+} transceive_commands[] = {
+    { CMD_WRITE_ENABLE,      "write enable" },
+    { CMD_READ_REGISTER,     "get feature" },
+    { CMD_SET_REGISTER,      "set feature" },
+    { CMD_READ_ID,           "read id" },
+    { CMD_PAGE_READ,         "page read" },
+    { CMD_READ_FAST,         "read cache" },
+    { CMD_READ_CACHE_SEQ,    "read cache sequential" },
+    { CMD_READ_CACHE_END,    "read cache end" },
+    { CMD_PROGRAM_LOAD,      "program load" },
+    { CMD_PROGRAM_LOAD_RAND, "program load random" },
+    { CMD_PROGRAM_EXECUTE,   "program execute" },
+    { CMD_ERASE_BLOCK,       "block erase" },
+    { CMD_Reset,             "reset" },
+};
+
+#define TRANSCEIVE_SLOTS (ARRAY_SIZE(transceive_commands) + 1)
+
+struct transceive_stats {
+    struct nand_stats_hist hist;
+    uint64_t bytes;
+    uint32_t errors;
+};
+
+static struct nand_stats_hist stats[NAND_STATS_ID_COUNT];
+static struct transceive_stats transceive_stats[TRANSCEIVE_SLOTS];
+
+
+static inline int bucket_of(uint32_t value)
+{
+    if (value == 0) {
+        return 0;
+    }
+
+    int bucket = 31 - __builtin_clz(value);
+    return MIN(bucket, NAND_STATS_BUCKETS - 1);
+}
+
+static void hist_add(struct nand_stats_hist *hist, uint32_t value)
+{
+    hist->count++;
+    hist->sum += value;
+    hist->max = MAX(hist->max, value);
+    hist->buckets[bucket_of(value)]++;
+}
+
+static size_t transceive_slot(uint8_t command)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(transceive_commands); i++) {
+        if (transceive_commands[i].command == command) {
+            return i;
+        }
+    }
+    return TRANSCEIVE_SLOTS - 1;
+}
+
+
+void nand_stats_record(enum nand_stats_id id, uint32_t value)
+{
+    if (id < NAND_STATS_ID_COUNT) {
+        hist_add(&stats[id], value);
+    }
+}
+
+void nand_stats_record_transceive(uint8_t command, uint32_t cycles, uint32_t bytes, int result)
+{
+    struct transceive_stats *slot = &transceive_stats[transceive_slot(command)];
+
+    hist_add(&slot->hist, cycles);
+    slot->bytes += bytes;
+    if (result != 0) {
+        slot->errors++;
+    }
+}
+
+const struct nand_stats_hist *nand_stats_get(enum nand_stats_id id)
+{
+    return id < NAND_STATS_ID_COUNT ? &stats[id] : NULL;
+}
+
+void nand_stats_reset(void)
+{
+    memset(stats, 0, sizeof(stats));
+    memset(transceive_stats, 0, sizeof(transceive_stats));
+}
+
+
+
+/////////////////////////           DUMP        ///////////////////////////////////
+
+#ifdef CONFIG_NAND_STATS_SHELL
+#define STATS_PRINT(sh, fmt, ...)                           \
+    do {                                                    \
+        if (sh) {                                           \
+            shell_print(sh, fmt, ##__VA_ARGS__);            \
+        } else {                                            \
+            LOG_INF(fmt, ##__VA_ARGS__);                    \
+        }                                                   \
+    } while (0)
+#else
+struct shell;
+#define STATS_PRINT(sh, fmt, ...) LOG_INF(fmt, ##__VA_ARGS__)
+#endif
+
+static void print_hist(const struct shell *sh, const char *name, const struct nand_stats_hist *hist)
+{
+    STATS_PRINT(sh, "%s: n=%u mean=%u max=%u", name, hist->count,
+                (uint32_t)(hist->sum / hist->count), hist->max);
+
+    for (int k = 0; k < NAND_STATS_BUCKETS; k++) {
+        if (hist->buckets[k] != 0) {
+            STATS_PRINT(sh, "  >= 2^%d: %u", k, hist->buckets[k]);
+        }
+    }
+}
+
+static void dump(const struct shell *sh)
+{
+    STATS_PRINT(sh, "NAND stats, %u cycles per second:", sys_clock_hw_cycles_per_sec());
+
+    for (size_t i = 0; i < TRANSCEIVE_SLOTS; i++) {
+        const struct transceive_stats *slot = &transceive_stats[i];
+
+        if (slot->hist.count == 0) {
+            continue;
+        }
+        const char *name = i < ARRAY_SIZE(transceive_commands) ? transceive_commands[i].name : "other";
+        STATS_PRINT(sh, "transceive %s: bytes=%llu errors=%u", name,
+                    (unsigned long long)slot->bytes, slot->errors);
+        print_hist(sh, "  [cycles]", &slot->hist);
+    }
+
+    for (int id = 0; id < NAND_STATS_ID_COUNT; id++) {
+        if (stats[id].count != 0) {
+            print_hist(sh, stats_names[id], &stats[id]);
+        }
+    }
+}
+
+void nand_stats_dump(void)
+{
+    dump(NULL);
+}
+
+
+#ifdef CONFIG_NAND_STATS_SHELL
+
+static int cmd_nand_stats_show(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    dump(sh);
+    return 0;
+}
+
+static int cmd_nand_stats_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    nand_stats_reset();
+    shell_print(sh, "NAND stats cleared");
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_nand_stats,
+    SHELL_CMD(show, NULL, "Print the NAND latency histograms", cmd_nand_stats_show),
+    SHELL_CMD(reset, NULL, "Clear the NAND latency histograms", cmd_nand_stats_reset),
+    SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(nand_stats, &sub_nand_stats, "NAND flash statistics", NULL);
+
+#endif //CONFIG_NAND_STATS_SHELL
+
+#endif //CONFIG_NAND_STATS
@@ -2,12 +2,18 @@
 #include <string.h>
 
 #include <zephyr/kernel.h>//only dependency
+#include <zephyr/sys/byteorder.h>
 
 #include "../inc/nand_driver.h"
 #include "../dhara/dhara/nand.h"
 #include "../inc/nand_top_layer.h"
-#include "../inc/nand_flash_devices.h"
 #include "../inc/example_handle.h"
+#include "../inc/nand_trace.h"
+#include "../inc/nand_clock.h"
+
+#ifdef CONFIG_NAND_PAGE_CRC
+#include "../dhara/ecc/crc32.h"
+#endif
 
 
 
@@ -15,381 +21,373 @@
 static nand_flash_device_t nand_flash_device;
 nand_flash_device_t *device_handle = &nand_flash_device;
 
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+#define NO_PAGE UINT32_MAX
+#define SECTORS_PER_PAGE(dev) ((dev)->page_size / (dev)->sector_size)
+#else
+#define SECTORS_PER_PAGE(dev) 1
+#endif
+
 
 /**
- * @brief Initialize a Winbond NAND device.
+ * @brief Detects the NAND flash chip and takes over its geometry.
  *
- * This function initializes a Winbond NAND flash device by reading its
- * device ID and setting up specific timing parameters based on the device ID.
- * *
- * @param dev Pointer to the NAND device structure.
+ * nand_chip_identify() reads the IDs and the parameter page, or looks the chip up
+ * in the device table. Geometry, spare size, timings and features are kept in
+ * dev->chip for the layers below.
  *
- * @retval 0 If the initialization is successful.
- * @retval -1 If there was an error during device ID retrieval or if the device ID
- *         is not recognized as a supported Winbond device.
+ * @param dev Pointer to the nand_flash_device_t structure representing the NAND device.
+ * @return 0 on successful detection and initialization of the chip, -1 on failure with an error logged.
  */
-static int nand_winbond_init(nand_flash_device_t *dev)
+static int detect_chip(nand_flash_device_t *dev)
 {
-    uint8_t device_id_buf[2];
-    nand_transaction_t t = {
-        .command = CMD_READ_ID,
-        .dummy_bytes = 2,
-        .miso_len = 2,
-        .miso_data = device_id_buf
-    };
-    int err = my_nand_handle->transceive(&t);
-    if (err != 0) {
-        my_nand_handle->log("Failed to receive device ID, error: ", true, true, err);
+    dev->gc_factor = 12;//after investigation this factor is the most fitting for the motion tracker
+
+    if (nand_chip_identify(&dev->chip) != 0) {
         return -1;
     }
 
-    uint16_t device_id = (device_id_buf[0] << 8) + device_id_buf[1];
-    dev->dhara_nand.log2_ppb = 6; // Assume 64 pages per block
-    dev->dhara_nand.log2_page_size = 11;// Assume 2048 bytes per page
-
-    switch (device_id) {
-    case WINBOND_DI_AA20:
-        my_nand_handle->log("Automatic recognition of WINBOND_DI_AA20 flash", false, false, 0);
-    case WINBOND_DI_BA20:
-        my_nand_handle->log("Automatic recognition of WINBOND_DI_BA20 flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 512;
-        break;
-    case WINBOND_DI_AA21:
-        my_nand_handle->log("Automatic recognition of WINBOND_DI_AA21 flash", false, false, 0);
-    case WINBOND_DI_BA21:
-        my_nand_handle->log("Automatic recognition of WINBOND_DI_BA21 flash", false, false, 0);
-    case WINBOND_DI_BC21:
-        my_nand_handle->log("Automatic recognition of WINBOND_DI_BC21 flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 1024;
-        break;
-    default:
-        my_nand_handle->log("Invalid Winbond device ID: ", true, true, device_id);
-        return -1;
+    dev->dhara_nand.log2_page_size = dev->chip.log2_page_size;
+    dev->dhara_nand.log2_ppb = dev->chip.log2_ppb;
+    dev->dhara_nand.num_blocks = dev->chip.num_blocks;
+
+#ifdef CONFIG_NAND_PLANE_PAIRS
+    //an even and an odd block are programmed together, one on each plane, on the parts
+    //whose dual-plane program was read back
+    dev->plane_pairs = dev->chip.planes == 2 && (dev->chip.features & NAND_CHIP_DUAL_PLANE_PROGRAM) != 0;
+    if (dev->plane_pairs) {
+        dev->dhara_nand.log2_page_size++;
+        dev->dhara_nand.num_blocks /= 2;
+        my_nand_handle->log("NAND MAPPING LAYER: Pairing the blocks of both planes", false, false, 0);
+    } else if (dev->chip.planes == 2) {
+        my_nand_handle->log("NAND MAPPING LAYER: Dual-plane program not verified on this part, blocks not paired", false, false, 0);
     }
+#endif
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+    if ((dev->chip.features & NAND_CHIP_ERASE_SUSPEND) == 0) {
+        my_nand_handle->log("NAND MAPPING LAYER: No erase suspend on this part, reads wait for background erases", false, false, 0);
+    }
+#endif
     return 0;
 }
 
-//We use the S5F14G04SND, but it should recognize the flash itself
-
 /**
- * @brief Initializes a NAND device based on its Alliance Memory device ID.
+ * @brief Unprotects the NAND flash chip to enable write operations.
  *
- * This function reads the device ID using a transaction, then sets
- * device-specific timing parameters and the number of blocks based on the
- * device ID. It supports multiple Alliance Memory NAND flash devices by
- * adjusting configuration parameters accordingly.
+ * This function checks if the chip is currently protected by reading the protection
+ * register (REG_PROTECT). If the chip is protected, it sends a command to write to the
+ * protection register and clear the protection bits, thereby unprotecting the chip.
+ * This allows subsequent operations such as erase and program to proceed without being
+ * blocked by write protection.
  *
- * @param dev Pointer to the NAND flash device structure.
- * @return 0 on success, -1 on error with a logged error message.
+ * @param dev Pointer to the nand_flash_device_t structure representing the NAND device.
+ * @return 0 on successful unprotection of the chip, -1 on failure.
  */
-
-static int nand_alliance_init(nand_flash_device_t *dev)
+static int unprotect_chip(nand_flash_device_t *dev)
 {
-    int err;
-    uint8_t device_id;
-    nand_transaction_t t = {
-        .command = CMD_READ_ID,
-        .address = DEVICE_ADDR_READ,
-        .address_bytes = 1,
-        .miso_len = 1,
-        .miso_data = &device_id
-    };
-    err = my_nand_handle->transceive(&t);
-    if (err != 0) {
-        my_nand_handle->log("Failed to read Alliance device ID", true, true, err);
-        return -1;
+    uint8_t status;
+    int ret = nand_read_register(REG_PROTECT, &status);
+    if (ret != 0) {
+        my_nand_handle->log("Failed to read register: ", true, true, ret);
+        return ret;
+    }
+
+    if (status != 0x00) {
+        ret = nand_write_register(REG_PROTECT, 0);
     }
-    //setting up the device
-
-    dev->dhara_nand.log2_ppb = 6; // Assume 64 pages per block
-    dev->dhara_nand.log2_page_size = 11; // Assume 2048 bytes per page
-    switch (device_id) {
-    case ALLIANCE_DI_25: // AS5F31G04SND-08LIN
-        my_nand_handle->log("Automatic recognition of AS5F31G04SND-08LIN flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 1024;
-        break;
-    case ALLIANCE_DI_2E: // AS5F32G04SND-08LIN
-        my_nand_handle->log("Automatic recognition of AS5F32G04SND-08LIN flash", false, false, 0);
-        // Fall through to set num_blocks for the next case
-    case ALLIANCE_DI_8E: // AS5F12G04SND-10LIN
-        my_nand_handle->log("Automatic recognition of AS5F12G04SND-10LIN flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 2048;
-        break;
-    case ALLIANCE_DI_2F: // AS5F34G04SND-08LIN
-        my_nand_handle->log("Automatic recognition of AS5F34G04SND-08LIN flash", false, false, 0);
-        // Fall through to set num_blocks for the next case
-    case ALLIANCE_DI_8F: // AS5F14G04SND-10LIN ==> Current implementation
-        my_nand_handle->log("NAND MAPPING LAYER: Automatic recognition of AS5F14G04SND-10LIN flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 4096;
-        break;
-    case ALLIANCE_DI_2D: // AS5F38G04SND-08LIN
-        my_nand_handle->log("Automatic recognition of AS5F38G04SND-08LIN flash", false, false, 0);
-        // Fall through to set num_blocks for the next case
-    case ALLIANCE_DI_8D: // AS5F18G04SND-10LIN
-        my_nand_handle->log("Automatic recognition of AS5F18G04SND-10LIN flash", false, false, 0);
-        dev->dhara_nand.log2_page_size = 12; // 4k pages
-        dev->dhara_nand.num_blocks = 4096;
-        break;
-    default:
-        my_nand_handle->log("Invalid Alliance device ID", true, true, device_id);
+    if (ret != 0) {
+        my_nand_handle->log("Failed to remove protection bit with error code: ", true, true, ret);
         return -1;
     }
+
     return 0;
 }
 
+
+
+
+#ifdef CONFIG_NAND_SOFT_ECC_DISABLE_ON_DIE
 /**
- * @brief Initializes a GigaDevice NAND flash based on its device ID.
+ * @brief Switches off the on-die ECC of the NAND flash chip.
  *
- * This function reads the device ID of a GigaDevice NAND flash and configures
- * various operational parameters based on the detected device.
+ * Only used when the software ECC in nand.c protects the pages. Clears the
+ * ECC_EN bit of the configuration register and leaves the other bits untouched.
  *
  * @param dev Pointer to the nand_flash_device_t structure representing the NAND device.
- * @return 0 on successful initialization and configuration, -1 on failure with an error logged.
- */
-static int nand_gigadevice_init(nand_flash_device_t *dev)
-{
-    uint8_t device_id;
-    int err;
-    nand_transaction_t t = {
-        .command = CMD_READ_ID,
-        .dummy_bytes = 2,
-        .miso_len = 1,
-        .miso_data = &device_id
-    };
-    err = my_nand_handle->transceive(&t);
-    if (err != 0) {
-        my_nand_handle->log("Failed to read Gigadevice device ID", true, true, err);
-        return -1;
+ * @return 0 on success, -1 on failure.
+ */
+static int disable_on_die_ecc(nand_flash_device_t *dev)
+{
+    uint8_t config;
+
+    if ((dev->chip.features & NAND_CHIP_ON_DIE_ECC) == 0) {
+        return 0;
     }
-    dev->dhara_nand.log2_ppb = 6; // Assume 64 pages per block
-    dev->dhara_nand.log2_page_size = 11; // Assume 2048 bytes per page
-    switch (device_id) {
-    case GIGADEVICE_DI_51:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_51 flash", false, false, 0);
-        // Fall through to set num_blocks for the next cases
-    case GIGADEVICE_DI_41:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_41 flash", false, false, 0);
-        // Fall through to set num_blocks for the next cases
-    case GIGADEVICE_DI_31:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_31 flash", false, false, 0);
-        // Fall through to set num_blocks for the next cases
-    case GIGADEVICE_DI_21:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_21 flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 1024;
-        break;
-    case GIGADEVICE_DI_52:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_52 flash", false, false, 0);
-        // Fall through to set num_blocks for the next cases
-    case GIGADEVICE_DI_42:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_42 flash", false, false, 0);
-        // Fall through to set num_blocks for the next cases
-    case GIGADEVICE_DI_32:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_32 flash", false, false, 0);
-        // Fall through to set num_blocks for the next cases
-    case GIGADEVICE_DI_22:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_22 flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 2048;
-        break;
-    case GIGADEVICE_DI_55:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_55 flash", false, false, 0);
-        // Fall through to set num_blocks for the next cases
-    case GIGADEVICE_DI_45:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_45 flash", false, false, 0);
-        // Fall through to set num_blocks for the next cases
-    case GIGADEVICE_DI_35:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_35 flash", false, false, 0);
-        // Fall through to set num_blocks for the next cases
-    case GIGADEVICE_DI_25:
-        my_nand_handle->log("Automatic recognition of GIGADEVICE_DI_25 flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 4096;
-        break;
-    default:
-        my_nand_handle->log("Invalid Gigadevice device ID", true, true, device_id);
+
+    int ret = nand_read_register(REG_CONFIG, &config);
+    if (ret != 0) {
+        my_nand_handle->log("Failed to read config register: ", true, true, ret);
         return -1;
     }
+
+    if ((config & CFG_ECC_ENABLE) != 0) {
+        ret = nand_write_register(REG_CONFIG, config & ~CFG_ECC_ENABLE);
+        if (ret != 0) {
+            my_nand_handle->log("Failed to disable on-die ECC with error code: ", true, true, ret);
+            return -1;
+        }
+    }
+
+    my_nand_handle->log("NAND MAPPING LAYER: On-die ECC disabled, using software ECC", false, false, 0);
     return 0;
 }
+#endif // CONFIG_NAND_SOFT_ECC_DISABLE_ON_DIE
 
 
 
 /**
- * @brief Initializes a Micron NAND flash based on its device ID.
+ * @brief Detects and prepares every NAND chip on the bus.
  *
- * This function reads the device ID of a Micron NAND flash and configures
- * various operational parameters based on the detected device.
+ * With more than one chip (my_nand_handle->number_of_flashes) all chips must have
+ * the same geometry. They are striped into one dhara_nand: with a power of two chip
+ * count a block spans the same block of every chip and the pages per block are
+ * multiplied, so consecutive pages go to different chips. Otherwise the block count
+ * is multiplied.
  *
  * @param dev Pointer to the nand_flash_device_t structure representing the NAND device.
- * @return 0 on successful initialization and configuration, -1 on failure with an error logged.
- */
-static int nand_micron_init(nand_flash_device_t *dev)
-{
-    uint8_t device_id;
-    int err;
-    nand_transaction_t t = {
-        .command = CMD_READ_ID,
-        .dummy_bytes = 2,
-        .miso_len = 1,
-        .miso_data = &device_id
-    };
-    err = my_nand_handle->transceive(&t);
-    if (err != 0) {
-        my_nand_handle->log("Failed to read Micron device ID", true, true, err);
+ * @return 0 on success, -1 on failure with an error logged.
+ */
+static int init_chips(nand_flash_device_t *dev)
+{
+    const int flashes = my_nand_handle->number_of_flashes > 1 ? my_nand_handle->number_of_flashes : 1;
+    struct dhara_nand first = {0};
+    int ret;
+
+    for (int i = 0; i < flashes; i++) {
+        my_nand_handle->active_flash = i;
+
+        ret = detect_chip(dev);
+        if (ret != 0) {
+            my_nand_handle->log("Failed to detect NAND chip", true, true, i);
+            return -1;
+        }
+
+        if (i == 0) {
+            first = dev->dhara_nand;
+        } else if (dev->dhara_nand.num_blocks != first.num_blocks ||
+                   dev->dhara_nand.log2_ppb != first.log2_ppb ||
+                   dev->dhara_nand.log2_page_size != first.log2_page_size) {
+            my_nand_handle->log("Striped NAND chips differ in geometry, chip", true, true, i);
+            return -1;
+        }
+
+        // Unprotect the NAND flash chip
+        ret = unprotect_chip(dev);
+        if (ret != 0) {
+            my_nand_handle->log("Failed to unprotect NAND chip", true, true, i);
+            return -1;
+        }
+
+#ifdef CONFIG_NAND_SOFT_ECC_DISABLE_ON_DIE
+        ret = disable_on_die_ecc(dev);
+        if (ret != 0) {
+            return -1;
+        }
+#endif
+    }
+
+#ifdef CONFIG_NAND_CLOCK_CALIBRATION
+    //a failed calibration leaves the slowest clock, the chips still work
+    (void)nand_clock_calibrate(dev);
+#endif
+
+    my_nand_handle->active_flash = 0;
+    if (nand_stripe_width() > 1) {
+        //one chip transfers the next page while the one before programs it
+        dev->dhara_nand.log2_ppb += __builtin_ctz(nand_stripe_width());
+        my_nand_handle->log("NAND MAPPING LAYER: Striping pages across chips", false, true, flashes);
+    } else if (flashes > 1) {
+        dev->dhara_nand.num_blocks = first.num_blocks * flashes;
+        my_nand_handle->log("NAND MAPPING LAYER: Striping blocks across chips", false, true, flashes);
+    }
+
+    return 0;
+}
+
+
+
+#ifdef CONFIG_NAND_HOT_COLD
+/**
+ * @brief Split off the hot region at the end of the chip.
+ *
+ * FAT and directory sectors are rewritten with every file update. In their own small
+ * dhara map they no longer land between the sectors of a recording, so the blocks of
+ * the main map fill with data that stays valid and the garbage collector has little
+ * to copy there. The hot region is small, collecting it is cheap although most of it
+ * is garbage.
+ *
+ * @param dev Pointer to the nand_flash_device_t structure, after init_chips.
+ * @return 0 on success, -1 if the chip is too small or the buffer allocation failed.
+ */
+static int init_hot_region(nand_flash_device_t *dev)
+{
+    const unsigned int hot_blocks = CONFIG_NAND_HOT_BLOCKS;
+
+    if (dev->dhara_nand.num_blocks < 2 * hot_blocks) {
+        my_nand_handle->log("Chip too small for the hot region, blocks", true, true, dev->dhara_nand.num_blocks);
         return -1;
     }
-    dev->dhara_nand.log2_ppb = 6; // Assume 64 pages per block
-    dev->dhara_nand.log2_page_size = 11; // Assume 2048 bytes per page
-
-    switch (device_id) {
-    case MICRON_DI_38:
-        my_nand_handle->log("Automatic recognition of MT29F8G08AB flash", false, false, 0);
-        break;
-    case MICRON_DI_48:
-        my_nand_handle->log("Automatic recognition of MT29F flash", false, false, 0);
-        break;
-    case MICRON_DI_68:
-        my_nand_handle->log("Automatic recognition of MT29F flash", false, false, 0);
-        break;
-    case MICRON_DI_A1:
-        my_nand_handle->log("Automatic recognition of MT29F1G08ABBDA flash", false, false, 0);
-        break;
-    case MICRON_DI_A3:
-        my_nand_handle->log("Automatic recognition of MT29F8G08ADBDA flash", false, false, 0);
-        break;
-    case MICRON_DI_A8:
-        my_nand_handle->log("Automatic recognition of MT29F256G08 flash", false, false, 0);
-        break;
-    case MICRON_DI_AA:
-        my_nand_handle->log("Automatic recognition of MT29F2G08 flash", false, false, 0);
-        break;
-    case MICRON_DI_AC:
-        my_nand_handle->log("Automatic recognition of MT29F4G08ABBDA flash", false, false, 0);
-        break;
-    case MICRON_DI_B1:
-        my_nand_handle->log("Automatic recognition of MT29F1G16ABBDA flash", false, false, 0);
-        break;
-    case MICRON_DI_B3:
-        my_nand_handle->log("Automatic recognition of MT29F8G16ADBDA flash", false, false, 0);
-        break;
-    case MICRON_DI_BA:
-        my_nand_handle->log("Automatic recognition of MT29F2G16AB flash", false, false, 0);
-        break;
-    case MICRON_DI_CA:
-        my_nand_handle->log("Automatic recognition of MT29F2G16A flash", false, false, 0);
-        break;
-    case MICRON_DI_C3:
-        my_nand_handle->log("Automatic recognition of MT29F8G16ADADA flash", false, false, 0);
-        break;
-    case MICRON_DI_CC:
-        my_nand_handle->log("Automatic recognition of MT29F4G16 flash", false, false, 0);
-        break;
-    case MICRON_DI_D3:
-        my_nand_handle->log("Automatic recognition of MT29F flash", false, false, 0);
-        break;
-    case MICRON_DI_D5:
-        my_nand_handle->log("Automatic recognition of MT29F flash", false, false, 0);
-        break;
-    case MICRON_DI_D7:
-        my_nand_handle->log("Automatic recognition of MT29F64G08TAA flash", false, false, 0);
-        break;
-    case MICRON_DI_DA:
-        my_nand_handle->log("Automatic recognition of MT29F2G08 flash", false, false, 0);
-        break;
-    case MICRON_DI_DC:
-        my_nand_handle->log("Automatic recognition of MT29F8G0 flash", false, false, 0);
-        break;
-    case MICRON_DI_F1:
-        my_nand_handle->log("Automatic recognition of MT29F4G0 flash", false, false, 0);
-        break;
-    case MICRON_DI_35:
-        my_nand_handle->log("Automatic recognition of MT29F4G0 flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 2048;
-        dev->dhara_nand.log2_page_size = 12; // Assume 4096 bytes per page
-        break;
-    case MICRON_DI_47:
-        my_nand_handle->log("Automatic recognition of MT29F4G0 flash", false, false, 0);
-        dev->dhara_nand.num_blocks = 2 * 2048;
-        dev->dhara_nand.log2_page_size = 12; // Assume 4096 bytes per page
-        break;
-    default:
-        my_nand_handle->log("Invalid Micron device ID", true, true, device_id);
+
+    dev->hot_nand = dev->dhara_nand;
+    dev->hot_nand.num_blocks = hot_blocks;
+    dev->dhara_nand.num_blocks -= hot_blocks;
+    //CONFIG_NAND_HOT_SECTORS counts disk sectors, the maps count pages
+    dev->hot_sectors = DIV_ROUND_UP(CONFIG_NAND_HOT_SECTORS, SECTORS_PER_PAGE(dev));
+
+    if (dev->hot_work_buffer == NULL) {
+        dev->hot_work_buffer = malloc(dev->page_size);
+    }
+    if (dev->hot_work_buffer == NULL) {
+        my_nand_handle->log("Failed to allocate hot work buffer", true, false, 0);
         return -1;
     }
     return 0;
 }
 
 
+/**
+ * @brief Compare the FAT layout in a boot sector with the hot region.
+ *
+ * Only logs: the split point has to stay fixed, or sectors would be looked up in the
+ * map that does not hold them.
+ *
+ * @param dev Pointer to the nand_flash_device_t structure.
+ * @param boot_sector Content of sector 0.
+ */
+static void check_hot_layout(nand_flash_device_t *dev, const uint8_t *boot_sector)
+{
+    if (boot_sector[0] != 0xEB && boot_sector[0] != 0xE9) {
+        return; //no FAT boot sector (unformatted or MBR)
+    }
+
+    const uint32_t bytes_per_sector = sys_get_le16(&boot_sector[11]);
+    const uint32_t reserved = sys_get_le16(&boot_sector[14]);
+    const uint32_t fats = boot_sector[16];
+    const uint32_t root_entries = sys_get_le16(&boot_sector[17]);
+    uint32_t fat_size = sys_get_le16(&boot_sector[22]);
+
+    if (fat_size == 0) {
+        fat_size = sys_get_le32(&boot_sector[36]); //FAT32
+    }
+    if (bytes_per_sector == 0) {
+        return;
+    }
+
+    const uint32_t data_start = reserved + fats * fat_size +
+                                (root_entries * 32 + bytes_per_sector - 1) / bytes_per_sector;
+    if (data_start > dev->hot_sectors * SECTORS_PER_PAGE(dev)) {
+        my_nand_handle->log("FAT metadata exceeds CONFIG_NAND_HOT_SECTORS, sectors", true, true, data_start);
+    }
+}
+#endif //CONFIG_NAND_HOT_COLD
 
 
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
 /**
- * @brief Detects the NAND flash chip and initializes it based on the manufacturer ID.
- *
- * This function reads the manufacturer ID of the NAND flash chip and calls the appropriate
- * initialization function based on the detected manufacturer. It supports chips from
- * Alliance, Winbond, and GigaDevice. The function sends a command to read the manufacturer
- * ID and then, based on the ID, calls a specific initialization function to set up device
- * parameters and operational characteristics.
+ * @brief Set up the sub-page sectors and their page buffers.
  *
- * @param dev Pointer to the nand_flash_device_t structure representing the NAND device.
- * @return 0 on successful detection and initialization of the chip, -1 on failure with an error logged.
+ * @param dev Pointer to the nand_flash_device_t structure, page_size already set.
+ * @return 0 on success, -1 if the sector size does not divide the page or the allocation failed.
  */
-static int detect_chip(nand_flash_device_t *dev)
+static int init_subpage(nand_flash_device_t *dev)
 {
-    uint8_t manufacturer_id;
-    nand_transaction_t t = {
-        .command = CMD_READ_ID,
-        .address = 0, // This normally selects the manufacturer id. Some chips ignores it, but still expects 8 dummy bits here
-        .address_bytes = 1,
-        .miso_len = 1,
-        .miso_data = &manufacturer_id
-    };
-    my_nand_handle->transceive(&t);
+    dev->sector_size = CONFIG_NAND_SECTOR_SIZE;
 
-    dev->gc_factor = 12;//after investigation this factor is the most fitting for the motion tracker
+    //the dirty sectors of a page are tracked in a 32 bit mask
+    if (dev->page_size % dev->sector_size != 0 || SECTORS_PER_PAGE(dev) > 32) {
+        my_nand_handle->log("Sector size does not fit the page size", true, true, dev->sector_size);
+        return -1;
+    }
 
-    switch (manufacturer_id) {
-    case NAND_FLASH_ALLIANCE_MI: // Alliance
-        return nand_alliance_init(dev);
-    case NAND_FLASH_WINBOND_MI: // Winbond
-        return nand_winbond_init(dev);
-    case NAND_FLASH_GIGADEVICE_MI: // GigaDevice
-        return nand_gigadevice_init(dev);
-    case NAND_FLASH_MICRON_MI: // GigaDevice
-        return nand_micron_init(dev);
-    default:
-        my_nand_handle->log("Invalid manufacturer ID", true, true, manufacturer_id);
+    if (dev->combine_buffer == NULL) {
+        dev->combine_buffer = malloc(dev->page_size);
+    }
+    if (dev->merge_buffer == NULL) {
+        dev->merge_buffer = malloc(dev->page_size);
+    }
+    if (dev->combine_buffer == NULL || dev->merge_buffer == NULL) {
+        my_nand_handle->log("Failed to allocate sector buffers", true, false, 0);
         return -1;
     }
+
+    dev->combine_page = NO_PAGE;
+    dev->combine_mask = 0;
+    dev->merge_page = NO_PAGE;
+    return 0;
 }
 
+
+static void free_subpage(nand_flash_device_t *dev)
+{
+    free(dev->combine_buffer);
+    dev->combine_buffer = NULL;
+    free(dev->merge_buffer);
+    dev->merge_buffer = NULL;
+}
+
+
 /**
- * @brief Unprotects the NAND flash chip to enable write operations.
+ * @brief Mask of count sectors starting at sector first of a page.
+ */
+static inline uint32_t sector_bits(uint32_t first, uint32_t count)
+{
+    return (count >= 32 ? UINT32_MAX : BIT(count) - 1) << first;
+}
+#endif //CONFIG_NAND_SUBPAGE_SECTORS
+
+
+/**
+ * @brief Map that holds sector_id, the hot map for FAT metadata (CONFIG_NAND_HOT_COLD).
  *
- * This function checks if the chip is currently protected by reading the protection
- * register (REG_PROTECT). If the chip is protected, it sends a command to write to the
- * protection register and clear the protection bits, thereby unprotecting the chip.
- * This allows subsequent operations such as erase and program to proceed without being
- * blocked by write protection.
+ * Both maps use the sector ids as they are, the main map just never sees the low ones.
+ */
+static struct dhara_map *map_of(nand_flash_device_t *dev, uint32_t sector_id)
+{
+#ifdef CONFIG_NAND_HOT_COLD
+    if (sector_id < dev->hot_sectors) {
+        return &dev->hot_map;
+    }
+#endif
+    return &dev->dhara_map;
+}
+
+
+/**
+ * @brief Initialize the maps and resume them from the flash.
  *
- * @param dev Pointer to the nand_flash_device_t structure representing the NAND device.
- * @return 0 on successful unprotection of the chip, -1 on failure.
+ * @return 0 on success, -1 if the hot map cannot hold CONFIG_NAND_HOT_SECTORS.
  */
-static int unprotect_chip(nand_flash_device_t *dev)
+static int init_maps(nand_flash_device_t *dev)
 {
-    uint8_t status;
-    int ret = nand_read_register(REG_PROTECT, &status);
-    if (ret != 0) {
-        my_nand_handle->log("Failed to read register: ", true, true, ret);
-        return ret;
+    dhara_error_t ignored;
+
+    dhara_map_init(&dev->dhara_map, &dev->dhara_nand, dev->work_buffer, dev->gc_factor);
+    if (dhara_map_resume(&dev->dhara_map, &ignored) == -1) {
+        my_nand_handle->log("No valid stored state, reinitializing map", false, false, 0);
     }
 
-    if (status != 0x00) {
-        ret = nand_write_register(REG_PROTECT, 0);
+#ifdef CONFIG_NAND_HOT_COLD
+    dhara_map_init(&dev->hot_map, &dev->hot_nand, dev->hot_work_buffer, dev->gc_factor);
+    if (dhara_map_resume(&dev->hot_map, &ignored) == -1) {
+        my_nand_handle->log("No valid stored state, reinitializing hot map", false, false, 0);
     }
-    if (ret != 0) {
-        my_nand_handle->log("Failed to remove protection bit with error code: ", true, true, ret);
+    //the FAT would fail with MAP_FULL on its first write above the capacity
+    if (dhara_map_capacity(&dev->hot_map) < dev->hot_sectors) {
+        my_nand_handle->log("Hot region holds fewer sectors than CONFIG_NAND_HOT_SECTORS", true, true,
+                            dhara_map_capacity(&dev->hot_map));
         return -1;
     }
-
+#endif
     return 0;
 }
 
@@ -423,6 +421,154 @@ int wait_for_ready(uint8_t *status_out)
 
 
 
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+static void sync_work_handler(struct k_work *work);
+#endif
+#ifdef CONFIG_NAND_ERASE_AHEAD
+static void erase_ahead_work_handler(struct k_work *work);
+#endif
+#ifdef CONFIG_NAND_SCRUB
+static void scrub_work_handler(struct k_work *work);
+#endif
+
+
+#define BACKGROUND_RETRY_MS 2 //delay of background work that stepped back for waiting reads
+
+/**
+ * @brief Take the mutex for an operation that may write.
+ *
+ * With CONFIG_NAND_READ_PRIORITY the write gate lets only one such operation wait at
+ * the mutex, the reads queue there directly. A read waits for the running operation
+ * and at most one queued write, not for all of them.
+ */
+static void lock_device(nand_flash_device_t *handle)
+{
+#ifdef CONFIG_NAND_READ_PRIORITY
+    k_sem_take(&handle->write_gate, K_FOREVER);
+    k_sem_take(&handle->mutex, K_FOREVER);
+    k_sem_give(&handle->write_gate);
+#else
+    k_sem_take(&handle->mutex, K_FOREVER);
+#endif
+}
+
+
+/**
+ * @brief Take the mutex for a read, released with k_sem_give as every other lock.
+ */
+static void lock_device_read(nand_flash_device_t *handle)
+{
+#ifdef CONFIG_NAND_READ_PRIORITY
+    atomic_inc(&handle->readers_waiting);
+    k_sem_take(&handle->mutex, K_FOREVER);
+    atomic_dec(&handle->readers_waiting);
+#else
+    k_sem_take(&handle->mutex, K_FOREVER);
+#endif
+}
+
+
+#if defined(CONFIG_NAND_ERASE_AHEAD) || defined(CONFIG_NAND_SCRUB)
+/**
+ * @brief Take the mutex for background work without waiting.
+ *
+ * Fails while reads are waiting. With CONFIG_NAND_READ_PRIORITY the write gate stays
+ * held until unlock_background(), a suspended erase then only lets reads in.
+ *
+ * @return true if the mutex was taken.
+ */
+static bool try_lock_background(nand_flash_device_t *handle)
+{
+#ifdef CONFIG_NAND_READ_PRIORITY
+    if (atomic_get(&handle->readers_waiting) > 0 || k_sem_take(&handle->write_gate, K_NO_WAIT) != 0) {
+        return false;
+    }
+    if (k_sem_take(&handle->mutex, K_NO_WAIT) != 0) {
+        k_sem_give(&handle->write_gate);
+        return false;
+    }
+    return true;
+#else
+    return k_sem_take(&handle->mutex, K_NO_WAIT) == 0;
+#endif
+}
+
+
+static void unlock_background(nand_flash_device_t *handle)
+{
+    k_sem_give(&handle->mutex);
+#ifdef CONFIG_NAND_READ_PRIORITY
+    k_sem_give(&handle->write_gate);
+#endif
+}
+#endif //CONFIG_NAND_ERASE_AHEAD || CONFIG_NAND_SCRUB
+
+
+/**
+ * @brief True while a read runs in the window of a suspended erase.
+ */
+static inline bool erase_suspended(const nand_flash_device_t *handle)
+{
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+    return handle->erase_suspended;
+#else
+    ARG_UNUSED(handle);
+    return false;
+#endif
+}
+
+
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+#define ERASE_POLL_US 100 //the erase takes milliseconds, the waiting reads get the CPU between the polls
+
+int wait_for_erase_serving_reads(nand_flash_device_t *dev, uint32_t page, uint8_t *status_out)
+{
+    int suspends = 0;
+    uint8_t status;
+
+    while (true) {
+        //a read served in between may have selected another chip
+        nand_select_flash(page);
+        if (nand_read_register(REG_STATUS, &status) != 0) {
+            my_nand_handle->log("Error reading NAND status register", true, false, 0);
+            return -1;
+        }
+        if ((status & STAT_BUSY) == 0) {
+            break;
+        }
+        if (atomic_get(&dev->readers_waiting) == 0 || suspends == CONFIG_NAND_ERASE_SUSPEND_MAX) {
+            k_usleep(ERASE_POLL_US);
+            continue;
+        }
+
+        suspends++;
+        if (nand_erase_suspend() != 0 || wait_for_ready(NULL) != 0) {
+            my_nand_handle->log("Failed to suspend erase", true, false, 0);
+            return -1;
+        }
+
+        //the mutex goes to the reads waiting for it, the writes stay at the write gate
+        dev->erase_suspended = true;
+        k_sem_give(&dev->mutex);
+        k_sem_take(&dev->mutex, K_FOREVER);
+        dev->erase_suspended = false;
+
+        //a resume after an erase that ended before the suspend is ignored by the chip
+        nand_select_flash(page);
+        if (nand_erase_resume() != 0) {
+            my_nand_handle->log("Failed to resume erase", true, false, 0);
+            return -1;
+        }
+    }
+
+    if (status_out) {
+        *status_out = status;
+    }
+    return 0;
+}
+#endif //CONFIG_NAND_ERASE_SUSPEND
+
+
 int nand_flash_init_device(nand_flash_device_t **handle)
 {
     my_nand_handle->log("NAND MAPPING LAYER: Initializing DHARA mapping", false, false, 0);
@@ -440,16 +586,8 @@ int nand_flash_init_device(nand_flash_device_t **handle)
         return -1;
     }
 
-    int ret = detect_chip(*handle);
-    if (ret != 0) {
-        my_nand_handle->log("Failed to detect NAND chip", true, false, 0);
-        goto fail;
-    }
-
-    // Unprotect the NAND flash chip
-    ret = unprotect_chip(*handle);
+    int ret = init_chips(*handle);
     if (ret != 0) {
-        my_nand_handle->log("Failed to unprotect NAND chip", true, false, 0);
         goto fail;
     }
 
@@ -458,6 +596,18 @@ int nand_flash_init_device(nand_flash_device_t **handle)
     (*handle)->block_size = (1 << (*handle)->dhara_nand.log2_ppb) * (*handle)->page_size;
     (*handle)->num_blocks = (*handle)->dhara_nand.num_blocks;
 
+#ifdef CONFIG_NAND_PAGE_CRC
+    //every page checksum covers page_size bytes, the hardware backend correction is fixed from here on
+    crc32_nand_prepare((*handle)->page_size);
+#endif
+
+#ifdef CONFIG_NAND_SOFT_ECC
+    ret = nand_soft_ecc_check_layout(*handle);
+    if (ret != 0) {
+        goto fail;
+    }
+#endif
+
     // Allocate work buffer for NAND operations
     //(*handle)->work_buffer = malloc((*handle)->page_size);
     if ((*handle)->work_buffer == NULL) {
@@ -471,20 +621,66 @@ int nand_flash_init_device(nand_flash_device_t **handle)
         goto fail;
     }
 
+#ifdef CONFIG_NAND_SCRUB
+    if ((*handle)->scrub_buffer == NULL) {
+        (*handle)->scrub_buffer = malloc((*handle)->page_size);
+    }
+    if ((*handle)->scrub_buffer == NULL) {
+        my_nand_handle->log("Failed to allocate scrub buffer", true, false, 0);
+        ret = -1;
+        goto fail;
+    }
+    (*handle)->scrub_count = 0;
+    atomic_set(&(*handle)->scrub_urgent, 0);
+#endif
+
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    ret = init_subpage(*handle);
+    if (ret != 0) {
+        goto fail;
+    }
+#endif
+
+#ifdef CONFIG_NAND_HOT_COLD
+    ret = init_hot_region(*handle);
+    if (ret != 0) {
+        goto fail;
+    }
+#endif
+
     // Initialize mutex for thread safety
     // Initialize the semaphore with an initial count of 1 and a maximum count of 1
     // This means the semaphore is immediately available for one `take` operation (semaphore signals not locks)
     k_sem_init(&(*handle)->mutex, 1, 1);
+#ifdef CONFIG_NAND_READ_PRIORITY
+    k_sem_init(&(*handle)->write_gate, 1, 1);
+    atomic_set(&(*handle)->readers_waiting, 0);
+#endif
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+    (*handle)->background_erase = false;
+    (*handle)->erase_suspended = false;
+#endif
+
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+    k_work_init_delayable(&(*handle)->sync_work, sync_work_handler);
+    (*handle)->sync_config.policy = NAND_SYNC_BOUNDED;
+    (*handle)->sync_config.max_delay_ms = CONFIG_NAND_SYNC_INTERVAL_MS;
+    (*handle)->sync_config.max_dirty_pages = CONFIG_NAND_SYNC_DIRTY_PAGES;
+    (*handle)->dirty_pages = 0;
+    (*handle)->power_low = false;
+#endif
+#ifdef CONFIG_NAND_ERASE_AHEAD
+    k_work_init_delayable(&(*handle)->erase_ahead_work, erase_ahead_work_handler);
+#endif
+#ifdef CONFIG_NAND_SCRUB
+    k_work_init_delayable(&(*handle)->scrub_work, scrub_work_handler);
+#endif
     
 
-    dhara_map_init(&(*handle)->dhara_map, &(*handle)->dhara_nand, (*handle)->work_buffer, (*handle)->gc_factor);
-    
-
-    // Resume map to handle power failures
-    dhara_error_t ignored;
-    ret = dhara_map_resume(&(*handle)->dhara_map, &ignored);
-    if (ret == -1) {
-        my_nand_handle->log("No valid stored state, reinitializing map", false, false, 0);
+    // Resume the map(s) to handle power failures
+    ret = init_maps(*handle);
+    if (ret != 0) {
+        goto fail;
     }
 
     return 0;
@@ -492,7 +688,23 @@ int nand_flash_init_device(nand_flash_device_t **handle)
 fail:
     if ((*handle)->work_buffer != NULL) {
         free((*handle)->work_buffer);
+        (*handle)->work_buffer = NULL;
+    }
+#ifdef CONFIG_NAND_SCRUB
+    if ((*handle)->scrub_buffer != NULL) {
+        free((*handle)->scrub_buffer);
+        (*handle)->scrub_buffer = NULL;
     }
+#endif
+#ifdef CONFIG_NAND_HOT_COLD
+    if ((*handle)->hot_work_buffer != NULL) {
+        free((*handle)->hot_work_buffer);
+        (*handle)->hot_work_buffer = NULL;
+    }
+#endif
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    free_subpage(*handle);
+#endif
     my_nand_handle->log("Failed to initalize mapping", true, false, 0);
     return ret;
 }
@@ -505,16 +717,15 @@ int nand_erase_chip(nand_flash_device_t *handle)
     int ret;
 
     // Take the semaphore with K_FOREVER to wait indefinitely
-    k_sem_take(&handle->mutex, K_FOREVER);
-
-    for (int i = 0; i < handle->num_blocks; i++) {
-        ret = nand_write_enable();
-        if (ret != 0) {
-            my_nand_handle->log("Failed to enable write for block erase", true, false, 0);
-            goto end;
-        }
-
-        ret = nand_erase_block(i * (1 << handle->dhara_nand.log2_ppb));
+    lock_device(handle);
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    nand_write_behind_reset();
+#endif
+
+    //with interleaved pages a block lies on every chip, page c of the block selects chip c
+    const int width = nand_stripe_width();
+    for (int i = 0; i < handle->num_blocks * width; i++) {
+        ret = nand_enable_and_erase_block((i / width) * (1 << handle->dhara_nand.log2_ppb) + i % width);
         if (ret != 0) {
             my_nand_handle->log("Failed to erase block", true, false, 0);
             goto end;
@@ -528,9 +739,28 @@ int nand_erase_chip(nand_flash_device_t *handle)
         }
     }
 
-    // clear dhara map
+    // clear dhara map, a snapshot does not survive this
+#ifdef CONFIG_NAND_SNAPSHOT
+    handle->snapshot_valid = false;
+#endif
     dhara_map_init(&handle->dhara_map, &handle->dhara_nand, handle->work_buffer, handle->gc_factor);
     dhara_map_clear(&handle->dhara_map);
+#ifdef CONFIG_NAND_HOT_COLD
+    dhara_map_init(&handle->hot_map, &handle->hot_nand, handle->hot_work_buffer, handle->gc_factor);
+    dhara_map_clear(&handle->hot_map);
+#endif
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    handle->combine_page = NO_PAGE;
+    handle->combine_mask = 0;
+    handle->merge_page = NO_PAGE;
+#endif
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+    handle->dirty_pages = 0;
+#endif
+#ifdef CONFIG_NAND_SCRUB
+    handle->scrub_count = 0;
+    atomic_set(&handle->scrub_urgent, 0);
+#endif
 
     k_sem_give(&handle->mutex);
     return 0;
@@ -542,80 +772,975 @@ end:
 }
 
 
-int nand_flash_read_sector(nand_flash_device_t *handle, uint8_t *buffer, uint16_t sector_id)
+#ifdef CONFIG_NAND_SNAPSHOT
+/**
+ * @brief Release the snapshot of all maps, the caller holds the mutex.
+ */
+static void release_snapshot_locked(nand_flash_device_t *handle)
 {
-    dhara_error_t err;
-    int ret = 0;
-
-    k_sem_take(&handle->mutex, K_FOREVER);
-
-    if (dhara_map_read(&handle->dhara_map, sector_id, buffer, &err) == 0) {
-        ret = err;
-    } else if (err == DHARA_E_ECC) {
-        // This indicates a soft ECC error, we rewrite the sector to recover
-        my_nand_handle->log("Soft ECC error, recovering", false, false, 0);
-        if (dhara_map_write(&handle->dhara_map, sector_id, buffer, &err)) {
-            ret = err;
-            my_nand_handle->log("Error while writing to map", true, false, 0);
-        }
-    }
-    k_sem_give(&handle->mutex);
-    return ret;
+    dhara_map_snapshot_release(&handle->dhara_map, &handle->snapshot);
+#ifdef CONFIG_NAND_HOT_COLD
+    dhara_map_snapshot_release(&handle->hot_map, &handle->hot_snapshot);
+#endif
+    handle->snapshot_valid = false;
 }
 
 
-int nand_flash_write_sector(nand_flash_device_t *handle, const uint8_t *buffer, uint16_t sector_id)
+/**
+ * @brief Drop the snapshot if the journal ran into its blocks, the caller holds the mutex.
+ *
+ * Writes and syncs (padding, garbage collection) both move the head, logging has
+ * priority over the export.
+ *
+ * @param fail Result of the map operation.
+ * @param err Error of the map operation.
+ * @return true if the snapshot was dropped and the operation should be tried again.
+ */
+static bool drop_snapshot_if_full_locked(nand_flash_device_t *handle, int fail, dhara_error_t err)
+{
+    if (!fail || err != DHARA_E_JOURNAL_FULL || !handle->snapshot_valid) {
+        return false;
+    }
+    my_nand_handle->log("Journal full, dropping the snapshot", true, false, 0);
+    release_snapshot_locked(handle);
+    return true;
+}
+#else
+static inline bool drop_snapshot_if_full_locked(nand_flash_device_t *handle, int fail, dhara_error_t err)
+{
+    return false;
+}
+#endif
+
+
+#ifdef CONFIG_NAND_SCRUB
+static int write_sector_locked(nand_flash_device_t *handle, const uint8_t *buffer, uint32_t sector_id);
+
+
+/**
+ * @brief Read a sector again and write it to a fresh page, the caller holds the mutex.
+ *
+ * @param failed_page Page the sector was on when its read failed.
+ * @param[out] data Page sized buffer, receives the sector.
+ * @return 0 if the sector was relocated or has left failed_page, the dhara error otherwise.
+ */
+static int scrub_sector_locked(nand_flash_device_t *handle, uint32_t sector_id, dhara_page_t failed_page, uint8_t *data)
+{
+    struct dhara_map *map = map_of(handle, sector_id);
+    dhara_error_t err = DHARA_E_NONE;
+    dhara_page_t page;
+
+    //trimmed, rewritten or moved by the garbage collection since, the new page needs no relocation
+    if (dhara_map_find(map, sector_id, &page, &err) != 0) {
+        return err == DHARA_E_NOT_FOUND ? 0 : err;
+    }
+    if (page != failed_page) {
+        return 0;
+    }
+    if (dhara_map_read(map, sector_id, data, &err) != 0) {
+        return err;
+    }
+    return write_sector_locked(handle, data, sector_id);
+}
+
+
+/**
+ * @brief Arm the scrub work for the queue, the caller holds the mutex.
+ *
+ * An urgent queue runs at once, otherwise an armed idle delay is kept.
+ */
+static void schedule_scrub_locked(nand_flash_device_t *handle)
+{
+    const bool urgent = handle->scrub_count >= CONFIG_NAND_SCRUB_URGENT;
+
+    atomic_set(&handle->scrub_urgent, urgent);
+    if (urgent) {
+        k_work_reschedule(&handle->scrub_work, K_NO_WAIT);
+    } else if (handle->scrub_count > 0) {
+        k_work_schedule(&handle->scrub_work, K_MSEC(CONFIG_NAND_SCRUB_IDLE_MS));
+    }
+}
+
+
+/**
+ * @brief Queue a sector for relocation, the caller holds the mutex.
+ *
+ * @param page Page the sector was on when its read failed.
+ * @return 0 if queued or queued already, -1 if the queue is full.
+ */
+static int queue_scrub_locked(nand_flash_device_t *handle, uint32_t sector_id, dhara_page_t page)
+{
+    for (uint32_t i = 0; i < handle->scrub_count; i++) {
+        if (handle->scrub_queue[i] == sector_id) {
+            //the sector failed again on the page it was written to since
+            handle->scrub_pages[i] = page;
+            return 0;
+        }
+    }
+    if (handle->scrub_count == CONFIG_NAND_SCRUB_QUEUE_SIZE) {
+        return -1;
+    }
+
+    handle->scrub_queue[handle->scrub_count] = sector_id;
+    handle->scrub_pages[handle->scrub_count] = page;
+    handle->scrub_attempts[handle->scrub_count] = 0;
+    handle->scrub_count++;
+    schedule_scrub_locked(handle);
+    return 0;
+}
+
+
+/**
+ * @brief Relocate the oldest queued sector.
+ *
+ * Runs on the system work queue and never waits for the device, a long write would
+ * hold up the other work items. It steps back when the mutex is busy and retries
+ * after the idle delay, or after BACKGROUND_RETRY_MS once CONFIG_NAND_SCRUB_URGENT
+ * sectors are queued.
+ */
+static void scrub_work_handler(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    nand_flash_device_t *handle = CONTAINER_OF(dwork, nand_flash_device_t, scrub_work);
+
+    if (!try_lock_background(handle)) {
+        //scrub_urgent was set under the mutex, a reschedule by the holder is kept
+        k_work_schedule(dwork, K_MSEC(atomic_get(&handle->scrub_urgent) ? BACKGROUND_RETRY_MS : CONFIG_NAND_SCRUB_IDLE_MS));
+        return;
+    }
+
+    if (handle->scrub_count > 0) {
+        const uint32_t sector_id = handle->scrub_queue[0];
+        const dhara_page_t page = handle->scrub_pages[0];
+        const uint8_t attempts = handle->scrub_attempts[0] + 1;
+        int ret = scrub_sector_locked(handle, sector_id, page, handle->scrub_buffer);
+
+        handle->scrub_count--;
+        memmove(&handle->scrub_queue[0], &handle->scrub_queue[1], handle->scrub_count * sizeof(handle->scrub_queue[0]));
+        memmove(&handle->scrub_pages[0], &handle->scrub_pages[1], handle->scrub_count * sizeof(handle->scrub_pages[0]));
+        memmove(&handle->scrub_attempts[0], &handle->scrub_attempts[1], handle->scrub_count);
+
+        if (ret == 0) {
+            my_nand_handle->log("Sector relocated after ECC error", false, true, sector_id);
+        } else if (ret == DHARA_E_ECC && attempts < CONFIG_NAND_SCRUB_RETRIES) {
+            //read disturb or a marginal read may pass the next time, try again at the end of the queue
+            handle->scrub_queue[handle->scrub_count] = sector_id;
+            handle->scrub_pages[handle->scrub_count] = page;
+            handle->scrub_attempts[handle->scrub_count] = attempts;
+            handle->scrub_count++;
+        } else {
+            my_nand_handle->log("Sector could not be relocated", true, true, sector_id);
+        }
+    }
+
+    //the queue only changes under the mutex, the next run is armed before it is released
+    schedule_scrub_locked(handle);
+    unlock_background(handle);
+}
+#endif //CONFIG_NAND_SCRUB
+
+
+/**
+ * @brief Read one sector, the caller holds the mutex.
+ */
+static int read_sector_locked(nand_flash_device_t *handle, uint8_t *buffer, uint32_t sector_id)
+{
+    dhara_error_t err = DHARA_E_NONE;
+    int ret = 0;
+    NAND_TRACE_START(trace_start);
+
+    struct dhara_map *map = map_of(handle, sector_id);
+
+    if (dhara_map_read(map, sector_id, buffer, &err) == 0) {
+        ret = err;
+    } else if (err == DHARA_E_CHECKSUM) {
+        // The buffer does not hold the stored data, rewriting it would seal the corruption
+        my_nand_handle->log("Sector checksum mismatch", true, true, sector_id);
+        ret = err;
+    } else if (err == DHARA_E_ECC) {
+#ifdef CONFIG_NAND_SCRUB
+        // The failed read left the buffer unfilled, the scrub work reads the sector again later and relocates it
+        dhara_page_t page;
+
+        ret = err;
+        if (dhara_map_find(map, sector_id, &page, &err) != 0) {
+            my_nand_handle->log("Error while reading from map", true, true, err);
+        } else if (queue_scrub_locked(handle, sector_id, page) == 0) {
+            my_nand_handle->log("ECC error, sector queued for relocation", false, true, sector_id);
+        } else if (!erase_suspended(handle)) {
+            // The scrub work fell behind, this read pays for its sector
+            my_nand_handle->log("Scrub queue full, relocating sector now", false, true, sector_id);
+            ret = scrub_sector_locked(handle, sector_id, page, buffer);
+        }
+#else
+        // The failed read left the buffer unfilled, a rewrite would seal garbage over the sector
+        my_nand_handle->log("Uncorrectable ECC error", true, true, sector_id);
+        ret = err;
+#endif
+    } else {
+        my_nand_handle->log("Error while reading from map", true, true, err);
+        ret = err;
+    }
+    NAND_TRACE_END(NAND_TRACE_SECTOR_READ, ret, sector_id, 0, trace_start);
+    return ret;
+}
+
+
+/**
+ * @brief Write one sector, the caller holds the mutex.
+ */
+static int write_sector_locked(nand_flash_device_t *handle, const uint8_t *buffer, uint32_t sector_id)
 {
     dhara_error_t err;
     int ret = 0; 
+    NAND_TRACE_START(trace_start);
 
-    k_sem_take(&handle->mutex, K_FOREVER);
-
-    if (dhara_map_write(&handle->dhara_map, sector_id, buffer, &err)) {
+    struct dhara_map *map = map_of(handle, sector_id);
+    int fail = dhara_map_write(map, sector_id, buffer, &err);
+    if (drop_snapshot_if_full_locked(handle, fail, err)) {
+        fail = dhara_map_write(map, sector_id, buffer, &err);
+    }
+#ifdef CONFIG_NAND_HOT_COLD
+    if (!fail && sector_id == 0) {
+        check_hot_layout(handle, buffer);
+    }
+#endif
+    if (fail) {
         my_nand_handle->log("Error while writing to map", true, false, 0);
         ret = err; 
     }
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+    if (!fail && handle->dirty_pages++ == 0 && handle->sync_config.policy == NAND_SYNC_BOUNDED) {
+        //an armed deadline is kept, it bounds the age of the oldest unsynced page
+        k_work_schedule(&handle->sync_work, K_MSEC(handle->sync_config.max_delay_ms));
+    }
+#endif
+
+    NAND_TRACE_END(NAND_TRACE_SECTOR_WRITE, ret, sector_id, 0, trace_start);
+    return ret;
+}
+
 
+#ifdef CONFIG_NAND_CACHE_READ
+/**
+ * @brief Read sectors that lie on consecutive pages of one block, the caller holds the mutex.
+ *
+ * If any page fails, the run is read again sector by sector, that path retries,
+ * counts and repairs.
+ */
+static int read_run_locked(nand_flash_device_t *handle, struct dhara_map *map, uint8_t *buffer,
+                           uint32_t sector_id, dhara_page_t page, uint32_t count)
+{
+    dhara_error_t err;
+    int ret = 0;
+    NAND_TRACE_START(trace_start);
+
+    if (dhara_nand_read_seq(map->journal.nand, page, count, buffer, &err) != 0) {
+        for (uint32_t i = 0; i < count && ret == 0; i++) {
+            ret = read_sector_locked(handle, buffer + i * handle->page_size, sector_id + i);
+        }
+    }
+    NAND_TRACE_END(NAND_TRACE_SECTOR_READ, ret, sector_id, count, trace_start);
+    return ret;
+}
+#endif
+
+
+/**
+ * @brief Read consecutive page sized sectors, the caller holds the mutex.
+ *
+ * With CONFIG_NAND_CACHE_READ all sectors are looked up first. Runs of them on
+ * consecutive pages of one block, as a sequential recording leaves them, are
+ * streamed with the cache read sequence of the chip.
+ */
+static int read_pages_locked(nand_flash_device_t *handle, uint8_t *buffer, uint32_t sector_id, uint32_t count)
+{
+    int ret = 0;
+
+#ifdef CONFIG_NAND_CACHE_READ
+    const dhara_page_t block_mask = (1U << handle->dhara_nand.log2_ppb) - 1;
+    struct dhara_map *run_map = NULL;
+    dhara_page_t run_page = 0;
+    uint32_t run_start = 0;
+    uint32_t run_count = 0;
+
+    for (uint32_t i = 0; i < count && ret == 0; i++) {
+        struct dhara_map *map = map_of(handle, sector_id + i);
+        dhara_error_t err;
+        dhara_page_t page;
+        const bool found = dhara_map_find(map, sector_id + i, &page, &err) == 0;
+
+        if (run_count > 0 && (!found || map != run_map || page != run_page + run_count || (page & block_mask) == 0)) {
+            ret = read_run_locked(handle, run_map, buffer + run_start * handle->page_size, sector_id + run_start,
+                                  run_page, run_count);
+            run_count = 0;
+        }
+
+        if (ret != 0) {
+            break;
+        } else if (!found) {
+            //unmapped sectors (0xff) and lookup errors take the normal path
+            ret = read_sector_locked(handle, buffer + i * handle->page_size, sector_id + i);
+        } else if (run_count++ == 0) {
+            run_map = map;
+            run_page = page;
+            run_start = i;
+        }
+    }
+
+    if (ret == 0 && run_count > 0) {
+        ret = read_run_locked(handle, run_map, buffer + run_start * handle->page_size, sector_id + run_start,
+                              run_page, run_count);
+    }
+#else
+    for (uint32_t i = 0; i < count && ret == 0; i++) {
+        ret = read_sector_locked(handle, buffer + i * handle->page_size, sector_id + i);
+    }
+#endif
+    return ret;
+}
+
+
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+typedef int (*page_reader_t)(nand_flash_device_t *handle, uint8_t *buffer, uint32_t page);
+
+
+/**
+ * @brief Read a page into the merge buffer unless it is there already, the caller holds the mutex.
+ */
+static int load_page_locked(nand_flash_device_t *handle, uint32_t page)
+{
+    if (handle->merge_page == page) {
+        return 0;
+    }
+
+    handle->merge_page = NO_PAGE;
+    int ret = read_sector_locked(handle, handle->merge_buffer, page);
+    if (ret == 0) {
+        handle->merge_page = page;
+    }
+    return ret;
+}
+
+
+/**
+ * @brief Write the page buffer to the map, the caller holds the mutex.
+ *
+ * A page with all sectors written goes out as it is, otherwise the new sectors are
+ * merged into the stored page first. The buffer is empty afterwards, also on error.
+ */
+static int flush_combine_locked(nand_flash_device_t *handle)
+{
+    const uint32_t page = handle->combine_page;
+    const uint32_t sector_size = handle->sector_size;
+    int ret;
+
+    if (page == NO_PAGE) {
+        return 0;
+    }
+
+    if (handle->combine_mask == sector_bits(0, SECTORS_PER_PAGE(handle))) {
+        if (handle->merge_page == page) {
+            handle->merge_page = NO_PAGE;
+        }
+        ret = write_sector_locked(handle, handle->combine_buffer, page);
+    } else {
+        ret = load_page_locked(handle, page);
+        if (ret == 0) {
+            for (uint32_t i = 0; i < SECTORS_PER_PAGE(handle); i++) {
+                if (handle->combine_mask & BIT(i)) {
+                    memcpy(handle->merge_buffer + i * sector_size, handle->combine_buffer + i * sector_size,
+                           sector_size);
+                }
+            }
+            //the merge buffer now holds the new page and stays valid as read cache
+            ret = write_sector_locked(handle, handle->merge_buffer, page);
+        }
+        if (ret != 0) {
+            handle->merge_page = NO_PAGE;
+        }
+    }
+
+    handle->combine_page = NO_PAGE;
+    handle->combine_mask = 0;
+    return ret;
+}
+
+
+/**
+ * @brief Copy the sectors of the page buffer over pages just read from the map.
+ *
+ * @param buffer Holds the sectors first_sector up to first_sector + count.
+ */
+static void overlay_combine_locked(nand_flash_device_t *handle, uint8_t *buffer, uint32_t first_sector,
+                                   uint32_t count)
+{
+    const uint32_t per_page = SECTORS_PER_PAGE(handle);
+    const uint32_t sector_size = handle->sector_size;
+
+    if (handle->combine_page == NO_PAGE) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < per_page; i++) {
+        const uint32_t sector = handle->combine_page * per_page + i;
+
+        if ((handle->combine_mask & BIT(i)) && sector >= first_sector && sector - first_sector < count) {
+            memcpy(buffer + (sector - first_sector) * sector_size, handle->combine_buffer + i * sector_size,
+                   sector_size);
+        }
+    }
+}
+
+
+/**
+ * @brief Read consecutive sub-page sectors, the caller holds the mutex.
+ *
+ * Whole pages are read straight into the caller's buffer, partial ones through the
+ * merge buffer. Sectors waiting in the page buffer are newer than the map and are
+ * copied over the result, except for snapshot reads.
+ *
+ * @param read_page read_sector_locked for the live map, or the snapshot reader.
+ */
+static int read_subpage_locked(nand_flash_device_t *handle, uint8_t *buffer, uint32_t start_sector,
+                               uint32_t count, page_reader_t read_page)
+{
+    const uint32_t per_page = SECTORS_PER_PAGE(handle);
+    const uint32_t sector_size = handle->sector_size;
+    const bool live = read_page == read_sector_locked;
+    int ret = 0;
+
+    while (count > 0 && ret == 0) {
+        const uint32_t page = start_sector / per_page;
+        const uint32_t first = start_sector % per_page;
+        uint32_t n = MIN(count, per_page - first);
+
+        if (live && first == 0 && count >= per_page) {
+            //a run of whole pages in one go, the merge buffer holds nothing newer than the map
+            n = count - count % per_page;
+            ret = read_pages_locked(handle, buffer, page, n / per_page);
+        } else if (n == per_page) {
+            ret = read_page(handle, buffer, page);
+        } else if (live) {
+            ret = load_page_locked(handle, page);
+            if (ret == 0) {
+                memcpy(buffer, handle->merge_buffer + first * sector_size, n * sector_size);
+            }
+        } else {
+            //the merge buffer is only scratch space here, it must not cache snapshot data
+            handle->merge_page = NO_PAGE;
+            ret = read_page(handle, handle->merge_buffer, page);
+            if (ret == 0) {
+                memcpy(buffer, handle->merge_buffer + first * sector_size, n * sector_size);
+            }
+        }
+
+        if (ret == 0 && live) {
+            overlay_combine_locked(handle, buffer, start_sector, n);
+        }
+
+        buffer += n * sector_size;
+        start_sector += n;
+        count -= n;
+    }
+    return ret;
+}
+
+
+/**
+ * @brief Write consecutive sub-page sectors, the caller holds the mutex.
+ *
+ * Whole pages are written straight from the caller's buffer. Partial pages are
+ * collected in the page buffer, which is written when a sector of another page
+ * arrives, when the page is complete or on sync.
+ */
+static int write_subpage_locked(nand_flash_device_t *handle, const uint8_t *buffer, uint32_t start_sector,
+                                uint32_t count)
+{
+    const uint32_t per_page = SECTORS_PER_PAGE(handle);
+    const uint32_t sector_size = handle->sector_size;
+    int ret = 0;
+
+    while (count > 0 && ret == 0) {
+        const uint32_t page = start_sector / per_page;
+        const uint32_t first = start_sector % per_page;
+        const uint32_t n = MIN(count, per_page - first);
+
+        if (n == per_page) {
+            //replaces whatever the buffers hold of this page
+            if (handle->combine_page == page) {
+                handle->combine_page = NO_PAGE;
+                handle->combine_mask = 0;
+            }
+            if (handle->merge_page == page) {
+                handle->merge_page = NO_PAGE;
+            }
+            ret = write_sector_locked(handle, buffer, page);
+        } else {
+            if (handle->combine_page != page) {
+                ret = flush_combine_locked(handle);
+                if (ret != 0) {
+                    break;
+                }
+                handle->combine_page = page;
+            }
+            memcpy(handle->combine_buffer + first * sector_size, buffer, n * sector_size);
+            handle->combine_mask |= sector_bits(first, n);
+
+            if (handle->combine_mask == sector_bits(0, per_page)) {
+                ret = flush_combine_locked(handle);
+            }
+        }
+
+        buffer += n * sector_size;
+        start_sector += n;
+        count -= n;
+    }
+    return ret;
+}
+#endif //CONFIG_NAND_SUBPAGE_SECTORS
+
+
+/**
+ * @brief Sync one map, the caller holds the mutex.
+ *
+ * @return 0 on success, the dhara error otherwise.
+ */
+static int sync_map_locked(nand_flash_device_t *handle, struct dhara_map *map)
+{
+    dhara_error_t err = DHARA_E_NONE;
+    int fail = dhara_map_sync(map, &err);
+
+    if (drop_snapshot_if_full_locked(handle, fail, err)) {
+        fail = dhara_map_sync(map, &err);
+    }
+    return fail ? err : 0;
+}
+
+
+/**
+ * @brief Sync all maps, the caller holds the mutex.
+ */
+static int sync_locked(nand_flash_device_t *handle)
+{
+    int ret = 0;
+    NAND_TRACE_START(trace_start);
+
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    ret = flush_combine_locked(handle);
+#endif
+    if (ret == 0) {
+        ret = sync_map_locked(handle, &handle->dhara_map);
+    }
+#ifdef CONFIG_NAND_HOT_COLD
+    if (ret == 0) {
+        ret = sync_map_locked(handle, &handle->hot_map);
+    }
+#endif
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+    if (ret == 0) {
+        handle->dirty_pages = 0;
+    }
+#endif
+    NAND_TRACE_END(NAND_TRACE_SYNC, ret, 0, 0, trace_start);
+    return ret;
+}
+
+
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+/**
+ * @brief True if everything written is committed to the flash, the caller holds the mutex.
+ */
+static bool clean_locked(nand_flash_device_t *handle)
+{
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    if (handle->combine_page != NO_PAGE) {
+        return false;
+    }
+#endif
+#ifdef CONFIG_NAND_HOT_COLD
+    if (!dhara_journal_is_clean(&handle->hot_map.journal)) {
+        return false;
+    }
+#endif
+    return dhara_journal_is_clean(&handle->dhara_map.journal);
+}
+
+
+/**
+ * @brief Apply the dirty page limit after a write, the caller holds the mutex.
+ */
+static int sync_after_write_locked(nand_flash_device_t *handle)
+{
+    if (clean_locked(handle)) {
+        //a checkpoint group was completed, the writes are on the flash without padding
+        handle->dirty_pages = 0;
+        return 0;
+    }
+    if (handle->sync_config.max_dirty_pages != 0 && handle->dirty_pages >= handle->sync_config.max_dirty_pages) {
+        return sync_locked(handle);
+    }
+    return 0;
+}
+
+
+static void sync_work_handler(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    nand_flash_device_t *handle = CONTAINER_OF(dwork, nand_flash_device_t, sync_work);
+
+#ifdef CONFIG_NAND_READ_PRIORITY
+    //the deadline is a bound on lost data, not on latency, a few milliseconds later do no harm
+    if (atomic_get(&handle->readers_waiting) > 0) {
+        k_work_reschedule(dwork, K_MSEC(BACKGROUND_RETRY_MS));
+        return;
+    }
+#endif
+    int ret = nand_flash_sync(handle);
+    if (ret != 0) {
+        my_nand_handle->log("Scheduled sync failed", true, true, ret);
+    }
+}
+#endif //CONFIG_NAND_SYNC_SCHEDULER
+
+
+#ifdef CONFIG_NAND_ERASE_AHEAD
+/**
+ * @brief Erase the next block of each map, run once the writes paused.
+ *
+ * Never waits for the mutex: a busy device is not idle, the work is tried again later.
+ */
+static void erase_ahead_work_handler(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    nand_flash_device_t *handle = CONTAINER_OF(dwork, nand_flash_device_t, erase_ahead_work);
+    dhara_error_t err;
+
+    if (!try_lock_background(handle)) {
+        k_work_reschedule(dwork, K_MSEC(CONFIG_NAND_ERASE_AHEAD_IDLE_MS));
+        return;
+    }
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+    handle->background_erase = true;
+#endif
+    //a failed erase marked the block bad, the head skips it as before
+    if (dhara_map_erase_ahead(&handle->dhara_map, &err)) {
+        my_nand_handle->log("Erase ahead failed", true, true, err);
+    }
+#ifdef CONFIG_NAND_HOT_COLD
+    if (dhara_map_erase_ahead(&handle->hot_map, &err)) {
+        my_nand_handle->log("Erase ahead of the hot region failed", true, true, err);
+    }
+#endif
+#ifdef CONFIG_NAND_ERASE_SUSPEND
+    handle->background_erase = false;
+#endif
+    unlock_background(handle);
+}
+#endif //CONFIG_NAND_ERASE_AHEAD
+
+
+/**
+ * @brief Read consecutive disk sectors, the caller holds the mutex.
+ */
+static int read_sectors_locked(nand_flash_device_t *handle, uint8_t *buffer, uint32_t start_sector, uint32_t count)
+{
+    int ret;
+
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    ret = read_subpage_locked(handle, buffer, start_sector, count, read_sector_locked);
+#else
+    ret = read_pages_locked(handle, buffer, start_sector, count);
+#endif
+#ifdef CONFIG_NAND_CLOCK_CALIBRATION
+    //the patterns would overwrite the cache of a chip with a suspended erase
+    if (!erase_suspended(handle)) {
+        nand_clock_service(handle);
+    }
+#endif
+    return ret;
+}
+
+
+/**
+ * @brief Write consecutive disk sectors, the caller holds the mutex.
+ */
+static int write_sectors_locked(nand_flash_device_t *handle, const uint8_t *buffer, uint32_t start_sector,
+                                uint32_t count)
+{
+    int ret = 0;
+
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    ret = write_subpage_locked(handle, buffer, start_sector, count);
+#else
+    for (uint32_t i = 0; i < count && ret == 0; i++) {
+        ret = write_sector_locked(handle, buffer + i * handle->page_size, start_sector + i);
+    }
+#endif
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+    if (ret == 0) {
+        ret = sync_after_write_locked(handle);
+    }
+#endif
+#ifdef CONFIG_NAND_CLOCK_CALIBRATION
+    nand_clock_service(handle);
+#endif
+#ifdef CONFIG_NAND_ERASE_AHEAD
+    //every write pushes the erase back, it runs once the writes pause
+    k_work_reschedule(&handle->erase_ahead_work, K_MSEC(CONFIG_NAND_ERASE_AHEAD_IDLE_MS));
+#endif
+    return ret;
+}
+
+
+int nand_flash_read_sector(nand_flash_device_t *handle, uint8_t *buffer, uint32_t sector_id)
+{
+    lock_device_read(handle);
+    int ret = read_sectors_locked(handle, buffer, sector_id, 1);
     k_sem_give(&handle->mutex);
     return ret;
 }
 
 
-int nand_flash_sync(nand_flash_device_t *handle)
+int nand_flash_write_sector(nand_flash_device_t *handle, const uint8_t *buffer, uint32_t sector_id)
+{
+    lock_device(handle);
+    int ret = write_sectors_locked(handle, buffer, sector_id, 1);
+    k_sem_give(&handle->mutex);
+    return ret;
+}
+
+
+int nand_flash_read_sectors(nand_flash_device_t *handle, uint8_t *buffer, uint32_t start_sector, uint32_t count)
+{
+    //one lock for the whole run, a sync or GC step of another thread cannot slip in between the pages
+    lock_device_read(handle);
+    int ret = read_sectors_locked(handle, buffer, start_sector, count);
+    k_sem_give(&handle->mutex);
+    return ret;
+}
+
+
+int nand_flash_write_sectors(nand_flash_device_t *handle, const uint8_t *buffer, uint32_t start_sector, uint32_t count)
+{
+    lock_device(handle);
+    int ret = write_sectors_locked(handle, buffer, start_sector, count);
+    k_sem_give(&handle->mutex);
+    return ret;
+}
+
+
+#ifdef CONFIG_NAND_SNAPSHOT
+int nand_flash_snapshot_take(nand_flash_device_t *handle)
 {
     dhara_error_t err;
     int ret = 0;
 
-    k_sem_take(&handle->mutex, K_FOREVER);
+    lock_device(handle);
+    handle->snapshot_valid = false;
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    ret = flush_combine_locked(handle);
+#endif
+    if (ret == 0 && dhara_map_snapshot_take(&handle->dhara_map, &handle->snapshot, &err)) {
+        ret = err;
+    }
+#ifdef CONFIG_NAND_HOT_COLD
+    if (ret == 0 && dhara_map_snapshot_take(&handle->hot_map, &handle->hot_snapshot, &err)) {
+        ret = err;
+    }
+#endif
+    if (ret != 0) {
+        my_nand_handle->log("Failed to take snapshot", true, true, err);
+        release_snapshot_locked(handle);
+    } else {
+        handle->snapshot_valid = true;
+        handle->snapshot_id++;
+    }
+    k_sem_give(&handle->mutex);
+    return ret;
+}
 
-    if (dhara_map_sync(&handle->dhara_map, &err)) {
-        ret = err; 
+
+void nand_flash_snapshot_release(nand_flash_device_t *handle)
+{
+    lock_device(handle);
+    release_snapshot_locked(handle);
+    k_sem_give(&handle->mutex);
+}
+
+
+/**
+ * @brief Read one page of the snapshot, the caller holds the mutex.
+ */
+static int read_snapshot_page_locked(nand_flash_device_t *handle, uint8_t *buffer, uint32_t page)
+{
+    dhara_error_t err = DHARA_E_NONE;
+    const struct dhara_map_snapshot *snapshot = &handle->snapshot;
+#ifdef CONFIG_NAND_HOT_COLD
+    if (page < handle->hot_sectors) {
+        snapshot = &handle->hot_snapshot;
+    }
+#endif
+    //an uncorrectable page is reported, not rewritten, a rewrite would put old data into the live map
+    if (dhara_map_snapshot_read(map_of(handle, page), snapshot, page, buffer, &err)) {
+        my_nand_handle->log("Error while reading from snapshot", true, true, err);
+        return err;
     }
+    return 0;
+}
+
+
+int nand_flash_read_snapshot_sectors(nand_flash_device_t *handle, uint8_t *buffer, uint32_t start_sector, uint32_t count)
+{
+    int ret = 0;
 
+    lock_device_read(handle);
+    if (!handle->snapshot_valid) {
+        ret = -1;
+    }
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    if (ret == 0) {
+        ret = read_subpage_locked(handle, buffer, start_sector, count, read_snapshot_page_locked);
+    }
+#else
+    for (uint32_t i = 0; i < count && ret == 0; i++) {
+        ret = read_snapshot_page_locked(handle, buffer + i * handle->page_size, start_sector + i);
+    }
+#endif
+    k_sem_give(&handle->mutex);
+    return ret;
+}
+#endif
+
+
+int nand_flash_sync(nand_flash_device_t *handle)
+{
+    lock_device(handle);
+    int ret = sync_locked(handle);
+    k_sem_give(&handle->mutex);
+    return ret;
+}
+
+
+void nand_flash_lock_chips(nand_flash_device_t *handle)
+{
+    lock_device(handle);
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    nand_write_behind_finish();
+#endif
+}
+
+
+void nand_flash_unlock_chips(nand_flash_device_t *handle)
+{
+    k_sem_give(&handle->mutex);
+}
+
+
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+int nand_flash_request_sync(nand_flash_device_t *handle)
+{
+    int ret = 0;
+
+    lock_device(handle);
+    if (clean_locked(handle)) {
+        handle->dirty_pages = 0;
+    } else if (handle->power_low || handle->sync_config.policy == NAND_SYNC_IMMEDIATE) {
+        ret = sync_locked(handle);
+    }
+    //NAND_SYNC_BOUNDED has its deadline armed since the first dirty page, NAND_SYNC_POWER_SIGNAL waits
+    k_sem_give(&handle->mutex);
+    return ret;
+}
+
+
+int nand_flash_set_sync_policy(nand_flash_device_t *handle, const struct nand_sync_config *config)
+{
+    lock_device(handle);
+    int ret = sync_locked(handle);
+    handle->sync_config = *config;
     k_sem_give(&handle->mutex);
     return ret;
 }
 
 
+int nand_flash_set_power_low(nand_flash_device_t *handle, bool low)
+{
+    int ret = 0;
+
+    lock_device(handle);
+    handle->power_low = low;
+    if (low) {
+        my_nand_handle->log("NAND MAPPING LAYER: Low battery, syncing", false, false, 0);
+        ret = sync_locked(handle);
+    }
+    k_sem_give(&handle->mutex);
+    return ret;
+}
+#endif //CONFIG_NAND_SYNC_SCHEDULER
+
+
 int nand_flash_get_capacity(nand_flash_device_t *handle, uint32_t *number_of_sectors)
 {
     *number_of_sectors = dhara_map_capacity(&handle->dhara_map);
+#ifdef CONFIG_NAND_HOT_COLD
+    *number_of_sectors += handle->hot_sectors;
+#endif
+    *number_of_sectors *= SECTORS_PER_PAGE(handle);
     return 0; 
 }
 
 
 int nand_flash_get_sector_size(nand_flash_device_t *handle, uint32_t *sector_size)
 {
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    *sector_size = handle->sector_size;
+#else
     *sector_size = handle->page_size;
+#endif
     return 0;
 }
 
 int nand_flash_deinit_device(nand_flash_device_t *handle)
 {
+#ifdef CONFIG_NAND_SYNC_SCHEDULER
+    struct k_work_sync sync;
+
+    k_work_cancel_delayable_sync(&handle->sync_work, &sync);
+#endif
+#ifdef CONFIG_NAND_ERASE_AHEAD
+    struct k_work_sync erase_sync;
+
+    k_work_cancel_delayable_sync(&handle->erase_ahead_work, &erase_sync);
+#endif
+#ifdef CONFIG_NAND_WRITE_BEHIND
+    //a failed page that was not synced is lost like any other unsynced write
+    nand_write_behind_reset();
+#endif
+#ifdef CONFIG_NAND_SCRUB
+    struct k_work_sync scrub_sync;
+
+    //sectors still queued are read again and queued by their next read
+    k_work_cancel_delayable_sync(&handle->scrub_work, &scrub_sync);
+    handle->scrub_count = 0;
+    if (handle->scrub_buffer != NULL) {
+        free(handle->scrub_buffer);
+        handle->scrub_buffer = NULL;
+    }
+#endif
     if (handle->work_buffer != NULL) {
         free(handle->work_buffer);
         handle->work_buffer = NULL;
     }
+#ifdef CONFIG_NAND_HOT_COLD
+    if (handle->hot_work_buffer != NULL) {
+        free(handle->hot_work_buffer);
+        handle->hot_work_buffer = NULL;
+    }
+#endif
+#ifdef CONFIG_NAND_SUBPAGE_SECTORS
+    free_subpage(handle);
+#endif
     //free(handle);
     return 0;
 }
@@ -0,0 +1,130 @@
+/**
+ * @file nand_trace.c
+ * @brief Binary event trace of the NAND stack
+ *
+ * RAM ring of 16 byte records, see nand_trace.h. Records are claimed with an atomic
+ * increment, so recording needs no lock and is safe from any thread. Each slot has a
+ * sequence word, cleared before the record is filled and set to its number + 1 after,
+ * so readers skip records that are being written or were overwritten while copied.
+ */
+
+#ifdef CONFIG_NAND_TRACE
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#include "../inc/nand_trace.h"
+
+#define TRACE_RECORDS CONFIG_NAND_TRACE_RECORDS
+
+BUILD_ASSERT(sizeof(struct nand_trace_record) == 16, "The host decoder expects 16 byte records");
+
+static struct nand_trace_record ring[TRACE_RECORDS];
+static atomic_t valid[TRACE_RECORDS];//number + 1 of the complete record in the slot, 0 while it is filled
+static atomic_t written = ATOMIC_INIT(0);//records written since the last clear, the ring index is this modulo TRACE_RECORDS
+static atomic_t enabled = ATOMIC_INIT(1);
+
+
+void nand_trace_record(uint8_t type, uint8_t code, uint32_t arg, uint16_t len, uint32_t start)
+{
+    if (!atomic_get(&enabled)) {
+        return;
+    }
+
+    const uint32_t now = k_cycle_get_32();
+    const uint32_t number = (uint32_t)atomic_inc(&written);
+    const uint32_t slot = number % TRACE_RECORDS;
+    struct nand_trace_record *r = &ring[slot];
+
+    atomic_set(&valid[slot], 0);
+    r->start = start;
+    r->duration = now - start;
+    r->arg = arg;
+    r->type = type;
+    r->code = code;
+    r->len = len;
+    atomic_set(&valid[slot], number + 1);//last, the record is complete
+}
+
+
+/**
+ * @brief Copy record number out of the ring.
+ *
+ * @return false if the record is still being written or was overwritten meanwhile.
+ */
+static bool read_record(uint32_t number, struct nand_trace_record *out)
+{
+    const uint32_t slot = number % TRACE_RECORDS;
+
+    if ((uint32_t)atomic_get(&valid[slot]) != number + 1) {
+        return false;
+    }
+
+    *out = ring[slot];
+    //a writer clears the word before it touches the record, so an unchanged word means an intact copy
+    return (uint32_t)atomic_get(&valid[slot]) == number + 1;
+}
+
+void nand_trace_enable(bool enable)
+{
+    atomic_set(&enabled, enable ? 1 : 0);
+}
+
+void nand_trace_clear(void)
+{
+    atomic_set(&written, 0);
+    for (uint32_t i = 0; i < TRACE_RECORDS; i++) {
+        atomic_set(&valid[i], 0);
+    }
+}
+
+size_t nand_trace_snapshot(struct nand_trace_record *out, size_t max)
+{
+    const uint32_t total = (uint32_t)atomic_get(&written);
+    const uint32_t count = MIN(MIN(total, TRACE_RECORDS), max);
+    const uint32_t first = total - count;
+    size_t copied = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (read_record(first + i, &out[copied])) {
+            copied++;
+        }
+    }
+
+    return copied;
+}
+
+void nand_trace_dump(void)
+{
+    const bool was_enabled = atomic_set(&enabled, 0) != 0;
+    const uint32_t total = (uint32_t)atomic_get(&written);
+    const uint32_t count = MIN(total, TRACE_RECORDS);
+
+    //the header gives the decoder the time base and tells it how much was lost,
+    //records still being written by a thread that passed the enabled check are left out
+    printk("NTR hz=%u records=%u dropped=%u\n", sys_clock_hw_cycles_per_sec(), count, total - count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct nand_trace_record record;
+        const uint8_t *bytes = (const uint8_t *)&record;
+        char line[2 * sizeof(struct nand_trace_record) + 1];
+
+        if (!read_record(total - count + i, &record)) {
+            continue;
+        }
+
+        for (size_t b = 0; b < sizeof(struct nand_trace_record); b++) {
+            static const char hex[] = "0123456789abcdef";
+            line[2 * b] = hex[bytes[b] >> 4];
+            line[2 * b + 1] = hex[bytes[b] & 0x0F];
+        }
+        line[sizeof(line) - 1] = '\0';
+        printk("NTR %s\n", line);
+    }
+
+    printk("NTR end\n");
+    atomic_set(&enabled, was_enabled ? 1 : 0);
+}
+
+#endif //CONFIG_NAND_TRACE
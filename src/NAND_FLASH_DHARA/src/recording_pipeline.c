@@ -0,0 +1,162 @@
+/**
+ * @file recording_pipeline.c
+ * @brief Producer/consumer pipeline between the sampling code and the flash
+ *
+ * head and tail count the bytes pushed and written since the start of the session.
+ * Only the producer moves head and only the writer moves tail, so one atomic store
+ * each publishes the data; the ring size is a power of two and the counters may wrap.
+ * The writer always takes whole chunks at chunk aligned positions, a chunk therefore
+ * never wraps around the end of the ring and is written straight from it.
+ */
+
+#ifdef CONFIG_NAND_RECORDING_PIPELINE
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+
+#include "../inc/recording_pipeline.h"
+
+LOG_MODULE_REGISTER(recording_pipeline, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define RING_SIZE CONFIG_NAND_RECORDING_PIPELINE_RING_SIZE
+#define CHUNK_SIZE CONFIG_NAND_RECORDING_PIPELINE_CHUNK_SIZE
+
+BUILD_ASSERT((RING_SIZE & (RING_SIZE - 1)) == 0, "The ring size must be a power of two");
+BUILD_ASSERT(RING_SIZE % CHUNK_SIZE == 0 && RING_SIZE >= 2 * CHUNK_SIZE,
+             "The ring must hold at least two whole chunks");
+
+static uint8_t ring[RING_SIZE] __aligned(4);
+static atomic_t head = ATOMIC_INIT(0);
+static atomic_t tail = ATOMIC_INIT(0);
+static atomic_t running = ATOMIC_INIT(0);
+
+static struct k_sem data_ready;
+static struct k_thread writer_thread;
+static K_THREAD_STACK_DEFINE(writer_stack, CONFIG_NAND_RECORDING_PIPELINE_STACK_SIZE);
+
+static struct nand_recording recording;
+static struct recording_pipeline_stats stats;
+
+
+static void writer_entry(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (true) {
+        k_sem_take(&data_ready, K_FOREVER);
+
+        const bool stopping = !atomic_get(&running);
+        uint32_t t = (uint32_t)atomic_get(&tail);
+        uint32_t used = (uint32_t)atomic_get(&head) - t;
+
+        //whole chunks only, the rest waits for the next one unless the session ends
+        while (used >= CHUNK_SIZE || (stopping && used > 0)) {
+            const size_t len = MIN(used, CHUNK_SIZE);
+            const uint32_t start = k_cycle_get_32();
+
+            int ret = nand_recording_write(&recording, &ring[t % RING_SIZE], len);
+            if (ret != 0 && stats.error == 0) {
+                //keep draining so the producer is not blocked, the data is lost anyway
+                LOG_ERR("Recording write failed: %d", ret);
+                stats.error = ret;
+            }
+
+            const uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+            stats.max_write_us = MAX(stats.max_write_us, us);
+            stats.chunks++;
+
+            t += len;
+            atomic_set(&tail, t);
+            used = (uint32_t)atomic_get(&head) - t;
+        }
+
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+
+int recording_pipeline_start(const char *path, FSIZE_t reserve)
+{
+    if (atomic_get(&running)) {
+        return -EBUSY;
+    }
+
+    int ret = nand_recording_open(&recording, path, reserve);
+    if (ret != 0) {
+        return ret;
+    }
+
+    atomic_set(&head, 0);
+    atomic_set(&tail, 0);
+    memset(&stats, 0, sizeof(stats));
+    k_sem_init(&data_ready, 0, K_SEM_MAX_LIMIT);
+    atomic_set(&running, 1);
+
+    k_thread_create(&writer_thread, writer_stack, K_THREAD_STACK_SIZEOF(writer_stack), writer_entry,
+                    NULL, NULL, NULL, CONFIG_NAND_RECORDING_PIPELINE_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&writer_thread, "rec_writer");
+    return 0;
+}
+
+
+int recording_pipeline_push(const void *data, size_t len)
+{
+    if (!atomic_get(&running)) {
+        return -EAGAIN;
+    }
+
+    const uint32_t h = (uint32_t)atomic_get(&head);
+    const uint32_t used = h - (uint32_t)atomic_get(&tail);
+
+    if (len > RING_SIZE - used) {
+        stats.overflows++;
+        stats.dropped_bytes += len;
+        return -ENOSPC;
+    }
+
+    const uint32_t pos = h % RING_SIZE;
+    const size_t first = MIN(len, RING_SIZE - pos);
+    memcpy(&ring[pos], data, first);
+    memcpy(ring, (const uint8_t *)data + first, len - first);
+
+    atomic_set(&head, h + len); //publishes the copy to the writer
+    stats.high_water = MAX(stats.high_water, used + len);
+
+    //wake the writer once per completed chunk, not per sample
+    if (h / CHUNK_SIZE != (h + len) / CHUNK_SIZE) {
+        k_sem_give(&data_ready);
+    }
+    return 0;
+}
+
+
+int recording_pipeline_stop(void)
+{
+    if (!atomic_cas(&running, 1, 0)) {
+        return -EALREADY;
+    }
+
+    k_sem_give(&data_ready);
+    k_thread_join(&writer_thread, K_FOREVER);
+
+    int ret = nand_recording_close(&recording);
+    LOG_INF("Recording stopped: %u chunks, high water %u of %u bytes, %u samples dropped, slowest write %u us",
+            stats.chunks, stats.high_water, RING_SIZE, stats.overflows, stats.max_write_us);
+
+    return stats.error != 0 ? stats.error : ret;
+}
+
+
+void recording_pipeline_get_stats(struct recording_pipeline_stats *out)
+{
+    *out = stats;
+}
+
+#endif //CONFIG_NAND_RECORDING_PIPELINE
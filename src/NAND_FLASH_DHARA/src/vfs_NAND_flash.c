@@ -6,6 +6,9 @@
 #include <zephyr/storage/disk_access.h>
 #include <ff.h>
 
+#include <errno.h>
+#include <string.h>
+
 #include "../inc/vfs_NAND_flash.h"
 #include "../inc/diskio_nand.h"
 
@@ -51,4 +54,118 @@ int unmount_nand_fs(void) {
 }
 
 
+
+/////////////////////////           PREALLOCATED RECORDINGS        ///////////////////////////////////
+
+/**
+ * @brief Translate a FatFs result to an errno code.
+ */
+static int recording_errno(FRESULT res)
+{
+    switch (res) {
+    case FR_OK:
+        return 0;
+    case FR_NO_FILE:
+    case FR_NO_PATH:
+        return -ENOENT;
+    case FR_DENIED:
+        return -ENOSPC;
+    case FR_EXIST:
+        return -EEXIST;
+    case FR_INVALID_NAME:
+        return -EINVAL;
+    case FR_WRITE_PROTECTED:
+        return -EROFS;
+    default:
+        return -EIO;
+    }
+}
+
+int nand_recording_open(struct nand_recording *rec, const char *path, FSIZE_t reserve)
+{
+    FRESULT res;
+
+    //FatFs addresses the volume as "NAND:", without the leading slash of the mount point
+    if (path[0] == '/') {
+        path++;
+    }
+
+    memset(rec, 0, sizeof(*rec));
+    res = f_open(&rec->fil, path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (res != FR_OK) {
+        LOG_ERR("VFS Layer: Failed to create recording %s (%d)", path, res);
+        return recording_errno(res);
+    }
+
+#if FF_USE_EXPAND
+    //one contiguous run of clusters, the data goes to consecutive sectors
+    res = f_expand(&rec->fil, reserve, 1);
+    if (res == FR_DENIED) {
+        //no contiguous run that long, fall back to a fragmented chain
+        res = f_lseek(&rec->fil, reserve);
+    }
+#else
+    res = f_lseek(&rec->fil, reserve);
+#endif
+    if (res == FR_OK && f_size(&rec->fil) < reserve) {
+        res = FR_DENIED; //volume full, f_lseek stops at the end of the free space
+    }
+    if (res == FR_OK) {
+        res = f_lseek(&rec->fil, 0);
+    }
+    if (res == FR_OK) {
+        res = f_sync(&rec->fil); //the chain goes to the FAT once, here
+    }
+    if (res != FR_OK) {
+        LOG_ERR("VFS Layer: Failed to preallocate %u bytes for %s (%d)", (uint32_t)reserve, path, res);
+        f_close(&rec->fil);
+        f_unlink(path);
+        return recording_errno(res);
+    }
+
+    rec->reserved = reserve;
+    return 0;
+}
+
+int nand_recording_write(struct nand_recording *rec, const void *data, size_t len)
+{
+    UINT written;
+    FRESULT res = f_write(&rec->fil, data, len, &written);
+
+    rec->written += written;
+    if (res != FR_OK) {
+        LOG_ERR("VFS Layer: Recording write failed (%d)", res);
+        return recording_errno(res);
+    }
+    if (written < len) {
+        return -ENOSPC;
+    }
+    return 0;
+}
+
+int nand_recording_sync(struct nand_recording *rec)
+{
+    return recording_errno(f_sync(&rec->fil));
+}
+
+int nand_recording_close(struct nand_recording *rec)
+{
+    FRESULT res = f_lseek(&rec->fil, rec->written);
+
+    if (res == FR_OK) {
+        res = f_truncate(&rec->fil);
+    }
+
+    FRESULT close_res = f_close(&rec->fil);
+    if (res == FR_OK) {
+        res = close_res;
+    }
+    if (res != FR_OK) {
+        LOG_ERR("VFS Layer: Failed to finalize recording (%d)", res);
+    }
+    return recording_errno(res);
+}
+
+
+
 //SYS_INIT(mount_nand_fs, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEVICE);
\ No newline at end of file
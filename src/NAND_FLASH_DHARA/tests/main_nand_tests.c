@@ -18,6 +18,7 @@
 #include    "vfs_NAND_flash.h"
 #include    "diskio_nand.h"
 #include    "nand_driver.h"
+#include    "nand_stats.h"
 #include    "nand_top_layer.h"
 
 #define MAX_PATH_LEN 255
@@ -1302,6 +1303,10 @@ int test_write_read_speed_chunks(void) {
     int64_t write_times[num_sizes];
     int64_t read_times[num_sizes];
 
+#ifdef CONFIG_NAND_STATS
+    nand_stats_reset();
+#endif
+
     // Loop through each size and perform the test
     for (size_t i = 0; i < num_sizes; i++) {
         size_t content_len = sizes[i];
@@ -1341,6 +1346,10 @@ int test_write_read_speed_chunks(void) {
         fs_unlink(fname);
     }
 
+#ifdef CONFIG_NAND_STATS
+    nand_stats_dump();//where the time of the loop above went, per layer
+#endif
+
     int rc = lsdir(nand_mount_fat.mnt_point);
     if (rc < 0) {
         LOG_PRINTK("FAIL: lsdir %s: %d\n", nand_mount_fat.mnt_point, rc);
@@ -19,34 +19,24 @@
 #include "nand_top_layer.h"
 
 #include "simulation_test.h"
+#include "recording_pipeline.h"
 
 #define STACK_SIZE 2048
 #define PRIORITY 5
 #define FILE_NAME "/test_simulation.txt"
 
 #define DATA_SIZE 30 //bytes generated by the sensors at 120 Hz IMU and mag
+#define RECORDING_SIZE (1024 * 1024) //preallocated per session, about 6 minutes of samples
 #define MAX_PATH_LEN 255
 
 
 static struct fs_file_t file;
+static struct nand_recording recording;
 static char data[DATA_SIZE] = {0};  // 2KB buffer
 const char *startoffile = "This is a header\n";
 
 LOG_MODULE_REGISTER(simulation_test, LOG_LEVEL_INF);
 
-static int append_to_file(const char *filename, const char *data, size_t length) {
-    
-
-    int rc = fs_write(&file, data, length);
-    if (rc < 0) {
-        printk("Failed to write to file %s: %d\n", filename, rc);
-        fs_close(&file);
-        return -1;
-    }
-    
-    return 0;
-}
-
 /**
  * @brief Test if a file can be created on the NAND filesystem.
  * 
@@ -166,10 +156,6 @@ int simulate_incoming_data(void) {
 
     snprintf(fname, sizeof(fname), "%s/%s", nand_mount_fat.mnt_point, FILE_NAME);
     delete_file_if_exists(fname);
-    
-
-    
-    ret = create_file(fname);
 
     fill_data_buffer();
 
@@ -191,19 +177,49 @@ int simulate_incoming_data(void) {
 	}
 
     LOG_INF("Starting virtual sampling");
-    fs_file_t_init(&file);
 
-    int rc = fs_open(&file, fname, FS_O_RDWR | FS_O_APPEND);
+#ifdef CONFIG_NAND_RECORDING_PIPELINE
+    //sampling only fills the ring, the writer thread takes the flash latency
+    int rc = recording_pipeline_start(fname, RECORDING_SIZE);
     if (rc < 0) {
-        printk("Failed to open file %s: %d\n", fname, rc);
+        printk("Failed to start recording %s: %d\n", fname, rc);
+        return -1;
+    }
+
+    recording_pipeline_push(startoffile, strlen(startoffile));
+    for (size_t bytes = strlen(startoffile); bytes + DATA_SIZE <= RECORDING_SIZE; bytes += DATA_SIZE) {
+        recording_pipeline_push(data, DATA_SIZE); //a full ring drops the sample, see the stats
+        k_msleep(10);
+    }
+
+    rc = recording_pipeline_stop();
+    if (rc != 0) {
+        printk("Recording %s failed: %d\n", fname, rc);
+    }
+
+    struct recording_pipeline_stats stats;
+    recording_pipeline_get_stats(&stats);
+    LOG_INF("Ring high water %u bytes, %u samples dropped", stats.high_water, stats.overflows);
+    return 0;
+#else
+    //the clusters of the whole session are allocated up front, appends do not touch the FAT
+    int rc = nand_recording_open(&recording, fname, RECORDING_SIZE);
+    if (rc < 0) {
+        printk("Failed to open recording %s: %d\n", fname, rc);
         return -1;
     }
-    while (1) {
-        rc = append_to_file(fname, data, DATA_SIZE);
-        if(rc != 0){break;}
+
+    rc = nand_recording_write(&recording, startoffile, strlen(startoffile));
+    while (rc == 0 && recording.written + DATA_SIZE <= recording.reserved) {
+        rc = nand_recording_write(&recording, data, DATA_SIZE);
         k_msleep(10);
     }
-    fs_close(&file);
+    if (rc != 0) {
+        printk("Failed to write to recording %s: %d\n", fname, rc);
+    }
+
+    nand_recording_close(&recording);
    
     return 0;
+#endif
 }
@@ -5,6 +5,8 @@
 #include "nand.h"
 
 #include "nand_driver.h"
+#include "nand_chip_info.h"
+#include "nand_top_layer.h"
 #include "spi_nand_oper_tests.h"
 #include <zephyr/devicetree.h>
 
@@ -187,6 +189,42 @@ int test_IDs_spi_nand(const struct spi_dt_spec *dev){
 
 
 
+int test_chip_info_spi_nand(const struct spi_dt_spec *dev){
+
+    LOG_INF("Test 1b: test chip identification and parameter page");
+
+    if (!device_is_ready(dev->bus)) {
+        LOG_ERR("Test 1b: Device not ready");
+        return -1;
+    }
+
+    struct nand_chip_info info;
+    int ret = nand_chip_identify(&info);
+    if (ret != 0) {
+        LOG_ERR("Failed to identify the chip");
+        return ret;
+    }
+
+    LOG_INF("%s: MI 0x%x DI 0x%x, %u blocks of %u pages of %u + %u bytes",
+            info.name, info.manufacturer_id, info.device_id, info.num_blocks,
+            1u << info.log2_ppb, 1u << info.log2_page_size, info.oob_size);
+    LOG_INF("tR %u us, tPROG %u us, tBERS %u us, ECC %u bits, features 0x%x (%s)",
+            info.t_r_us, info.t_prog_us, info.t_bers_us, info.ecc_bits, info.features,
+            (info.features & NAND_CHIP_PARAM_PAGE) ? "parameter page" : "device table");
+
+    //the configuration register must be back to normal operation, not the OTP area
+    uint8_t config;
+    ret = nand_read_register(REG_CONFIG, &config);
+    if (ret != 0 || (config & CFG_OTP_ENABLE) != 0) {
+        LOG_ERR("OTP area still selected after the parameter page, config 0x%x", config);
+        return -1;
+    }
+    return 0;
+}
+
+
+
+
 //final test, write and read it
 int test_spi_nand_write_read(const struct spi_dt_spec *dev) {
     LOG_INF("Test 6: testing SPI NAND write and read register");
@@ -379,6 +417,144 @@ static uint8_t pattern_buf[2048];
 static uint8_t temp_buf[2175];
 
 //final test, write and read it
+int test_spi_nand_batch_write_read(const struct spi_dt_spec *dev) {
+    LOG_INF("Test 6b: testing erase and program as batches of transactions");
+    const uint8_t data[4] = {0x5A, 0xA5, 0x3C, 0xC3};
+    uint32_t page = 64;//first page of block 1
+    uint8_t readings[4] = {0};
+    uint8_t status;
+
+    if (!device_is_ready(dev->bus)) {
+        LOG_ERR("Device not ready");
+        return -1;
+    }
+
+    //write enable and erase in one batch
+    int ret = nand_enable_and_erase_block(page);
+    if (ret != 0) {
+        LOG_ERR("Test 6b: Failed to erase block, error: %d", ret);
+        return -1;
+    }
+    ret = wait_for_ready(&status);
+    if (ret != 0 || (status & STAT_ERASE_FAILED) != 0) {
+        LOG_ERR("Test 6b: Erase failed, status 0x%x", status);
+        return -1;
+    }
+
+    //write enable, program load and program execute in one batch
+    ret = nand_enable_and_program_page(page, data, 0, sizeof(data));
+    if (ret != 0) {
+        LOG_ERR("Test 6b: Failed to program page, error: %d", ret);
+        return -1;
+    }
+    ret = wait_for_ready(&status);
+    if (ret != 0 || (status & STAT_PROGRAM_FAILED) != 0) {
+        LOG_ERR("Test 6b: Program failed, status 0x%x", status);
+        return -1;
+    }
+
+    ret = nand_read_page(page);
+    if (ret == 0) {
+        ret = wait_for_ready(NULL);
+    }
+    if (ret == 0) {
+        ret = nand_read(readings, 0, sizeof(readings));
+    }
+    if (ret != 0) {
+        LOG_ERR("Test 6b: Failed to read page %u, error: %d", page, ret);
+        return -1;
+    }
+
+    if (memcmp(readings, data, sizeof(data)) != 0) {
+        LOG_ERR("Test 6b: Read 0x%02x%02x%02x%02x instead of the programmed data",
+                readings[0], readings[1], readings[2], readings[3]);
+        return -1;
+    }
+
+    LOG_INF("Test 6b: No error thrown");
+    return 0;
+}
+
+
+
+#ifdef CONFIG_NAND_PLANE_PAIRS
+int test_plane_pair_write_read(const struct spi_dt_spec *dev) {
+    LOG_INF("Test 6c: one program execute programs the caches of both planes");
+    struct nand_chip_info info;
+    uint8_t status;
+
+    if (!device_is_ready(dev->bus)) {
+        LOG_ERR("Device not ready");
+        return -1;
+    }
+    if (nand_chip_identify(&info) != 0) {
+        LOG_ERR("Test 6c: Failed to identify the chip");
+        return -1;
+    }
+    if (info.planes != 2) {
+        LOG_INF("Test 6c: %s has one plane, skipped", info.name);
+        return 0;
+    }
+
+    //the driver is switched to plane pairs for the test, whatever the flag of the part says
+    const struct nand_chip_info saved_chip = device_handle->chip;
+    const bool saved_pairs = device_handle->plane_pairs;
+    const uint16_t length = 2U << info.log2_page_size;//the data of both planes, the on-die ECC owns parts of the spare areas
+    const uint32_t page = (1U << info.log2_ppb) * nand_stripe_width();//the second block, not the one with the map
+    uint8_t *pattern = malloc(length);
+    uint8_t *readings = malloc(length);
+    int ret = -1;
+
+    device_handle->chip = info;
+    device_handle->plane_pairs = true;
+
+    if (pattern == NULL || readings == NULL) {
+        LOG_ERR("Test 6c: No memory for %u bytes", length);
+        goto end;
+    }
+    fill_buffer(PATTERN_SEED, pattern, length);
+
+    if (nand_enable_and_erase_block(page) != 0 || wait_for_ready(&status) != 0 ||
+        (status & STAT_ERASE_FAILED) != 0) {
+        LOG_ERR("Test 6c: Erase of the block pair failed");
+        goto end;
+    }
+    if (nand_enable_and_program_page(page, pattern, 0, length) != 0 || wait_for_ready(&status) != 0 ||
+        (status & STAT_PROGRAM_FAILED) != 0) {
+        LOG_ERR("Test 6c: Program of the pair page failed");
+        goto end;
+    }
+    if (nand_read_page(page) != 0 || wait_for_ready(NULL) != 0 || nand_read(readings, 0, length) != 0) {
+        LOG_ERR("Test 6c: Failed to read the pair page");
+        goto end;
+    }
+
+    //a part that programs the addressed plane only reads back 0xFF in the other half
+    if (memcmp(readings, pattern, length) != 0) {
+        LOG_ERR("Test 6c: %s does not program both planes, do not flag it NAND_CHIP_DUAL_PLANE_PROGRAM", info.name);
+        goto end;
+    }
+
+    //the pair is left erased
+    ret = nand_enable_and_erase_block(page);
+    if (ret == 0) {
+        ret = wait_for_ready(NULL);
+    }
+    if (ret == 0) {
+        LOG_INF("Test 6c: %s may be flagged NAND_CHIP_DUAL_PLANE_PROGRAM", info.name);
+    }
+
+end:
+    device_handle->chip = saved_chip;
+    device_handle->plane_pairs = saved_pairs;
+    free(pattern);
+    free(readings);
+    return ret;
+}
+#endif
+
+
+
 int test_spi_nand_sector_write_read(const struct spi_dt_spec *dev) {
     LOG_INF("Test 7: testing NAND sector write and read register");
 
@@ -586,6 +762,13 @@ int test_SPI_NAND_Communicator_all_tests(const struct spi_dt_spec *dev) {
         LOG_ERR("Device & Manufacturer ID test failed");
         return ret;
     }
+
+    //test 1b
+    ret = test_chip_info_spi_nand(dev);
+    if (ret != 0) {
+        LOG_ERR("Chip identification test failed");
+        return ret;
+    }
     
     
 
@@ -629,6 +812,24 @@ int test_SPI_NAND_Communicator_all_tests(const struct spi_dt_spec *dev) {
     }
 
 
+    //test 6b
+    ret = test_spi_nand_batch_write_read(dev);
+    if (ret != 0) {
+        LOG_ERR("Batch write and read test failed");
+        return ret;
+    }
+
+
+#ifdef CONFIG_NAND_PLANE_PAIRS
+    //test 6c
+    ret = test_plane_pair_write_read(dev);
+    if (ret != 0) {
+        LOG_ERR("Plane pair write and read test failed");
+        return ret;
+    }
+#endif
+
+
     //test 7
     ret = test_spi_nand_sector_write_read(dev);
     if (ret != 0) {
@@ -101,6 +101,17 @@ int test_erase_block_spi_nand(const struct spi_dt_spec *dev);
  */
 int test_IDs_spi_nand(const struct spi_dt_spec *dev);
 
+/**
+ * @brief Test the identification of the chip from its parameter page or the device table.
+ *
+ * Logs geometry, spare size, timings and features, and checks that the chip left
+ * the OTP area after reading the parameter page.
+ *
+ * @param dev Pointer to the SPI device structure.
+ * @return Returns 0 on success, or -1 if the chip is unknown or still in the OTP area.
+ */
+int test_chip_info_spi_nand(const struct spi_dt_spec *dev);
+
 /**
  * @brief Tests the SPI NAND write and read operation.
  *
@@ -112,6 +123,31 @@ int test_IDs_spi_nand(const struct spi_dt_spec *dev);
  */
 int test_spi_nand_write_read(const struct spi_dt_spec *dev);
 
+/**
+ * @brief Tests the batched erase and program of the driver.
+ *
+ * Erases block 1 with nand_enable_and_erase_block(), programs its first page with
+ * nand_enable_and_program_page() and reads the data back.
+ *
+ * @param dev Pointer to the SPI device structure.
+ * @return Returns 0 on success, or -1 if a step failed or the data differs.
+ */
+int test_spi_nand_batch_write_read(const struct spi_dt_spec *dev);
+
+#ifdef CONFIG_NAND_PLANE_PAIRS
+/**
+ * @brief Tests the dual-plane program of a 2-plane chip, skipped on other chips.
+ *
+ * Switches the driver to plane pairs for the test, erases blocks 2 and 3, programs
+ * a pair page with one program execute and reads both halves back. A part passes
+ * before it gets NAND_CHIP_DUAL_PLANE_PROGRAM in the chip table.
+ *
+ * @param dev Pointer to the SPI device structure.
+ * @return Returns 0 on success or on a 1-plane chip, -1 if a step failed or the data differs.
+ */
+int test_plane_pair_write_read(const struct spi_dt_spec *dev);
+#endif
+
 /**
  * @brief Tests the SPI NAND write and read operation on an entire sector.
  *
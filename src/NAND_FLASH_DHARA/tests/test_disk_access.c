@@ -4,6 +4,7 @@
 #include "zephyr/storage/disk_access.h"
 
 #include "diskio_nand.h"
+#include "nand_top_layer.h"
 #include "test_disk_access.h"
 #include <zephyr/devicetree.h>
 
@@ -128,3 +129,78 @@ int test_disk_initialize_status_read(struct disk_info *nand_disk){
     return 0;
 
 }
+
+
+#define MULTI_SECTORS   4
+#define MULTI_START     16
+
+//test multi-sector write and a sequential read stream, which goes through the read ahead with CONFIG_NAND_USB_OFFLOAD
+int test_disk_multi_sector(struct disk_info *nand_disk){
+
+    uint32_t sector_size;
+    int ret = 0;
+
+    //2048 byte pages, 4096 byte pages, plane pairs and sub-page sectors all differ
+    if(nand_flash_get_sector_size(device_handle, &sector_size) != 0 || sector_size == 0){
+        LOG_ERR("Failed to get the sector size");
+        return -1;
+    }
+
+    const size_t total = MULTI_SECTORS * sector_size;
+    uint8_t *pattern_buf = malloc(total);
+    uint8_t *temp_buf = malloc(total);
+    if(pattern_buf == NULL || temp_buf == NULL){
+        LOG_ERR("Failed to allocate %zu bytes of test buffers", 2 * total);
+        ret = -1;
+        goto end;
+    }
+
+    fill_buffer(PATTERN_SEED + 1, pattern_buf, total);
+
+    if(nand_disk_access_write(nand_disk, pattern_buf, MULTI_START, MULTI_SECTORS) != 0){
+        LOG_ERR("Failed to write %d sectors on disk level", MULTI_SECTORS);
+        ret = -1;
+        goto end;
+    }
+
+    //one sector at a time, every read after the first is sequential
+    memset(temp_buf, 0x00, total);
+    for (int i = 0; i < MULTI_SECTORS; i++) {
+        if(nand_disk_access_read(nand_disk, temp_buf + i * sector_size, MULTI_START + i, 1) != 0){
+            LOG_ERR("Failed to read sector %d on disk level", MULTI_START + i);
+            ret = -1;
+            goto end;
+        }
+    }
+    if(check_buffer(PATTERN_SEED + 1, temp_buf, total) != 0){
+        LOG_ERR("Sequential single sector reads differ from the multi-sector write");
+        ret = -1;
+    }
+
+    //overwrite a sector the read ahead may hold, then read everything at once
+    fill_buffer(PATTERN_SEED + 2, pattern_buf + sector_size, sector_size);
+    if(nand_disk_access_write(nand_disk, pattern_buf + sector_size, MULTI_START + 1, 1) != 0){
+        LOG_ERR("Failed to overwrite sector %d on disk level", MULTI_START + 1);
+        ret = -1;
+        goto end;
+    }
+    memset(temp_buf, 0x00, total);
+    if(nand_disk_access_read(nand_disk, temp_buf, MULTI_START, MULTI_SECTORS) != 0){
+        LOG_ERR("Failed to read %d sectors on disk level", MULTI_SECTORS);
+        ret = -1;
+        goto end;
+    }
+    if(memcmp(temp_buf, pattern_buf, total) != 0){
+        LOG_ERR("Multi-sector read returned stale data");
+        ret = -1;
+    }
+
+    if(ret == 0){
+        LOG_INF("Multi-sector disk access passed, sector size %u", sector_size);
+    }
+
+end:
+    free(pattern_buf);
+    free(temp_buf);
+    return ret;
+}
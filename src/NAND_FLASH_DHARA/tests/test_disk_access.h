@@ -23,6 +23,8 @@
 
 int test_disk_initialize_status_read(struct disk_info *nand_disk);
 
+int test_disk_multi_sector(struct disk_info *nand_disk);
+
 
 
 #endif //TEST_DISK_ACCESS
\ No newline at end of file
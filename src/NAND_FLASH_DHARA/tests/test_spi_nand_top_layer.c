@@ -24,6 +24,7 @@ LOG_MODULE_REGISTER(test_spi_nand_top_layer, CONFIG_LOG_DEFAULT_LEVEL);
 
 
 #define PATTERN_SEED    0x12345678
+#define WRITE_BEHIND_PAGES 8
 
 
 //put the spi_handle into the spi_nand_flash_device_t struct and initialize the device
@@ -264,6 +265,82 @@ int test2_writing_tests_top_layer(const struct spi_dt_spec *spi)
 
 
 
+int test_write_behind_read_back(const struct spi_dt_spec *spi)
+{
+    const struct dhara_nand *n = &device_handle->dhara_nand;
+    const dhara_block_t block = n->num_blocks - 1;//the map starts at block 0 after the chip erase
+    const dhara_page_t first = block << n->log2_ppb;
+    const size_t page_size = device_handle->page_size;
+    dhara_error_t err = DHARA_E_NONE;
+    int ret = 0;
+
+    LOG_INF("Test 2b: pages programmed behind each other read back unchanged");
+
+    uint8_t *pattern_buf = malloc(page_size);
+    uint8_t *temp_buf = malloc(page_size);
+    if (pattern_buf == NULL || temp_buf == NULL) {
+        LOG_ERR("Test 2b: no memory for the page buffers");
+        ret = -1;
+        goto end;
+    }
+
+    if (dhara_nand_erase(n, block, &err) != 0) {
+        LOG_ERR("Test 2b: erase of block %u failed, error: %d", block, err);
+        ret = -1;
+        goto end;
+    }
+
+    //every page is sent while the one before may still program, a load the chip
+    //dropped shows up as a page with the content of the one before
+    for (int i = 0; i < WRITE_BEHIND_PAGES; i++) {
+        fill_buffer(PATTERN_SEED + i, pattern_buf, page_size);
+        if (dhara_nand_prog_behind(n, first + i, pattern_buf, &err) != 0) {
+            LOG_ERR("Test 2b: program of page %d failed, error: %d", i, err);
+            ret = -1;
+            goto end;
+        }
+    }
+
+    //the last page is waited for, it also reports a failure of the page before
+    fill_buffer(PATTERN_SEED + WRITE_BEHIND_PAGES, pattern_buf, page_size);
+    if (dhara_nand_prog(n, first + WRITE_BEHIND_PAGES, pattern_buf, &err) != 0) {
+        LOG_ERR("Test 2b: program of page %d failed, error: %d", WRITE_BEHIND_PAGES, err);
+        ret = -1;
+        goto end;
+    }
+
+    for (int i = 0; i <= WRITE_BEHIND_PAGES; i++) {
+        memset(temp_buf, 0x00, page_size);
+        if (dhara_nand_read(n, first + i, 0, page_size, temp_buf, &err) != 0) {
+            LOG_ERR("Test 2b: read of page %d failed, error: %d", i, err);
+            ret = -1;
+            break;
+        }
+        if (check_buffer(PATTERN_SEED + i, temp_buf, page_size) != 0) {
+            LOG_ERR("Test 2b: page %d does not read back as programmed", i);
+            ret = -1;
+            break;
+        }
+    }
+
+    //dhara expects the block erased or holding its own pages
+    if (dhara_nand_erase(n, block, &err) != 0) {
+        LOG_ERR("Test 2b: erase of block %u failed, error: %d", block, err);
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        LOG_INF("Test 2b: %d pages programmed behind each other read back", WRITE_BEHIND_PAGES + 1);
+    }
+
+end:
+    free(pattern_buf);
+    free(temp_buf);
+    return ret;
+}
+
+
+
 int test_struct_handling(const struct spi_dt_spec *spi){
     static uint8_t pattern_buf[2048];
     static uint8_t temp_buf[2048];
@@ -340,6 +417,11 @@ int test_nand_top_layer(const struct spi_dt_spec *spidev_dt){
     }
     LOG_INF("setup erase deinit finished");
 
+    if(test_write_behind_read_back(spidev_dt) != 0){
+        LOG_ERR("Failed write behind read back test");
+        return -1;
+    }
+
     if(test_struct_handling(spidev_dt) != 0){
         LOG_ERR("Failed to write to random secor");
         return -1;
@@ -81,6 +81,18 @@ int do_single_write_test(nand_flash_device_t *flash, uint32_t start_sec, uint16_
  */
 int test2_writing_tests_top_layer(const struct spi_dt_spec *spi);
 
+/**
+ * Programs consecutive pages of the last block with dhara_nand_prog_behind() and reads them back.
+ *
+ * Each page is transferred while the one before may still program. A chip that drops a load
+ * sent during its busy time programs the content of the page before, which the read back finds.
+ * The block is erased again afterwards.
+ *
+ * @param[in] spi Pointer to the SPI device specification structure.
+ * @return 0 on success, negative error code on failure.
+ */
+int test_write_behind_read_back(const struct spi_dt_spec *spi);
+
 /**
  * Tests writing and reading to and from a specific sector using the NAND flash device.
  *
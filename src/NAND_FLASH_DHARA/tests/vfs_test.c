@@ -10,6 +10,7 @@
 #include <zephyr/drivers/flash.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include <zephyr/storage/disk_access.h>
 #include <ff.h> 
@@ -280,10 +281,75 @@ int nand_binary_file_adj(char *fname)
 
 
 
+/* Preallocate 64 KiB, fill only part of it and check that close trims the rest */
+#define RECORDING_RESERVE (64 * 1024)
+#define RECORDING_CHUNKS 50
+
+static int nand_recording_test(char *fname)
+{
+	struct nand_recording rec;
+	struct fs_dirent entry;
+	struct fs_file_t file;
+	uint8_t read_back[TEST_FILE_SIZE];
+	int rc;
+
+	init_pattern(file_test_pattern, sizeof(file_test_pattern));
+
+	rc = nand_recording_open(&rec, fname, RECORDING_RESERVE);
+	if (rc) {
+		LOG_PRINTK("FAIL: recording open %s: %d\n", fname, rc);
+		return rc;
+	}
+
+	for (int i = 0; i < RECORDING_CHUNKS; i++) {
+		rc = nand_recording_write(&rec, file_test_pattern, sizeof(file_test_pattern));
+		if (rc) {
+			LOG_PRINTK("FAIL: recording write: %d\n", rc);
+			nand_recording_close(&rec);
+			return rc;
+		}
+	}
+
+	rc = nand_recording_close(&rec);
+	if (rc) {
+		LOG_PRINTK("FAIL: recording close: %d\n", rc);
+		return rc;
+	}
+
+	rc = fs_stat(fname, &entry);
+	if (rc || entry.size != RECORDING_CHUNKS * sizeof(file_test_pattern)) {
+		LOG_PRINTK("FAIL: recording size %zu, expected %zu\n", entry.size,
+			   RECORDING_CHUNKS * sizeof(file_test_pattern));
+		return -1;
+	}
+
+	fs_file_t_init(&file);
+	rc = fs_open(&file, fname, FS_O_READ);
+	if (rc) {
+		LOG_PRINTK("FAIL: open %s: %d\n", fname, rc);
+		return rc;
+	}
+
+	for (int i = 0; i < RECORDING_CHUNKS && rc == 0; i++) {
+		if (fs_read(&file, read_back, sizeof(read_back)) != sizeof(read_back) ||
+		    memcmp(read_back, file_test_pattern, sizeof(read_back)) != 0) {
+			LOG_PRINTK("FAIL: recording chunk %d differs\n", i);
+			rc = -1;
+		}
+	}
+
+	fs_close(&file);
+	if (rc == 0) {
+		LOG_PRINTK("%s: recording of %zu bytes ok\n", fname, entry.size);
+	}
+	return rc;
+}
+
 int test_vfs_NAND_flash(void)
 {
 	char fname1[MAX_PATH_LEN];
 	char fname2[MAX_PATH_LEN];
+	char fname3[MAX_PATH_LEN];
 	struct fs_statvfs sbuf;
 	int rc;
 
@@ -299,6 +365,7 @@ int test_vfs_NAND_flash(void)
 
 	snprintf(fname1, sizeof(fname1), "%s/boot_count", nand_mount_fat.mnt_point);
 	snprintf(fname2, sizeof(fname2), "%s/pattern.bin", nand_mount_fat.mnt_point);
+	snprintf(fname3, sizeof(fname3), "%s/recording.bin", nand_mount_fat.mnt_point);
 	
 
 	rc = fs_statvfs(nand_mount_fat.mnt_point, &sbuf);
@@ -329,6 +396,11 @@ int test_vfs_NAND_flash(void)
 		goto out;
 	}
 
+	rc = nand_recording_test(fname3);
+	if (rc) {
+		goto out;
+	}
+
 out:
 	rc = fs_unmount(&nand_mount_fat);
 	LOG_PRINTK("%s unmount: %d\n", nand_mount_fat.mnt_point, rc);
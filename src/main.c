@@ -60,6 +60,7 @@ int  main(void)
     // }
 
 	//test_disk_initialize_status_read(&nand_disk);
+	//test_disk_multi_sector(&nand_disk);
 
 	//test_vfs_NAND_flash();
 	